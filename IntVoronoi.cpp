@@ -0,0 +1,599 @@
+#include "IntVoronoi.h"
+#include "predicates.h"
+#include "sort.h"
+#include "int128.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using namespace predicates;
+
+namespace
+{
+  /// Разнести младшие 32 бита value по четным битам результата.
+  uint64_t SpreadBits(uint64_t value)
+  {
+    value &= 0xFFFFFFFFu;
+    value = (value | (value << 16)) & 0x0000FFFF0000FFFFull;
+    value = (value | (value << 8)) & 0x00FF00FF00FF00FFull;
+    value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    value = (value | (value << 2)) & 0x3333333333333333ull;
+    value = (value | (value << 1)) & 0x5555555555555555ull;
+    return value;
+  }
+
+  /// Неотрицательная координата для ключей сортировки.
+  uint64_t Offset(int32_t value)
+  {
+    return static_cast<uint64_t>(static_cast<int64_t>(value) + MAX_INT_COORDINATE);
+  }
+
+  /// Ключ порядка Мортона (Z-кривая).
+  uint64_t MortonKey(const glm::ivec2 &site)
+  {
+    return SpreadBits(Offset(site.x)) | (SpreadBits(Offset(site.y)) << 1);
+  }
+
+  /// Ключ лексикографического порядка (x, затем y).
+  uint64_t LexicographicKey(const glm::ivec2 &site)
+  {
+    return (Offset(site.x) << 32) | Offset(site.y);
+  }
+
+  int64_t Dot(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &origin)
+  {
+    return (static_cast<int64_t>(a.x) - origin.x) * (static_cast<int64_t>(b.x) - origin.x) +
+           (static_cast<int64_t>(a.y) - origin.y) * (static_cast<int64_t>(b.y) - origin.y);
+  }
+}
+
+IntVoronoi::IntVoronoi()
+  : mSize(0, 0), mStamp(0), mLast(0)
+{
+}
+
+IntVoronoi::IntVoronoi(const std::vector<glm::ivec2> &sites, const glm::ivec2 &size)
+  : mListSite(sites), mSize(size), mStamp(0), mLast(0)
+{
+  assert(size.x >= 0 && size.x <= MAX_INT_COORDINATE);
+  assert(size.y >= 0 && size.y <= MAX_INT_COORDINATE);
+#ifndef NDEBUG
+  for(auto it = mListSite.begin(); it != mListSite.end(); ++it)
+  {
+    assert((*it).x >= -MAX_INT_COORDINATE && (*it).x <= MAX_INT_COORDINATE);
+    assert((*it).y >= -MAX_INT_COORDINATE && (*it).y <= MAX_INT_COORDINATE);
+  }
+#endif
+}
+
+IntVoronoi &IntVoronoi::operator()()
+{
+  Clear();
+
+  mListVertex.reserve(mListSite.size() * 2);
+  mListEdge.reserve(mListSite.size() * 3);
+
+  if(Triangulate())
+  {
+    BuildEdges();
+  }
+  else
+  {
+    BuildCollinearEdges();
+  }
+
+  ReleaseProcess();
+  return *this;
+}
+
+void IntVoronoi::Clear()
+{
+  std::vector<Vertex>().swap(mListVertex);
+  std::vector<Edge>().swap(mListEdge);
+}
+
+void IntVoronoi::ReleaseProcess()
+{
+  std::vector<Triangle>().swap(mTriangles);
+  std::vector<int>().swap(mTriangleVertex);
+  std::vector<int>().swap(mMarks);
+}
+
+bool IntVoronoi::Triangulate()
+{
+  const unsigned int count = static_cast<unsigned int>(mListSite.size());
+  if(count < 3)
+  {
+    return false;
+  }
+
+  // Точки вставляются в порядке Мортона, поэтому соседние вставки близки
+  // и поиск треугольника от последнего созданного короткий.
+  std::vector<uint64_t> keys(count);
+  std::vector<unsigned int> order(count);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    keys[i] = MortonKey(mListSite[i]);
+    order[i] = i;
+  }
+  RadixSort(keys, order, 1);
+
+  // Начальный треугольник из первых трех точек, не лежащих на одной прямой.
+  const int a = order[0];
+  unsigned int bi = 1;
+  while(bi < count && mListSite[order[bi]] == mListSite[a])
+  {
+    ++bi;
+  }
+  if(bi == count)
+  {
+    return false;
+  }
+  unsigned int ci = bi + 1;
+  while(ci < count && IntOrient2d(mListSite[a], mListSite[order[bi]], mListSite[order[ci]]) == 0)
+  {
+    ++ci;
+  }
+  if(ci == count)
+  {
+    return false;
+  }
+
+  int b = order[bi];
+  int c = order[ci];
+  if(IntOrient2d(mListSite[a], mListSite[b], mListSite[c]) < 0)
+  {
+    std::swap(b, c);
+  }
+
+  mTriangles.reserve(count * 2 + 4);
+  const Triangle initial[4] =
+  {
+    {{a, b, c}, {-1, -1, -1}},
+    {{b, a, INFINITE}, {-1, -1, -1}},
+    {{c, b, INFINITE}, {-1, -1, -1}},
+    {{a, c, INFINITE}, {-1, -1, -1}},
+  };
+  mTriangles.assign(initial, initial + 4);
+
+  // Связываем треугольники по общим ребрам.
+  for(int t1 = 0; t1 < 4; ++t1)
+  {
+    for(int i1 = 0; i1 < 3; ++i1)
+    {
+      for(int t2 = 0; t2 < 4; ++t2)
+      {
+        for(int i2 = 0; i2 < 3; ++i2)
+        {
+          if(mTriangles[t1].v[(i1 + 1) % 3] == mTriangles[t2].v[(i2 + 2) % 3] &&
+             mTriangles[t1].v[(i1 + 2) % 3] == mTriangles[t2].v[(i2 + 1) % 3])
+          {
+            mTriangles[t1].n[i1] = t2;
+          }
+        }
+      }
+    }
+  }
+
+  mMarks.assign(mTriangles.size(), 0);
+  mStamp = 0;
+  mLast = 0;
+
+  for(unsigned int i = 1; i < count; ++i)
+  {
+    if(i != bi && i != ci)
+    {
+      Insert(order[i]);
+    }
+  }
+  return true;
+}
+
+int IntVoronoi::Locate(int site) const
+{
+  const glm::ivec2 &point = mListSite[site];
+
+  // Обход по видимости. В триангуляции Делоне он не зацикливается.
+  int triangle = mLast;
+  for(;;)
+  {
+    const Triangle &current = mTriangles[triangle];
+    int next = -1;
+    for(int i = 0; i < 3; ++i)
+    {
+      if(IntOrient2d(mListSite[current.v[(i + 1) % 3]], mListSite[current.v[(i + 2) % 3]], point) < 0)
+      {
+        next = current.n[i];
+        break;
+      }
+    }
+
+    if(next < 0)
+    {
+      // Точка внутри треугольника или на его границе.
+      for(int i = 0; i < 3; ++i)
+      {
+        if(mListSite[current.v[i]] == point)
+        {
+          return -1;
+        }
+      }
+      return triangle;
+    }
+
+    const Triangle &neighbor = mTriangles[next];
+    if(neighbor.v[0] == INFINITE || neighbor.v[1] == INFINITE || neighbor.v[2] == INFINITE)
+    {
+      // Точка снаружи оболочки.
+      return next;
+    }
+    triangle = next;
+  }
+}
+
+bool IntVoronoi::InConflict(int triangle, int site) const
+{
+  const Triangle &t = mTriangles[triangle];
+  const glm::ivec2 &point = mListSite[site];
+
+  for(int k = 0; k < 3; ++k)
+  {
+    if(t.v[k] == INFINITE)
+    {
+      // Ребро оболочки a -> b, снаружи слева от него.
+      const glm::ivec2 &a = mListSite[t.v[(k + 1) % 3]];
+      const glm::ivec2 &b = mListSite[t.v[(k + 2) % 3]];
+      const int64_t orientation = IntOrient2d(a, b, point);
+      if(orientation != 0)
+      {
+        return orientation > 0;
+      }
+      // Точка на прямой ребра конфликтует, если лежит строго внутри ребра.
+      return Dot(point, b, a) > 0 && Dot(point, a, b) > 0;
+    }
+  }
+
+  return IntInCircle(mListSite[t.v[0]], mListSite[t.v[1]], mListSite[t.v[2]], point) > 0;
+}
+
+void IntVoronoi::Insert(int site)
+{
+  const int start = Locate(site);
+  if(start < 0)
+  {
+    // Совпадающая точка.
+    return;
+  }
+
+  // Ищем область конфликта и ее границу.
+  struct Border
+  {
+    int triangle;
+    int index;
+  };
+
+  ++mStamp;
+  std::vector<int> cavity;
+  std::vector<int> stack;
+  std::vector<Border> border;
+
+  mMarks[start] = mStamp;
+  cavity.push_back(start);
+  stack.push_back(start);
+  while(!stack.empty())
+  {
+    const int current = stack.back();
+    stack.pop_back();
+    for(int i = 0; i < 3; ++i)
+    {
+      const int neighbor = mTriangles[current].n[i];
+      if(mMarks[neighbor] == mStamp)
+      {
+        continue;
+      }
+      if(mMarks[neighbor] != -mStamp && InConflict(neighbor, site))
+      {
+        mMarks[neighbor] = mStamp;
+        cavity.push_back(neighbor);
+        stack.push_back(neighbor);
+        continue;
+      }
+      mMarks[neighbor] = -mStamp;
+      Border edge = {current, i};
+      border.push_back(edge);
+    }
+  }
+
+  // Новые треугольники соединяют точку с ребрами границы.
+  // Запоминаем все до изменения треугольников, т.к. их места переиспользуются.
+  struct Fan
+  {
+    Triangle triangle;
+    int index;
+    int outer;
+    int outerIndex;
+  };
+  std::vector<Fan> fan(border.size());
+  for(size_t k = 0; k < border.size(); ++k)
+  {
+    const Triangle &old = mTriangles[border[k].triangle];
+    Fan &item = fan[k];
+    item.triangle = old;
+    item.index = border[k].index;
+    item.triangle.v[item.index] = site;
+    item.outer = old.n[item.index];
+    item.outerIndex = 0;
+    while(mTriangles[item.outer].n[item.outerIndex] != border[k].triangle)
+    {
+      ++item.outerIndex;
+      assert(item.outerIndex < 3);
+    }
+  }
+
+  // Новых треугольников на два больше, чем удаленных.
+  std::vector<int> slots(cavity);
+  while(slots.size() < fan.size())
+  {
+    slots.push_back(static_cast<int>(mTriangles.size()));
+    mTriangles.push_back(Triangle());
+  }
+  mMarks.resize(mTriangles.size(), 0);
+
+  // Ребра с новой точкой: вершина на другом конце ребра -> треугольник и индекс.
+  std::vector<std::pair<int, std::pair<int, int>>> spokes;
+  spokes.reserve(fan.size() * 2);
+
+  for(size_t k = 0; k < fan.size(); ++k)
+  {
+    const int slot = slots[k];
+    Triangle &triangle = mTriangles[slot];
+    triangle = fan[k].triangle;
+    triangle.n[fan[k].index] = fan[k].outer;
+    mTriangles[fan[k].outer].n[fan[k].outerIndex] = slot;
+
+    const int i = fan[k].index;
+    const int spokeEnds[2] = {triangle.v[(i + 1) % 3], triangle.v[(i + 2) % 3]};
+    const int spokeIndices[2] = {(i + 2) % 3, (i + 1) % 3};
+    for(int s = 0; s < 2; ++s)
+    {
+      auto it = spokes.begin();
+      while(it != spokes.end() && (*it).first != spokeEnds[s])
+      {
+        ++it;
+      }
+      if(it == spokes.end())
+      {
+        spokes.push_back(std::make_pair(spokeEnds[s], std::make_pair(slot, spokeIndices[s])));
+      }
+      else
+      {
+        triangle.n[spokeIndices[s]] = (*it).second.first;
+        mTriangles[(*it).second.first].n[(*it).second.second] = slot;
+      }
+    }
+
+    if(triangle.v[0] != INFINITE && triangle.v[1] != INFINITE && triangle.v[2] != INFINITE)
+    {
+      mLast = slot;
+    }
+  }
+}
+
+IntVoronoi::Fraction IntVoronoi::CircleParameter(int site1, int site2, int site3) const
+{
+  const glm::ivec2 &a = mListSite[site1];
+  const glm::ivec2 &b = mListSite[site2];
+  const glm::ivec2 &c = mListSite[site3];
+
+  // Центр O = (a + b) / 2 + t * d, d = (a -> b) повернутый на 90 градусов.
+  // |O - a| = |O - c| дает t = (c - a)(c - b) / (2 * (b - a) x (c - a)).
+  Fraction t;
+  t.num = Dot(a, b, c);
+  t.den = 2 * IntOrient2d(a, b, c);
+  assert(t.den != 0);
+  if(t.den < 0)
+  {
+    t.num = -t.num;
+    t.den = -t.den;
+  }
+  return t;
+}
+
+void IntVoronoi::BuildEdges()
+{
+  mTriangleVertex.assign(mTriangles.size(), -1);
+
+  for(int t = 0; t < static_cast<int>(mTriangles.size()); ++t)
+  {
+    const Triangle &triangle = mTriangles[t];
+    if(triangle.v[0] == INFINITE || triangle.v[1] == INFINITE || triangle.v[2] == INFINITE)
+    {
+      continue;
+    }
+
+    for(int i = 0; i < 3; ++i)
+    {
+      const int neighbor = triangle.n[i];
+      const Triangle &other = mTriangles[neighbor];
+      const bool infinite = other.v[0] == INFINITE || other.v[1] == INFINITE || other.v[2] == INFINITE;
+      if(!infinite && neighbor < t)
+      {
+        // Ребро уже обработано из соседа.
+        continue;
+      }
+
+      // Ребро site1 -> site2 идет против часовой стрелки, треугольник слева от него.
+      // Грань идет от центра правого треугольника к центру левого.
+      const int site1 = triangle.v[(i + 1) % 3];
+      const int site2 = triangle.v[(i + 2) % 3];
+      const Fraction to = CircleParameter(site1, site2, triangle.v[i]);
+
+      if(infinite)
+      {
+        std::pair<int, int> vertices = AddEdge(site1, site2, nullptr, &to, -1, mTriangleVertex[t]);
+        if(vertices.second >= 0)
+        {
+          mTriangleVertex[t] = vertices.second;
+        }
+        continue;
+      }
+
+      int j = 0;
+      while(other.n[j] != t)
+      {
+        ++j;
+      }
+      const Fraction from = CircleParameter(site1, site2, other.v[j]);
+      assert(Int128::Mul(from.num, to.den) < Int128::Mul(to.num, from.den) ||
+             Int128::Mul(from.num, to.den) == Int128::Mul(to.num, from.den));
+
+      std::pair<int, int> vertices = AddEdge(site1, site2, &from, &to, mTriangleVertex[neighbor], mTriangleVertex[t]);
+      if(vertices.first >= 0)
+      {
+        mTriangleVertex[neighbor] = vertices.first;
+      }
+      if(vertices.second >= 0)
+      {
+        mTriangleVertex[t] = vertices.second;
+      }
+    }
+  }
+}
+
+void IntVoronoi::BuildCollinearEdges()
+{
+  // Все точки на одной прямой: ячейки - полосы между соседними точками.
+  const unsigned int count = static_cast<unsigned int>(mListSite.size());
+  std::vector<uint64_t> keys(count);
+  std::vector<unsigned int> order(count);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    keys[i] = LexicographicKey(mListSite[i]);
+    order[i] = i;
+  }
+  RadixSort(keys, order, 1);
+
+  for(unsigned int i = 1; i < count; ++i)
+  {
+    if(keys[i] != keys[i - 1])
+    {
+      AddEdge(order[i - 1], order[i], nullptr, nullptr, -1, -1);
+    }
+  }
+}
+
+std::pair<int, int> IntVoronoi::AddEdge(int site1, int site2, const Fraction *from, const Fraction *to,
+                                        int fromVertex, int toVertex)
+{
+  const glm::ivec2 &a = mListSite[site1];
+  const glm::ivec2 &b = mListSite[site2];
+
+  // Удвоенная середина и направление перпендикуляра.
+  const int64_t middle[2] = {static_cast<int64_t>(a.x) + b.x, static_cast<int64_t>(a.y) + b.y};
+  const int64_t dir[2] = {static_cast<int64_t>(a.y) - b.y, static_cast<int64_t>(b.x) - a.x};
+  const int64_t size[2] = {mSize.x, mSize.y};
+
+  auto Less = [](const Fraction &f1, const Fraction &f2)
+  {
+    return Int128::Mul(f1.num, f2.den) < Int128::Mul(f2.num, f1.den);
+  };
+
+  // Отсечение Лианга-Барски в параметре t.
+  Fraction low = from ? *from : Fraction();
+  Fraction high = to ? *to : Fraction();
+  bool hasLow = from != nullptr;
+  bool hasHigh = to != nullptr;
+  bool clipLow = false;
+  bool clipHigh = false;
+
+  for(int axis = 0; axis < 2; ++axis)
+  {
+    // 0 <= middle + 2 * t * dir <= 2 * size.
+    if(dir[axis] == 0)
+    {
+      if(middle[axis] < 0 || middle[axis] > 2 * size[axis])
+      {
+        return std::make_pair(-1, -1);
+      }
+      continue;
+    }
+
+    Fraction t1 = {-middle[axis], 2 * dir[axis]};
+    Fraction t2 = {2 * size[axis] - middle[axis], 2 * dir[axis]};
+    if(dir[axis] < 0)
+    {
+      std::swap(t1, t2);
+      t1.num = -t1.num;
+      t1.den = -t1.den;
+      t2.num = -t2.num;
+      t2.den = -t2.den;
+    }
+
+    if(!hasLow || Less(low, t1))
+    {
+      low = t1;
+      hasLow = true;
+      clipLow = true;
+    }
+    if(!hasHigh || Less(t2, high))
+    {
+      high = t2;
+      hasHigh = true;
+      clipHigh = true;
+    }
+  }
+  assert(hasLow && hasHigh);
+
+  if(!Less(low, high))
+  {
+    return std::make_pair(-1, -1);
+  }
+
+  const int vertex1 = !clipLow && fromVertex >= 0 ? fromVertex : NewVertex(site1, site2, low);
+  const int vertex2 = !clipHigh && toVertex >= 0 ? toVertex : NewVertex(site1, site2, high);
+  mListEdge.push_back(Edge(site1, site2, vertex1, vertex2));
+
+  return std::make_pair(clipLow ? -1 : vertex1, clipHigh ? -1 : vertex2);
+}
+
+int IntVoronoi::NewVertex(int site1, int site2, const Fraction &t)
+{
+  const glm::ivec2 &a = mListSite[site1];
+  const glm::ivec2 &b = mListSite[site2];
+
+  // x = (a.x + b.x) / 2 + t * dir.x = ((a.x + b.x) * den + 2 * num * dir.x) / (2 * den).
+  const Int128 x = Int128::Mul(static_cast<int64_t>(a.x) + b.x, t.den) +
+                   Int128::Mul(2 * t.num, static_cast<int64_t>(a.y) - b.y);
+  const Int128 y = Int128::Mul(static_cast<int64_t>(a.y) + b.y, t.den) +
+                   Int128::Mul(2 * t.num, static_cast<int64_t>(b.x) - a.x);
+
+  mListVertex.push_back(Vertex((x << FRACTION_BITS).DivRound(2 * t.den),
+                               (y << FRACTION_BITS).DivRound(2 * t.den)));
+  return static_cast<int>(mListVertex.size()) - 1;
+}
+
+const std::vector<glm::ivec2> &IntVoronoi::GetSites() const
+{
+  return mListSite;
+}
+
+const std::vector<IntVoronoi::Edge> &IntVoronoi::GetEdges() const
+{
+  return mListEdge;
+}
+
+const std::vector<IntVoronoi::Vertex> &IntVoronoi::GetVertex() const
+{
+  return mListVertex;
+}
+
+const glm::ivec2 &IntVoronoi::GetSize() const
+{
+  return mSize;
+}
+
+glm::dvec2 IntVoronoi::ToPoint(const Vertex &vertex)
+{
+  const double scale = 1.0 / static_cast<double>(1 << FRACTION_BITS);
+  return glm::dvec2(static_cast<double>(vertex.x) * scale, static_cast<double>(vertex.y) * scale);
+}
@@ -0,0 +1,158 @@
+#ifndef INTVORONOI_H
+#define INTVORONOI_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <vector>
+
+/// Диаграмма Вороного для точек с целыми координатами.
+/// Диаграмма строится как двойственная к триангуляции Делоне. Все решения
+/// принимаются точными целочисленными предикатами (64 и 128 бит), вершины
+/// выдаются в фиксированной точке. Результат побитово совпадает на любой
+/// платформе, с любым компилятором и флагами оптимизации (FMA, fast-math).
+/// Грани имеют тот же смысл, что и у Voronoi: отрезки срединных перпендикуляров,
+/// обрезанные рабочей областью, site1 слева, site2 справа от направления
+/// vertex1 -> vertex2. Вершины внутри области общие для сходящихся в них граней.
+class IntVoronoi
+{
+public:
+  /// Количество дробных бит координат вершин.
+  static const unsigned int FRACTION_BITS = 16;
+
+  /// Вершина в фиксированной точке: координата = значение / 2^FRACTION_BITS.
+  struct Vertex
+  {
+    int64_t x;
+    int64_t y;
+    Vertex(int64_t _x, int64_t _y)
+      : x(_x), y(_y)
+    {
+    }
+  };
+
+  typedef Voronoi::Edge Edge;
+
+  /// Конструктор по умолчанию.
+  IntVoronoi();
+
+  /// Конструктор.
+  /// @param sites Список точек. Координаты по модулю не больше
+  /// predicates::MAX_INT_COORDINATE. Совпадающие точки не получают граней.
+  /// @param size Размер рабочей области [0, size].
+  IntVoronoi(const std::vector<glm::ivec2> &sites, const glm::ivec2 &size);
+
+  /// Построить диаграмму вороного.
+  IntVoronoi &operator()();
+
+  /// Очистить диаграмму вороного.
+  /// Освобождаются списки вершин и граней.
+  /// Список точек не освобождается.
+  void Clear();
+
+  /// Вернуть список точек.
+  const std::vector<glm::ivec2> &GetSites() const;
+
+  /// Вернуть список граней.
+  const std::vector<Edge> &GetEdges() const;
+
+  /// Вернуть список вершин.
+  const std::vector<Vertex> &GetVertex() const;
+
+  /// Вернуть размер рабочей области.
+  const glm::ivec2 &GetSize() const;
+
+  /// Перевести вершину в координаты с плавающей точкой.
+  static glm::dvec2 ToPoint(const Vertex &vertex);
+
+private:
+  /// Бесконечная вершина триангуляции. Треугольники с ней примыкают
+  /// к ребрам выпуклой оболочки снаружи.
+  static const int INFINITE = -1;
+
+  /// Треугольник триангуляции. Вершины перечислены против часовой стрелки.
+  /// Сосед n[i] лежит напротив вершины v[i].
+  struct Triangle
+  {
+    int v[3];
+    int n[3];
+  };
+
+  /// Рациональное число num / den, den > 0.
+  struct Fraction
+  {
+    int64_t num;
+    int64_t den;
+  };
+
+  /// Построить триангуляцию Делоне.
+  /// @return false, если все точки лежат на одной прямой.
+  bool Triangulate();
+
+  /// Вставить точку в триангуляцию (алгоритм Боуера-Ватсона).
+  void Insert(int site);
+
+  /// Найти треугольник, описанная окружность которого содержит точку,
+  /// обходом от последнего созданного треугольника.
+  /// @return -1, если точка совпадает с вершиной триангуляции.
+  int Locate(int site) const;
+
+  /// Конфликтует ли треугольник с точкой: точка строго внутри
+  /// описанной окружности или, для бесконечного треугольника, снаружи оболочки.
+  bool InConflict(int triangle, int site) const;
+
+  /// Построить грани по триангуляции.
+  void BuildEdges();
+
+  /// Построить грани для точек, лежащих на одной прямой.
+  void BuildCollinearEdges();
+
+  /// Добавить грань на срединном перпендикуляре к site1, site2.
+  /// Перпендикуляр задается как середина + t * (повернутый на 90 градусов вектор site1 -> site2).
+  /// @param from Начало грани по t или nullptr для бесконечности.
+  /// @param to Конец грани по t или nullptr для бесконечности.
+  /// @param fromVertex Вершина в начале грани, если она уже создана, иначе -1.
+  /// @param toVertex Вершина в конце грани, если она уже создана, иначе -1.
+  /// @return Вершины начала и конца грани или -1, если грань не попала в область.
+  std::pair<int, int> AddEdge(int site1, int site2, const Fraction *from, const Fraction *to,
+                              int fromVertex, int toVertex);
+
+  /// Параметр t центра описанной окружности треугольника site1, site2, site3
+  /// на срединном перпендикуляре к site1, site2.
+  Fraction CircleParameter(int site1, int site2, int site3) const;
+
+  /// Создать вершину на срединном перпендикуляре в точке t.
+  int NewVertex(int site1, int site2, const Fraction &t);
+
+  /// Освободить ресурсы построения.
+  void ReleaseProcess();
+
+private:
+  /// Список исходных точек.
+  std::vector<glm::ivec2> mListSite;
+
+  /// Размер рабочей области.
+  glm::ivec2 mSize;
+
+  /// Список вершин полигонов.
+  std::vector<Vertex> mListVertex;
+
+  /// Список граней.
+  std::vector<Edge> mListEdge;
+
+  /// Треугольники триангуляции.
+  std::vector<Triangle> mTriangles;
+
+  /// Вершина диаграммы для каждого треугольника, -1 если еще не создана.
+  std::vector<int> mTriangleVertex;
+
+  /// Метки треугольников при поиске области конфликта.
+  std::vector<int> mMarks;
+
+  /// Номер текущей вставки для меток.
+  int mStamp;
+
+  /// Последний созданный конечный треугольник, с него начинается поиск.
+  int mLast;
+};
+
+#endif // INTVORONOI_H
@@ -24,18 +24,14 @@ struct LloydPredicateDefault
   }
 };
 
-/// Релаксация методом Ллойда.
+/// Сдвинуть точки по построенной диаграмме.
+/// @param voronoi Диаграмма, построенная по sites без перестановки точек.
 /// @param sites Список точек.
-/// @param size Размер органичивающей области.
 /// @param predicate Функция обработки точек.
 /// @return Список точек после одной итерации релаксации Ллойда.
 template<class Predicate>
-std::vector<glm::vec2> Lloyd(const std::vector<glm::vec2> &sites, const glm::vec2 &size, Predicate predicate = Predicate())
+std::vector<glm::vec2> LloydRelax(const Voronoi &voronoi, const std::vector<glm::vec2> &sites, Predicate predicate)
 {
-  // Строим диаграмму
-  Voronoi voronoi(sites, size);
-  voronoi();
-
   // Подготавливаем массив для заполнения полигонов.
   std::vector<std::vector<unsigned int> > listPoligons;
   listPoligons.reserve(sites.size());
@@ -50,15 +46,20 @@ std::vector<glm::vec2> Lloyd(const std::vector<glm::vec2> &sites, const glm::vec
 
   // Проходим по всем граням и добавляем вершины соответствующим точкам.
   // Каждая вершина продублируется 2 раза, но это не страшно.
-  auto edges = voronoi.GetEdges();
+  // Грань границы области (site1 == site2) добавляется один раз,
+  // иначе ее вершины учитывались бы вдвое чаще остальных.
+  const auto &edges = voronoi.GetEdges();
   for(auto it = edges.begin(); it != edges.end(); ++it)
   {
     const Voronoi::Edge &edge = (*it);
 
     listPoligons[edge.site1].push_back(edge.vertex1);
     listPoligons[edge.site1].push_back(edge.vertex2);
-    listPoligons[edge.site2].push_back(edge.vertex1);
-    listPoligons[edge.site2].push_back(edge.vertex2);
+    if(edge.site2 != edge.site1)
+    {
+      listPoligons[edge.site2].push_back(edge.vertex1);
+      listPoligons[edge.site2].push_back(edge.vertex2);
+    }
   }
 
   // Вычисляем новые значения точек.
@@ -80,6 +81,47 @@ std::vector<glm::vec2> Lloyd(const std::vector<glm::vec2> &sites, const glm::vec
   return std::move(listSites);
 }
 
+/// Релаксация методом Ллойда.
+/// @param sites Список точек.
+/// @param size Размер органичивающей области.
+/// @param predicate Функция обработки точек.
+/// @return Список точек после одной итерации релаксации Ллойда.
+template<class Predicate>
+std::vector<glm::vec2> Lloyd(const std::vector<glm::vec2> &sites, const glm::vec2 &size, Predicate predicate = Predicate())
+{
+  // Строим диаграмму
+  Voronoi voronoi(sites, size);
+  voronoi();
+
+  return LloydRelax(voronoi, sites, predicate);
+}
+
+/// Релаксация методом Ллойда в пуле потоков.
+/// Диаграмма строится через Voronoi::Build, отмена и progress - как в нем.
+/// @param pool Пул потоков.
+/// @param sites Список точек, копируется в задачу.
+/// @param size Размер органичивающей области.
+/// @param cancel Флаг отмены.
+/// @param progress Функция, получающая ход построения диаграммы.
+/// @param predicate Функция обработки точек.
+/// @return Список точек после одной итерации релаксации Ллойда,
+/// пустой список, если построение отменено.
+template<class Predicate>
+std::future<std::vector<glm::vec2> > LloydAsync(ThreadPool &pool, const std::vector<glm::vec2> &sites,
+                                                const glm::vec2 &size, const CancelToken &cancel,
+                                                const Voronoi::ProgressCallback &progress, Predicate predicate)
+{
+  return pool.Submit([sites, size, cancel, progress, predicate]() mutable -> std::vector<glm::vec2>
+  {
+    Voronoi voronoi(sites, size);
+    if(!voronoi.Build(cancel, progress))
+    {
+      return std::vector<glm::vec2>();
+    }
+    return LloydRelax(voronoi, sites, predicate);
+  });
+}
+
 /// Релаксация методом Ллойда.
 /// @param sites Список точек.
 /// @param size Размер органичивающей области.
@@ -89,6 +131,20 @@ std::vector<glm::vec2> Lloyd(const std::vector<glm::vec2> &sites, const glm::vec
   return Lloyd(sites, size, LloydPredicateDefault());
 }
 
+/// Релаксация методом Ллойда в общем пуле ThreadPool::Default.
+/// @param sites Список точек, копируется в задачу.
+/// @param size Размер органичивающей области.
+/// @param cancel Флаг отмены.
+/// @param progress Функция, получающая ход построения диаграммы.
+/// @return Список точек после одной итерации релаксации Ллойда,
+/// пустой список, если построение отменено.
+inline std::future<std::vector<glm::vec2> > LloydAsync(const std::vector<glm::vec2> &sites, const glm::vec2 &size,
+                                                       const CancelToken &cancel = CancelToken(),
+                                                       const Voronoi::ProgressCallback &progress = Voronoi::ProgressCallback())
+{
+  return LloydAsync(ThreadPool::Default(), sites, size, cancel, progress, LloydPredicateDefault());
+}
+
 
 #endif // LLOYD_H
 
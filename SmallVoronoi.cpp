@@ -0,0 +1,497 @@
+#include "SmallVoronoi.h"
+#include "predicates.h"
+#include "sort.h"
+
+using namespace geometry;
+
+#include <algorithm>
+#include <assert.h>
+
+#define EPS 0.001
+
+namespace
+{
+  /// Идет ли событие a раньше события b: выше, при равной высоте - создано раньше.
+  template<class E>
+  bool EventBefore(const E &a, const E &b)
+  {
+    return a.posy > b.posy || (a.posy == b.posy && a.id < b.id);
+  }
+}
+
+SmallVoronoiBase::SmallVoronoiBase()
+  : mCapacity(0), mRect(geometry::Point(), geometry::Point()), mSweepLine(0.0f),
+    mSiteCount(0), mCircleEventCount(0), mEndPointCount(0), mEdgeElementCount(0), mVertexCount(0), mEdgeCount(0),
+    mBeachCount(0), mFreeArc(NONE), mArcSlots(0), mNextEvent(1)
+{
+  mS = Storage();
+}
+
+size_t SmallVoronoiBase::GetSiteCount() const
+{
+  return mSiteCount;
+}
+
+size_t SmallVoronoiBase::GetVertexCount() const
+{
+  return mVertexCount;
+}
+
+size_t SmallVoronoiBase::GetEdgeCount() const
+{
+  return mEdgeCount;
+}
+
+const geometry::Rect &SmallVoronoiBase::GetRect() const
+{
+  return mRect;
+}
+
+bool SmallVoronoiBase::Build(const Storage &storage, size_t capacity, const Point *sites, size_t count,
+                             const Point &size)
+{
+  mS = storage;
+  mCapacity = capacity;
+  mSiteCount = 0;
+  mCircleEventCount = 0;
+  mEndPointCount = 0;
+  mEdgeElementCount = 0;
+  mVertexCount = 0;
+  mEdgeCount = 0;
+  mBeachCount = 0;
+  mFreeArc = NONE;
+  mArcSlots = 0;
+  mNextEvent = 1;
+  if(count > capacity)
+  {
+    return false;
+  }
+
+  mRect = geometry::Rect(geometry::Point(), geometry::Point(size));
+  mBounds = BasicRect<float>(mRect);
+  mSiteCount = count;
+  if(count == 0)
+  {
+    return true;
+  }
+
+  // События точек в порядке заметающей прямой, одинаковые точки - по номеру,
+  // как после устойчивой сортировки в Voronoi.
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    mS.sites[i] = sites[i];
+    mS.siteEvents[i].key = SweepKey(sites[i]);
+    mS.siteEvents[i].site = i;
+  }
+  std::sort(mS.siteEvents, mS.siteEvents + count, [](const SiteEvent &a, const SiteEvent &b) -> bool
+  {
+    return a.key < b.key || (a.key == b.key && a.site < b.site);
+  });
+
+  // Первая арка и все точки на ее высоте.
+  size_t next = 0;
+  InsertSiteFirst(mS.siteEvents[next].site);
+  mSweepLine = mS.sites[mS.siteEvents[next].site].y;
+  for(++next; next < count && !(mSweepLine > mS.sites[mS.siteEvents[next].site].y); ++next)
+  {
+    InsertSiteTop(mS.siteEvents[next].site);
+  }
+
+  while(next < count || mCircleEventCount > 0)
+  {
+    const CircleEvent *event = mCircleEventCount > 0 ? &mS.circleEvents[mCircleEventCount - 1] : nullptr;
+    if(event && (next == count || event->posy >= mS.sites[mS.siteEvents[next].site].y))
+    {
+      const int arc = event->arc;
+      mSweepLine = event->posy;
+      RemoveCircleEvent(arc);
+      RemoveArc(arc);
+    }
+    else
+    {
+      const unsigned int site = mS.siteEvents[next++].site;
+      mSweepLine = mS.sites[site].y;
+      InsertArc(LocateArc(mS.sites[site].x), site);
+    }
+  }
+
+  PostProcess();
+  return true;
+}
+
+void SmallVoronoiBase::InsertSiteFirst(unsigned int site)
+{
+  const int arc = NewArc(site);
+  mS.beach[0] = arc;
+  mS.arcs[arc].pos = 0;
+  mBeachCount = 1;
+}
+
+void SmallVoronoiBase::InsertSiteTop(unsigned int site)
+{
+  // Точки на одной высоте идут справа налево, новая арка - самая левая.
+  const int right = mS.beach[0];
+  const int arc = NewArc(site);
+  ShiftBeach(0, 1);
+  mS.beach[0] = arc;
+  mS.arcs[arc].pos = 0;
+
+  // Второй конец грани - брекпоинт, уходящий вверх.
+  mS.arcs[arc].edge = NewEdge(OPEN, OPEN, site, mS.arcs[right].site);
+  mS.arcs[arc].end = 0;
+}
+
+void SmallVoronoiBase::InsertArc(int pos, unsigned int site)
+{
+  // Арка на месте pos становится левой частью, за ней вставляются новая арка
+  // и правая часть старой арки.
+  const int arc = mS.beach[pos];
+  if(mS.arcs[arc].event)
+  {
+    RemoveCircleEvent(arc);
+  }
+  const unsigned int siteArc = mS.arcs[arc].site;
+
+  const int mid = NewArc(site);
+  const int right = NewArc(siteArc);
+  ShiftBeach(pos + 1, 2);
+  mS.beach[pos + 1] = mid;
+  mS.beach[pos + 2] = right;
+
+  Arc &a = mS.arcs[arc];
+  Arc &m = mS.arcs[mid];
+  Arc &r = mS.arcs[right];
+  m.pos = pos + 1;
+  r.pos = pos + 2;
+  r.edge = a.edge;
+  r.end = a.end;
+
+  const int edge = static_cast<int>(mEdgeElementCount);
+  a.edge = edge;
+  a.end = 0;
+  m.edge = edge;
+  m.end = 1;
+
+  CheckCircleEvent(BeachArc(pos - 1), arc, mid);
+  CheckCircleEvent(mid, right, BeachArc(pos + 3));
+
+  NewEdge(OPEN, OPEN, siteArc, site);
+}
+
+void SmallVoronoiBase::RemoveArc(int arc)
+{
+  const int pos = mS.arcs[arc].pos;
+  const int left = BeachArc(pos - 1);
+  const int right = BeachArc(pos + 1);
+  assert(left != NONE && right != NONE);
+
+  if(mS.arcs[left].event)
+  {
+    RemoveCircleEvent(left);
+  }
+  if(mS.arcs[right].event)
+  {
+    RemoveCircleEvent(right);
+  }
+
+  Arc &l = mS.arcs[left];
+  Arc &a = mS.arcs[arc];
+  Arc &r = mS.arcs[right];
+  const int ep = NewEndPoint(l.site, a.site, r.site);
+
+  // Грани брекпоинтов удаляемой арки сходятся в новой вершине.
+  UpdateEdge(l.edge, l.end, ep);
+  UpdateEdge(a.edge, a.end, ep);
+
+  l.edge = NewEdge(OPEN, ep, l.site, r.site);
+  l.end = 0;
+
+  ShiftBeach(pos + 1, -1);
+  DeleteArc(arc);
+
+  CheckCircleEvent(BeachArc(pos - 2), left, right);
+  CheckCircleEvent(left, right, BeachArc(pos + 1));
+}
+
+void SmallVoronoiBase::CheckCircleEvent(int left, int arc, int right)
+{
+  if(left == NONE || right == NONE)
+  {
+    return;
+  }
+  if(mS.arcs[arc].event != 0)
+  {
+    return;
+  }
+
+  const unsigned int s1 = mS.arcs[left].site;
+  const unsigned int s2 = mS.arcs[arc].site;
+  const unsigned int s3 = mS.arcs[right].site;
+  if(s1 == s2 || s2 == s3 || s3 == s1)
+  {
+    return;
+  }
+
+  // Событие есть, только если точки лежат по часовой стрелке.
+  if(predicates::Orient2d(mS.sites[s1], mS.sites[s2], mS.sites[s3]) >= 0)
+  {
+    return;
+  }
+
+  const float posy = CircleBottom<float>(mS.sites[s1], mS.sites[s2], mS.sites[s3]);
+  if(posy <= mSweepLine + static_cast<float>(EPS))
+  {
+    NewCircleEvent(arc, posy);
+  }
+}
+
+int SmallVoronoiBase::LocateArc(float x) const
+{
+  // Брекпоинты по x возрастают слева направо, ищем первый не левее x.
+  int lo = 0;
+  int hi = mBeachCount - 1;
+  while(lo < hi)
+  {
+    const int mid = (lo + hi) / 2;
+    const float bpx = IntersectParabols<float>(mSweepLine, mS.sites[mS.arcs[mS.beach[mid]].site],
+                                               mS.sites[mS.arcs[mS.beach[mid + 1]].site]);
+    if(x > bpx)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void SmallVoronoiBase::ShiftBeach(int pos, int shift)
+{
+  assert(mBeachCount + shift <= static_cast<int>(2 * mCapacity));
+  int *beach = mS.beach;
+  if(shift > 0)
+  {
+    for(int i = mBeachCount - 1; i >= pos; --i)
+    {
+      beach[i + shift] = beach[i];
+      mS.arcs[beach[i]].pos = i + shift;
+    }
+  }
+  else
+  {
+    for(int i = pos; i < mBeachCount; ++i)
+    {
+      beach[i + shift] = beach[i];
+      mS.arcs[beach[i]].pos = i + shift;
+    }
+  }
+  mBeachCount += shift;
+}
+
+int SmallVoronoiBase::BeachArc(int pos) const
+{
+  return pos >= 0 && pos < mBeachCount ? mS.beach[pos] : NONE;
+}
+
+void SmallVoronoiBase::NewCircleEvent(int arc, float posy)
+{
+  assert(mCircleEventCount < 2 * mCapacity);
+  CircleEvent event;
+  event.posy = posy;
+  event.id = mNextEvent++;
+  event.arc = arc;
+  mS.arcs[arc].event = event.id;
+  mS.arcs[arc].eventY = posy;
+
+  // События упорядочены от поздних к ранним, ближайшее - последнее.
+  CircleEvent *events = mS.circleEvents;
+  CircleEvent *it = std::lower_bound(events, events + mCircleEventCount, event,
+                                     [](const CircleEvent &a, const CircleEvent &b) -> bool
+  {
+    return EventBefore(b, a);
+  });
+  std::copy_backward(it, events + mCircleEventCount, events + mCircleEventCount + 1);
+  *it = event;
+  ++mCircleEventCount;
+}
+
+void SmallVoronoiBase::RemoveCircleEvent(int arc)
+{
+  CircleEvent key;
+  key.posy = mS.arcs[arc].eventY;
+  key.id = mS.arcs[arc].event;
+  key.arc = arc;
+  mS.arcs[arc].event = 0;
+
+  CircleEvent *events = mS.circleEvents;
+  CircleEvent *it = std::lower_bound(events, events + mCircleEventCount, key,
+                                     [](const CircleEvent &a, const CircleEvent &b) -> bool
+  {
+    return EventBefore(b, a);
+  });
+  assert(it != events + mCircleEventCount && (*it).id == key.id);
+  std::copy(it + 1, events + mCircleEventCount, it);
+  --mCircleEventCount;
+}
+
+int SmallVoronoiBase::NewArc(unsigned int site)
+{
+  int arc = mFreeArc;
+  if(arc != NONE)
+  {
+    mFreeArc = mS.arcs[arc].pos;
+  }
+  else
+  {
+    assert(mArcSlots < 2 * mCapacity);
+    arc = static_cast<int>(mArcSlots++);
+  }
+
+  Arc &a = mS.arcs[arc];
+  a.site = site;
+  a.pos = NONE;
+  a.edge = NONE;
+  a.end = 0;
+  a.event = 0;
+  a.eventY = 0.0f;
+  return arc;
+}
+
+void SmallVoronoiBase::DeleteArc(int arc)
+{
+  assert(mS.arcs[arc].event == 0);
+  mS.arcs[arc].pos = mFreeArc;
+  mFreeArc = arc;
+}
+
+int SmallVoronoiBase::NewEdge(int el1, int el2, unsigned int site1, unsigned int site2)
+{
+  assert(mEdgeElementCount < 3 * mCapacity);
+  EdgeElement &edge = mS.edgeElements[mEdgeElementCount];
+  edge.el[0] = el1;
+  edge.el[1] = el2;
+  edge.site1 = site1;
+  edge.site2 = site2;
+  return static_cast<int>(mEdgeElementCount++);
+}
+
+int SmallVoronoiBase::NewEndPoint(unsigned int site1, unsigned int site2, unsigned int site3)
+{
+  assert(mEndPointCount < 2 * mCapacity);
+  const Point point = CreateCircle<float>(mS.sites[site1], mS.sites[site2], mS.sites[site3]);
+
+  EndPoint &ep = mS.endPoints[mEndPointCount];
+  ep.pos = -1;
+  if(RectContainsPoint(mBounds, point))
+  {
+    assert(mVertexCount < 8 * mCapacity);
+    mS.vertex[mVertexCount] = point;
+    ep.pos = static_cast<int>(mVertexCount++);
+  }
+  ep.site1 = site1;
+  ep.site2 = site2;
+  ep.site3 = site3;
+  return static_cast<int>(mEndPointCount++);
+}
+
+void SmallVoronoiBase::UpdateEdge(int edge, int end, int ep)
+{
+  EdgeElement &e = mS.edgeElements[edge];
+  assert(e.el[end] == OPEN);
+  e.el[end] = ep;
+
+  // Грань, оба конца которой - вершины в области, готова.
+  if(e.el[0] != OPEN && e.el[1] != OPEN)
+  {
+    const int v1 = mS.endPoints[e.el[0]].pos;
+    const int v2 = mS.endPoints[e.el[1]].pos;
+    if(v1 >= 0 && v2 >= 0)
+    {
+      mS.edges[mEdgeCount++] = Edge(e.site1, e.site2, v1, v2);
+      // Готовая грань помечается одинаковыми точками и пропускается при обрезке.
+      e.site1 = e.site2;
+    }
+  }
+}
+
+void SmallVoronoiBase::PostProcess()
+{
+  // Обрезка в double, как в Voronoi::ClipEdge.
+  typedef geometry::Point Point;
+
+  for(size_t i = 0; i < mEdgeElementCount; ++i)
+  {
+    const EdgeElement &edge = mS.edgeElements[i];
+    if(edge.site1 == edge.site2)
+    {
+      continue;
+    }
+
+    const Point s1(mS.sites[edge.site1]);
+    const Point s2(mS.sites[edge.site2]);
+    Segment clipped;
+    bool valid = false;
+    int v1 = -1;
+    int v2 = -1;
+
+    if(edge.el[0] != OPEN && edge.el[1] != OPEN)
+    {
+      const EndPoint &ep1 = mS.endPoints[edge.el[0]];
+      const EndPoint &ep2 = mS.endPoints[edge.el[1]];
+      const Point p1 = ep1.pos >= 0 ? Point(mS.vertex[ep1.pos]) :
+        CreateCircle<double>(mS.sites[ep1.site1], mS.sites[ep1.site2], mS.sites[ep1.site3]);
+      const Point p2 = ep2.pos >= 0 ? Point(mS.vertex[ep2.pos]) :
+        CreateCircle<double>(mS.sites[ep2.site1], mS.sites[ep2.site2], mS.sites[ep2.site3]);
+      valid = ClipRectSegment(mRect, Segment(p1, p2), clipped);
+      v1 = ep1.pos;
+      v2 = ep2.pos;
+    }
+    else if(edge.el[0] == OPEN && edge.el[1] == OPEN)
+    {
+      const Line line = Perpendicular(Line(s1, s2), Center<double>(s1, s2));
+      valid = ClipRectLine(mRect, line, clipped);
+    }
+    else
+    {
+      const EndPoint &ep = mS.endPoints[edge.el[0] != OPEN ? edge.el[0] : edge.el[1]];
+
+      // Луч идет от вершины в сторону, противоположную третьей точке.
+      unsigned int dirPoint = ep.site1;
+      if(dirPoint == edge.site1 || dirPoint == edge.site2)
+      {
+        dirPoint = ep.site2;
+        if(dirPoint == edge.site1 || dirPoint == edge.site2)
+        {
+          dirPoint = ep.site3;
+        }
+      }
+      const Point center = Center<double>(s1, s2);
+      const Line rayLine = Perpendicular(Line(s1, s2), center);
+      const Line perpRay = Perpendicular(rayLine, Point(mS.sites[dirPoint]));
+      const Point point = ep.pos >= 0 ? Point(mS.vertex[ep.pos]) :
+        CreateCircle<double>(mS.sites[ep.site1], mS.sites[ep.site2], mS.sites[ep.site3]);
+      const Point dir = point - IntersectLines(rayLine, perpRay);
+      valid = ClipRectRay(mRect, Ray(point, center + dir), clipped);
+      v1 = ep.pos;
+    }
+
+    if(!valid)
+    {
+      continue;
+    }
+    if(v1 < 0)
+    {
+      mS.vertex[mVertexCount] = glm::vec2(clipped.a);
+      v1 = static_cast<int>(mVertexCount++);
+    }
+    if(v2 < 0)
+    {
+      mS.vertex[mVertexCount] = glm::vec2(clipped.b);
+      v2 = static_cast<int>(mVertexCount++);
+    }
+    assert(mVertexCount <= 8 * mCapacity);
+    mS.edges[mEdgeCount++] = Edge(edge.site1, edge.site2, v1, v2);
+  }
+}
@@ -0,0 +1,213 @@
+#ifndef SMALLVORONOI_H
+#define SMALLVORONOI_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <vector>
+
+/// Построение небольших диаграмм без выделения памяти.
+/// Тот же алгоритм Форчуна, что у Voronoi, но береговая линия - массив арок
+/// слева направо с двоичным поиском, события круга - упорядоченный массив,
+/// брекпоинты хранятся в арках. Береговая линия и очередь событий небольшие
+/// (порядка корня из числа точек), поэтому вставка и удаление сдвигом массива
+/// дешевле дерева. Все списки лежат в массивах SmallVoronoi, построение
+/// не обращается к распределителю памяти.
+/// Порядок событий, номера вершин и граней те же, что у Voronoi без флагов:
+/// результат совпадает с Voronoi для тех же точек.
+/// Определения - в SmallVoronoi.cpp, SmallVoronoi только задает массивы.
+class SmallVoronoiBase
+{
+public:
+  typedef glm::vec2 Point;
+  typedef VoronoiBase::Edge Edge;
+
+  /// Вернуть число точек, вершин и граней.
+  size_t GetSiteCount() const;
+  size_t GetVertexCount() const;
+  size_t GetEdgeCount() const;
+
+  /// Вернуть ограничивающую область диаграммы.
+  const geometry::Rect &GetRect() const;
+
+protected:
+  /// Событие точки: ключ SweepKey и номер точки.
+  struct SiteEvent
+  {
+    uint64_t key;
+    unsigned int site;
+  };
+
+  /// Арка береговой линии.
+  struct Arc
+  {
+    unsigned int site;
+    /// Место в береговой линии, у свободной арки - следующая свободная арка.
+    int pos;
+    /// Грань брекпоинта справа от арки и ее конец, соответствующий брекпоинту.
+    int edge;
+    int end;
+    /// Номер и высота события круга арки, номер 0 - события нет.
+    unsigned int event;
+    float eventY;
+  };
+
+  /// Событие круга.
+  struct CircleEvent
+  {
+    float posy;
+    unsigned int id;
+    int arc;
+  };
+
+  /// Точка пересечения граней, pos - вершина или -1, если точка вне области.
+  struct EndPoint
+  {
+    int pos;
+    unsigned int site1;
+    unsigned int site2;
+    unsigned int site3;
+  };
+
+  /// Грань. Концы - номера точек пересечения граней или OPEN для брекпоинта.
+  struct EdgeElement
+  {
+    int el[2];
+    unsigned int site1;
+    unsigned int site2;
+  };
+
+  /// Массивы наследника.
+  struct Storage
+  {
+    Point *sites;
+    SiteEvent *siteEvents;
+    Arc *arcs;
+    int *beach;
+    CircleEvent *circleEvents;
+    EndPoint *endPoints;
+    EdgeElement *edgeElements;
+    Point *vertex;
+    Edge *edges;
+  };
+
+  SmallVoronoiBase();
+
+  /// Построить диаграмму в массивах storage, рассчитанных на capacity точек.
+  bool Build(const Storage &storage, size_t capacity, const Point *sites, size_t count, const Point &size);
+
+private:
+  static const int NONE = -1;
+  static const int OPEN = -1;
+
+  void InsertSiteFirst(unsigned int site);
+  void InsertSiteTop(unsigned int site);
+  void InsertArc(int pos, unsigned int site);
+  void RemoveArc(int arc);
+  void CheckCircleEvent(int left, int arc, int right);
+
+  /// Найти место арки над точкой x.
+  int LocateArc(float x) const;
+
+  /// Сдвинуть арки береговой линии начиная с места pos на shift мест.
+  void ShiftBeach(int pos, int shift);
+
+  /// Арка на месте pos или NONE.
+  int BeachArc(int pos) const;
+
+  /// Добавить и удалить событие круга арки.
+  void NewCircleEvent(int arc, float posy);
+  void RemoveCircleEvent(int arc);
+
+  int NewArc(unsigned int site);
+  void DeleteArc(int arc);
+  int NewEdge(int el1, int el2, unsigned int site1, unsigned int site2);
+  int NewEndPoint(unsigned int site1, unsigned int site2, unsigned int site3);
+  void UpdateEdge(int edge, int end, int ep);
+
+  /// Обрезать оставшиеся грани областью.
+  void PostProcess();
+
+  Storage mS;
+  size_t mCapacity;
+
+  geometry::Rect mRect;
+  geometry::BasicRect<float> mBounds;
+  float mSweepLine;
+
+  size_t mSiteCount;
+  size_t mCircleEventCount;
+  size_t mEndPointCount;
+  size_t mEdgeElementCount;
+  size_t mVertexCount;
+  size_t mEdgeCount;
+
+  /// Число арок береговой линии, свободные арки и число занятых мест.
+  int mBeachCount;
+  int mFreeArc;
+  size_t mArcSlots;
+
+  /// Номер следующего события круга.
+  unsigned int mNextEvent;
+};
+
+/// Диаграмма не больше чем из N точек (Voronoi, float) без выделения памяти.
+/// Все списки - массивы внутри объекта, объект занимает около 250 * N байт.
+/// Выгодна для N до нескольких сотен.
+template<unsigned int N>
+class SmallVoronoi : public SmallVoronoiBase
+{
+public:
+  SmallVoronoi()
+  {
+  }
+
+  /// Построить диаграмму.
+  /// @param sites Точки, не содержат одинаковых точек.
+  /// @param count Число точек.
+  /// @param size Размер рабочей области.
+  /// @return false, если точек больше N.
+  bool Build(const Point *sites, size_t count, const Point &size)
+  {
+    Storage storage = {mSites, mSiteEvents, mArcs, mBeach, mCircleEvents, mEndPoints, mEdgeElements, mVertex, mEdges};
+    return SmallVoronoiBase::Build(storage, N, sites, count, size);
+  }
+
+  bool Build(const std::vector<Point> &sites, const Point &size)
+  {
+    return Build(sites.empty() ? nullptr : &sites[0], sites.size(), size);
+  }
+
+  /// Вернуть точки, вершины и грани. Числа элементов - GetSiteCount,
+  /// GetVertexCount, GetEdgeCount.
+  const Point *GetSites() const
+  {
+    return mSites;
+  }
+
+  const Point *GetVertex() const
+  {
+    return mVertex;
+  }
+
+  const Edge *GetEdges() const
+  {
+    return mEdges;
+  }
+
+private:
+  // Арок не больше 2N - 1, у каждой не больше одного события круга.
+  // Точек пересечения граней, как и вершин диаграммы, не больше 2N,
+  // каждая точка и каждая вершина создают грань, каждая грань добавляет
+  // при обрезке до 2 вершин.
+  Point mSites[N];
+  SiteEvent mSiteEvents[N];
+  Arc mArcs[2 * N];
+  int mBeach[2 * N];
+  CircleEvent mCircleEvents[2 * N];
+  EndPoint mEndPoints[2 * N];
+  EdgeElement mEdgeElements[3 * N];
+  Point mVertex[8 * N];
+  Edge mEdges[3 * N];
+};
+
+#endif // SMALLVORONOI_H
@@ -1,4 +1,9 @@
 #include "Voronoi.h"
+#include "archive.h"
+#include "storage.h"
+#include "sort.h"
+#include "predicates.h"
+#include "parallel.h"
 
 
 using namespace geometry;
@@ -7,154 +12,773 @@ using namespace geometry;
 #include <stdio.h>
 #endif
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <new>
 
 #define EPS 0.001
 
-Voronoi::Voronoi()
-  : mRect(Point(), Point())
+namespace
+{
+  /// Идет ли точка a раньше точки b в порядке заметающей прямой.
+  template<class P>
+  bool SweepBefore(const P &a, const P &b)
+  {
+    return a.y > b.y || (a.y == b.y && a.x > b.x);
+  }
+
+  /// Упорядочить события точек float.
+  void SortSiteEvents(const std::vector<glm::vec2> &sites, std::vector<unsigned int> &events)
+  {
+    // Ключ содержит координаты точки, поэтому сортировка не обращается к списку точек.
+    std::vector<uint64_t> keys(sites.size());
+    for(unsigned int i = 0; i < sites.size(); ++i)
+    {
+      keys[i] = SweepKey(sites[i]);
+    }
+    RadixSort(keys, events, 1);
+  }
+
+  /// Упорядочить события точек double.
+  /// Две координаты double не помещаются в 64-битный ключ, поэтому сортируем сравнением
+  /// копий точек. Одинаковые точки остаются в исходном порядке, как и при RadixSort.
+  void SortSiteEvents(const std::vector<glm::dvec2> &sites, std::vector<unsigned int> &events)
+  {
+    struct Key
+    {
+      glm::dvec2 point;
+      unsigned int index;
+    };
+    std::vector<Key> keys(sites.size());
+    for(unsigned int i = 0; i < sites.size(); ++i)
+    {
+      keys[i].point = sites[events[i]];
+      keys[i].index = events[i];
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) -> bool
+    {
+      return SweepBefore(a.point, b.point) || (a.point == b.point && a.index < b.index);
+    });
+    for(unsigned int i = 0; i < sites.size(); ++i)
+    {
+      events[i] = keys[i].index;
+    }
+  }
+}
+
+template<class T>
+BasicVoronoi<T>::BasicVoronoi()
+  : mRect(geometry::Point(), geometry::Point()), mFlags(0),
+    mCircleEvents(CircleEventComparator(), NodeAllocator<CircleEvent *>(&mFreeEventNodes))
 {
   mHead = nullptr;
+  mFinger = nullptr;
   mSiteEventsIndex = 0;
+  mStepping = false;
 }
 
-Voronoi::Voronoi(const std::vector<glm::vec2> &sites, const glm::vec2 &size)
-  : mListSite(sites), mRect(Point(), size)
+template<class T>
+BasicVoronoi<T>::BasicVoronoi(const std::vector<Point> &sites, const Point &size, unsigned int flags)
+  : mListSite(sites), mRect(geometry::Point(), geometry::Point(size)), mFlags(flags),
+    mCircleEvents(CircleEventComparator(), NodeAllocator<CircleEvent *>(&mFreeEventNodes))
 {
   mHead = nullptr;
+  mFinger = nullptr;
   mSiteEventsIndex = 0;
+  mStepping = false;
 }
 
-Voronoi::Voronoi(const Voronoi &voronoi)
-  : mListSite(voronoi.mListSite), mRect(voronoi.mRect),
-    mListVertex(voronoi.mListVertex), mListEdge(voronoi.mListEdge)
+template<class T>
+BasicVoronoi<T>::BasicVoronoi(const std::vector<Point> &sites, const std::vector<Point> &boundary, unsigned int flags)
+  : mListSite(sites), mRect(geometry::Point(), geometry::Point()), mFlags(flags),
+    mCircleEvents(CircleEventComparator(), NodeAllocator<CircleEvent *>(&mFreeEventNodes))
 {
   mHead = nullptr;
+  mFinger = nullptr;
   mSiteEventsIndex = 0;
+  mStepping = false;
+
+  assert(boundary.size() >= 3);
+  assert(!(mFlags & PERIODIC));
+  mBoundary.reserve(boundary.size());
+  for(auto it = boundary.begin(); it != boundary.end(); ++it)
+  {
+    mBoundary.push_back(geometry::Point(*it));
+  }
+
+  // Обход против часовой стрелки: удвоенная площадь положительна.
+  double area = 0.0;
+  for(size_t i = 0; i < mBoundary.size(); ++i)
+  {
+    const geometry::Point &a = mBoundary[i];
+    const geometry::Point &b = mBoundary[i + 1 == mBoundary.size() ? 0 : i + 1];
+    area += a.x * b.y - b.x * a.y;
+  }
+  if(area < 0.0)
+  {
+    std::reverse(mBoundary.begin(), mBoundary.end());
+  }
+
+  mRect = geometry::Rect(mBoundary.front(), mBoundary.front());
+  for(size_t i = 0; i < mBoundary.size(); ++i)
+  {
+    mRect.lb = glm::min(mRect.lb, mBoundary[i]);
+    mRect.rt = glm::max(mRect.rt, mBoundary[i]);
+    assert(RotationPoint<double>(mBoundary[i], mBoundary[(i + 1) % mBoundary.size()],
+                         mBoundary[(i + 2) % mBoundary.size()]) >= 0.0);
+  }
+}
+
+template<class T>
+BasicVoronoi<T>::BasicVoronoi(const BasicVoronoi &voronoi)
+  : mListSite(voronoi.mListSite), mRect(voronoi.mRect), mBoundary(voronoi.mBoundary), mFlags(voronoi.mFlags),
+    mSiteOrder(voronoi.mSiteOrder), mPeriodicSource(voronoi.mPeriodicSource),
+    mCircleEvents(CircleEventComparator(), NodeAllocator<CircleEvent *>(&mFreeEventNodes)),
+    mProgress(voronoi.mProgress), mListVertex(voronoi.mListVertex), mListEdge(voronoi.mListEdge)
+{
+  mHead = nullptr;
+  mFinger = nullptr;
+  mSiteEventsIndex = 0;
+  mStepping = false;
 }
 
-Voronoi &Voronoi::operator=(const Voronoi &voronoi)
+template<class T>
+BasicVoronoi<T> &BasicVoronoi<T>::operator=(const BasicVoronoi &voronoi)
 {
   if (this != &voronoi)
   {
     assert(mHead == nullptr);
     mRect = voronoi.mRect;
+    mBoundary = voronoi.mBoundary;
+    mFlags = voronoi.mFlags;
     mListSite = voronoi.mListSite;
+    mSiteOrder = voronoi.mSiteOrder;
+    mPeriodicSource = voronoi.mPeriodicSource;
+    mProgress = voronoi.mProgress;
     mListVertex = voronoi.mListVertex;
     mListEdge = voronoi.mListEdge;
   }
   return *this;
 }
 
-Voronoi::Voronoi(Voronoi &&voronoi)
-  : mListSite(std::move(voronoi.mListSite)), mRect(voronoi.mRect),
+template<class T>
+BasicVoronoi<T>::BasicVoronoi(BasicVoronoi &&voronoi)
+  : mListSite(std::move(voronoi.mListSite)), mRect(voronoi.mRect), mBoundary(std::move(voronoi.mBoundary)),
+    mFlags(voronoi.mFlags),
+    mSiteOrder(std::move(voronoi.mSiteOrder)), mPeriodicSource(std::move(voronoi.mPeriodicSource)),
+    mCircleEvents(CircleEventComparator(), NodeAllocator<CircleEvent *>(&mFreeEventNodes)),
+    mProgress(voronoi.mProgress),
     mListVertex(std::move(voronoi.mListVertex)), mListEdge(std::move(voronoi.mListEdge))
 {
   mHead = nullptr;
+  mFinger = nullptr;
   mSiteEventsIndex = 0;
+  mStepping = false;
 }
 
-Voronoi &Voronoi::operator=(Voronoi &&voronoi)
+template<class T>
+BasicVoronoi<T> &BasicVoronoi<T>::operator=(BasicVoronoi &&voronoi)
 {
   if (this != &voronoi)
   {
     assert(mHead == nullptr);
     mRect = voronoi.mRect;
+    mBoundary = std::move(voronoi.mBoundary);
+    mFlags = voronoi.mFlags;
     mListSite = std::move(voronoi.mListSite);
+    mSiteOrder = std::move(voronoi.mSiteOrder);
+    mPeriodicSource = std::move(voronoi.mPeriodicSource);
+    mProgress = voronoi.mProgress;
     mListVertex = std::move(voronoi.mListVertex);
     mListEdge = std::move(voronoi.mListEdge);
   }
   return *this;
 }
 
-Voronoi::~Voronoi()
+template<class T>
+BasicVoronoi<T>::~BasicVoronoi()
 {
+  // Незавершенное пошаговое построение.
+  Cancel();
+
   assert(mHead == nullptr);
   assert(mSiteEvents.empty());
   assert(mCircleEvents.empty());
-  assert(mListPoints.empty());
+  assert(mBreakPoints.empty() && mEndPoints.empty());
   assert(mListEdgeElement.empty());
 
   // Все ресурсы кроме списка граней и списка вершин уже должны быть освобождены.
   // Списки граней и вершин освободятся автоматически.
+
+  ReleaseFreeLists();
 }
 
-Voronoi &Voronoi::operator()()
+template<class T>
+BasicVoronoi<T> &BasicVoronoi<T>::operator()()
 {
+  // Незавершенное пошаговое построение отменяется.
+  Cancel();
+
   assert(mHead == nullptr);
   assert(mSiteEvents.empty());
   assert(mCircleEvents.empty());
-  assert(mListPoints.empty());
+  assert(mBreakPoints.empty() && mEndPoints.empty());
   assert(mListEdgeElement.empty());
   // Перед построением диаграммы все ресурсы должны быть освобождены.
 
   // Очищаем списки вершин и граней. Вдруг мы строим диаграмму не в первый раз?
   Clear();
 
+  if(mFlags & PERIODIC)
+  {
+    BuildPeriodic();
+  }
+  else
+  {
+    BuildDiagram();
+  }
+
+  return *this;
+}
+
+template<class T>
+void BasicVoronoi<T>::BuildDiagram()
+{
+  BeginDiagram();
+  ProcessEvents(std::numeric_limits<size_t>::max());
+  EndDiagram();
+}
+
+template<class T>
+void BasicVoronoi<T>::Start()
+{
+  Cancel();
+
+  assert(mHead == nullptr);
+  assert(mSiteEvents.empty());
+  assert(mCircleEvents.empty());
+  assert(mBreakPoints.empty() && mEndPoints.empty());
+  assert(mListEdgeElement.empty());
+
+  Clear();
+
+  if(mFlags & PERIODIC)
+  {
+    // Периодическая диаграмма может строиться повторно с более широкой
+    // полосой копий, поэтому строится целиком.
+    BuildPeriodic();
+    return;
+  }
+
+  BeginDiagram();
+  mStepping = true;
+}
+
+template<class T>
+bool BasicVoronoi<T>::Step(size_t maxEvents)
+{
+  if(!mStepping)
+  {
+    return true;
+  }
+  if(!ProcessEvents(maxEvents))
+  {
+    return false;
+  }
+  EndDiagram();
+  mStepping = false;
+  return true;
+}
+
+template<class T>
+bool BasicVoronoi<T>::StepFor(std::chrono::steady_clock::duration budget)
+{
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + budget;
+  while(!Step(STEP_CLOCK_PERIOD))
+  {
+    if(std::chrono::steady_clock::now() >= deadline)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class T>
+void BasicVoronoi<T>::Cancel()
+{
+  if(!mStepping)
+  {
+    return;
+  }
+  mStepping = false;
+
+  RemoveTree();
+  for(auto it = mCircleEvents.begin(); it != mCircleEvents.end(); ++it)
+  {
+    FreeEvent(*it);
+  }
+  mCircleEvents.clear();
+  mSiteEventsIndex = mSiteEvents.size();
+  ReleaseProcess();
+
+  mBreakPointCount = 0;
+  mEndPointCount = 0;
+  mEdgeElementCount = 0;
+  ReleasePostProcess();
+
+  Clear();
+  if((mFlags & REORDER_SITES) && (mFlags & RESTORE_SITE_ORDER))
+  {
+    RestoreSiteOrder();
+  }
+  mProgress = Progress();
+}
+
+template<class T>
+const typename BasicVoronoi<T>::Progress &BasicVoronoi<T>::GetProgress() const
+{
+  return mProgress;
+}
+
+template<class T>
+bool BasicVoronoi<T>::Build(const CancelToken &cancel, const ProgressCallback &progress)
+{
+  if(cancel.IsCancelled())
+  {
+    Cancel();
+    Clear();
+    mProgress = Progress();
+    return false;
+  }
+
+  Start();
+  while(!Step(CANCEL_CHECK_PERIOD))
+  {
+    if(cancel.IsCancelled())
+    {
+      Cancel();
+      return false;
+    }
+    if(progress)
+    {
+      progress(mProgress);
+    }
+  }
+  if(progress)
+  {
+    progress(mProgress);
+  }
+  return true;
+}
+
+template<class T>
+std::future<bool> BasicVoronoi<T>::BuildAsync(ThreadPool &pool, const CancelToken &cancel,
+                                              const ProgressCallback &progress)
+{
+  return pool.Submit([this, cancel, progress]()
+  {
+    return Build(cancel, progress);
+  });
+}
+
+template<class T>
+std::future<bool> BasicVoronoi<T>::BuildAsync(const CancelToken &cancel, const ProgressCallback &progress)
+{
+  return BuildAsync(ThreadPool::Default(), cancel, progress);
+}
+
+template<class T>
+void BasicVoronoi<T>::BeginDiagram()
+{
   // Резервируем память.
-  mListPoints.reserve(mListSite.size() * 6);
-  mListEdgeElement.reserve(mListSite.size() * 3);
+  if(mFlags & LOW_MEMORY)
+  {
+    // Места переиспользуются, таблицам нужно только наибольшее число
+    // одновременно существующих элементов.
+    const size_t root = static_cast<size_t>(std::sqrt(static_cast<double>(mListSite.size()))) + 1;
+    mBreakPoints.reserve(root * LOW_MEMORY_BREAK_POINTS);
+    mEndPoints.reserve(root * LOW_MEMORY_END_POINTS);
+    mListEdgeElement.reserve(root * LOW_MEMORY_EDGES);
+  }
+  else
+  {
+    // Каждая точка добавляет 2 брекпоинта, каждая вершина - брекпоинт
+    // и точку пересечения граней, вершин около 2n.
+    mBreakPoints.reserve(mListSite.size() * 4);
+    mEndPoints.reserve(mListSite.size() * 2);
+    mListEdgeElement.reserve(mListSite.size() * 3);
+  }
+  mBreakPointCount = 0;
+  mEndPointCount = 0;
+  mEdgeElementCount = 0;
+  mArcCount = 0;
+  mFreeBreakPoint = NO_POINT;
+  mFreeEndPoint = NO_POINT;
+  mFreeEdgeElement = -1;
+  mMemoryStats = MemoryStats();
   mListVertex.reserve(mListSite.size() * 2);
   mListEdge.reserve(mListSite.size() * 3);
 
-  // Создаем события точек.
+  // Создаем события точек сверху вниз.
+  // Точки лежащие на одной высоте идут справа налево.
   mSiteEventsIndex = 0;
-  mSiteEvents.reserve(mListSite.size());
-  for(SiteIndex i = 0; i < mListSite.size(); ++i)
+  mSiteEvents.resize(mListSite.size());
+  if((mFlags & SORTED_SITES) && !(mFlags & PERIODIC))
+  {
+    for(SiteIndex i = 0; i < mListSite.size(); ++i)
+    {
+      assert(i == 0 || !SweepBefore(mListSite[i], mListSite[i - 1]));
+      mSiteEvents[i] = i;
+    }
+  }
+  else
+  {
+    for(SiteIndex i = 0; i < mListSite.size(); ++i)
+    {
+      mSiteEvents[i] = i;
+    }
+    SortSiteEvents(mListSite, mSiteEvents);
+  }
+  mBounds = BasicRect<T>(mRect);
+
+  if(mFlags & REORDER_SITES)
   {
-    mSiteEvents.push_back(i);
+    ReorderSites();
   }
 
-  // Сортируем события точек сверху вниз.
-  // Точки лежащие на одной высоте сортируются справа налево.
-  std::sort(mSiteEvents.begin(), mSiteEvents.end(), [this](SiteIndex n1, SiteIndex n2) -> bool
+  mFingerCost = 0.0f;
+  mRootCost = 0.0f;
+  mSearchCount = 0;
+  mEventCount = 0;
+  mSweepLine = 0;
+  mProgress = Progress();
+  mProgress.siteCount = mSiteEvents.size();
+
+  if(mSiteEvents.empty())
   {
-    const Point &p1 = mListSite[n1];
-    const Point &p2 = mListSite[n2];
+    return;
+  }
 
-    if(p1.y == p2.y)
-      return p1.x > p2.x;
-    return p1.y > p2.y;
-  });
+  // Вставляем первую арку.
+  assert(mSiteEvents[mSiteEventsIndex] < mListSite.size());
+  InsertSiteFirstHead(mSiteEvents[mSiteEventsIndex]);
+  mSweepLine = mListSite[mSiteEvents[mSiteEventsIndex]].y;
+  ++mSiteEventsIndex;
 
-  // Строим диаграмму.
-  Process();
+  // Вставляем все самые верхние точки, лежащие на одной высоте.
+  while(mSiteEventsIndex < mSiteEvents.size())
+  {
+    assert(mSiteEvents[mSiteEventsIndex] < mListSite.size());
 
-  return *this;
+    if(mSweepLine > mListSite[mSiteEvents[mSiteEventsIndex]].y)
+    {
+      break;
+    }
+
+    InsertSiteTop(mSiteEvents[mSiteEventsIndex]);
+    ++mSiteEventsIndex;
+  }
+
+  mProgress.sweepLine = mSweepLine;
+  mProgress.siteEvents = mSiteEventsIndex;
+}
+
+template<class T>
+void BasicVoronoi<T>::EndDiagram()
+{
+  if(!mSiteEvents.empty())
+  {
+    SampleMemory();
+    ReleaseProcess();
+
+    PostProcess();
+    SampleMemory();
+    ReleasePostProcess();
+  }
+
+  if((mFlags & REORDER_SITES) && (mFlags & (RESTORE_SITE_ORDER | PERIODIC)))
+  {
+    RestoreSiteOrder();
+  }
+  mProgress.done = true;
+}
+
+template<class T>
+void BasicVoronoi<T>::BuildPeriodic()
+{
+  // Убираем копии предыдущего построения.
+  assert(mSiteOrder.empty());
+  assert(mBoundary.empty());
+  const size_t count = mListSite.size() - mPeriodicSource.size();
+  mListSite.resize(count);
+  std::vector<unsigned int>().swap(mPeriodicSource);
+  if(count == 0)
+  {
+    return;
+  }
+
+  const geometry::Rect rect = mRect;
+  const geometry::Point size = rect.rt - rect.lb;
+  for(SiteIndex i = 0; i < count; ++i)
+  {
+    assert(mListSite[i].x >= rect.lb.x && mListSite[i].x < rect.rt.x);
+    assert(mListSite[i].y >= rect.lb.y && mListSite[i].y < rect.rt.y);
+  }
+
+  double band = PERIODIC_BAND * std::sqrt(size.x * size.y / count);
+  while(true)
+  {
+    // Добавляем копии точек, попавшие в полосу шириной band вокруг области.
+    // Полоса шире области, если точек мало, тогда копий больше 8.
+    mRect = geometry::Rect(rect.lb - geometry::Point(band), rect.rt + geometry::Point(band));
+    const int copies = static_cast<int>(std::ceil(band / std::min(size.x, size.y)));
+    for(int y = -copies; y <= copies; ++y)
+    {
+      for(int x = -copies; x <= copies; ++x)
+      {
+        if(x == 0 && y == 0)
+        {
+          continue;
+        }
+        const geometry::Point shift(x * size.x, y * size.y);
+        for(SiteIndex i = 0; i < count; ++i)
+        {
+          const geometry::Point site = geometry::Point(mListSite[i]) + shift;
+          if(site.x >= mRect.lb.x && site.x <= mRect.rt.x && site.y >= mRect.lb.y && site.y <= mRect.rt.y)
+          {
+            mListSite.push_back(Point(site));
+            mPeriodicSource.push_back(i);
+          }
+        }
+      }
+    }
+
+    BuildDiagram();
+    if(IsPeriodicComplete(count))
+    {
+      break;
+    }
+
+    Clear();
+    mListSite.resize(count);
+    mPeriodicSource.clear();
+    band *= 2.0;
+  }
+
+  mRect = rect;
+  FinishPeriodic(count);
+}
+
+template<class T>
+bool BasicVoronoi<T>::IsPeriodicComplete(size_t count) const
+{
+  // Ячейка, построенная без части точек, содержит настоящую ячейку.
+  // Если каждая вершина ячейки ближе к своей точке, чем к любой точке
+  // вне области, отсутствующие точки ячейку не режут. Обрезанная областью
+  // ячейка имеет вершину на границе и не проходит проверку.
+  std::vector<bool> hasEdge(count, false);
+  for(auto it = mListEdge.begin(); it != mListEdge.end(); ++it)
+  {
+    const SiteIndex sites[2] = {(*it).site1, (*it).site2};
+    for(int k = 0; k < 2; ++k)
+    {
+      if(sites[k] >= count)
+      {
+        continue;
+      }
+      hasEdge[sites[k]] = true;
+
+      const geometry::Point site(mListSite[sites[k]]);
+      const geometry::Point vertex[2] = {geometry::Point(mListVertex[(*it).vertex1]),
+                                         geometry::Point(mListVertex[(*it).vertex2])};
+      for(int j = 0; j < 2; ++j)
+      {
+        const double radius = glm::length(vertex[j] - site);
+        if(vertex[j].x - radius < mRect.lb.x || vertex[j].x + radius > mRect.rt.x ||
+           vertex[j].y - radius < mRect.lb.y || vertex[j].y + radius > mRect.rt.y)
+        {
+          return false;
+        }
+      }
+    }
+  }
+  return std::find(hasEdge.begin(), hasEdge.end(), false) == hasEdge.end();
+}
+
+template<class T>
+void BasicVoronoi<T>::FinishPeriodic(size_t count)
+{
+  // Новые номера копий и вершин, -1 - не используется.
+  std::vector<int> siteIndex(mListSite.size() - count, -1);
+  std::vector<VertexIndex> vertexIndex(mListVertex.size(), -1);
+
+  std::vector<Point> sites(mListSite.begin(), mListSite.begin() + count);
+  std::vector<unsigned int> source;
+  std::vector<Point> vertex;
+  std::vector<Edge> edges;
+  vertex.reserve(mListVertex.size());
+  edges.reserve(mListEdge.size());
+
+  for(auto it = mListEdge.begin(); it != mListEdge.end(); ++it)
+  {
+    if((*it).site1 >= count && (*it).site2 >= count)
+    {
+      continue;
+    }
+
+    Edge edge = *it;
+    SiteIndex *site[2] = {&edge.site1, &edge.site2};
+    for(int k = 0; k < 2; ++k)
+    {
+      if(*site[k] >= count)
+      {
+        int &index = siteIndex[*site[k] - count];
+        if(index < 0)
+        {
+          index = static_cast<int>(sites.size());
+          sites.push_back(mListSite[*site[k]]);
+          source.push_back(mPeriodicSource[*site[k] - count]);
+        }
+        *site[k] = static_cast<SiteIndex>(index);
+      }
+    }
+
+    unsigned int *v[2] = {&edge.vertex1, &edge.vertex2};
+    for(int k = 0; k < 2; ++k)
+    {
+      VertexIndex &index = vertexIndex[*v[k]];
+      if(index < 0)
+      {
+        index = static_cast<VertexIndex>(vertex.size());
+        vertex.push_back(mListVertex[*v[k]]);
+      }
+      *v[k] = static_cast<unsigned int>(index);
+    }
+    edges.push_back(edge);
+  }
+
+  mListSite.swap(sites);
+  mPeriodicSource.swap(source);
+  mListVertex.swap(vertex);
+  mListEdge.swap(edges);
 }
 
-void Voronoi::Clear()
+template<class T>
+void BasicVoronoi<T>::Clear()
 {
-  std::vector<glm::vec2>().swap(mListVertex);
+  if(mFlags & REUSE_MEMORY)
+  {
+    mListVertex.clear();
+    mListEdge.clear();
+    return;
+  }
+  std::vector<Point>().swap(mListVertex);
   std::vector<Edge>().swap(mListEdge);
 }
 
-void Voronoi::ReleaseProcess()
+template<class T>
+void BasicVoronoi<T>::Assign(const std::vector<Point> &sites, const Point &size)
+{
+  Cancel();
+  assert(mHead == nullptr);
+  mListSite = sites;
+  mRect = geometry::Rect(geometry::Point(), geometry::Point(size));
+  mBoundary.clear();
+  mSiteOrder.clear();
+  mPeriodicSource.clear();
+  mProgress = Progress();
+  Clear();
+}
+
+template<class T>
+void BasicVoronoi<T>::ReorderSites()
+{
+  std::vector<Point> sites(mListSite.size());
+  std::vector<unsigned int> order(mListSite.size());
+  for(SiteIndex i = 0; i < mSiteEvents.size(); ++i)
+  {
+    sites[i] = mListSite[mSiteEvents[i]];
+    // Точки могли быть переставлены предыдущим построением.
+    order[i] = mSiteOrder.empty() ? mSiteEvents[i] : mSiteOrder[mSiteEvents[i]];
+    mSiteEvents[i] = i;
+  }
+  mListSite.swap(sites);
+  mSiteOrder.swap(order);
+}
+
+template<class T>
+void BasicVoronoi<T>::RestoreSiteOrder()
+{
+  assert(mSiteOrder.size() == mListSite.size());
+
+  std::vector<Point> sites(mListSite.size());
+  for(SiteIndex i = 0; i < mListSite.size(); ++i)
+  {
+    sites[mSiteOrder[i]] = mListSite[i];
+  }
+  mListSite.swap(sites);
+
+  for(auto it = mListEdge.begin(); it != mListEdge.end(); ++it)
+  {
+    (*it).site1 = mSiteOrder[(*it).site1];
+    (*it).site2 = mSiteOrder[(*it).site2];
+  }
+  std::vector<unsigned int>().swap(mSiteOrder);
+}
+
+template<class T>
+void BasicVoronoi<T>::ReleaseProcess()
 {
   assert(mSiteEventsIndex == mSiteEvents.size());
   assert(mCircleEvents.empty());
   RemoveTree();
 
-  std::vector<SiteIndex>().swap(mSiteEvents);
-  std::multiset<CircleEvent *, CircleEventComparator>().swap(mCircleEvents);
+  if(mFlags & REUSE_MEMORY)
+  {
+    mSiteEvents.clear();
+  }
+  else
+  {
+    std::vector<SiteIndex>().swap(mSiteEvents);
+    ReleaseFreeLists();
+  }
+  mArcCount = 0;
 }
 
-void Voronoi::ReleasePostProcess()
+template<class T>
+void BasicVoronoi<T>::ReleasePostProcess()
 {
   assert(IsListEdgeElementEmpty());
   assert(IsListPointsEmpty());
 
-  std::vector<IElement *>().swap(mListPoints);
-  std::vector<EdgeElement *>().swap(mListEdgeElement);
+  if(mFlags & REUSE_MEMORY)
+  {
+    mBreakPoints.clear();
+    mEndPoints.clear();
+    mListEdgeElement.clear();
+  }
+  else
+  {
+    std::vector<BreakPoint>().swap(mBreakPoints);
+    std::vector<EndPoint>().swap(mEndPoints);
+    std::vector<EdgeElement>().swap(mListEdgeElement);
+  }
+  mFreeBreakPoint = NO_POINT;
+  mFreeEndPoint = NO_POINT;
+  mFreeEdgeElement = -1;
 }
 
-bool Voronoi::IsList(BtreeElement *btreeElement)
+template<class T>
+bool BasicVoronoi<T>::IsList(BtreeElement *btreeElement)
 {
   assert(btreeElement);
 
   return btreeElement->left == nullptr && btreeElement->right == nullptr;
 }
 
-bool Voronoi::IsNode(BtreeElement *btreeElement)
+template<class T>
+bool BasicVoronoi<T>::IsNode(BtreeElement *btreeElement)
 {
   assert(btreeElement);
 
@@ -163,14 +787,16 @@ bool Voronoi::IsNode(BtreeElement *btreeElement)
 
 
 #ifdef VORONOI_DEBUG_INFO
-void Voronoi::GenerateListsBPA()
+template<class T>
+void BasicVoronoi<T>::GenerateListsBPA()
 {
   mListArc.clear();
   mListBP.clear();
   GenerateListsBPA(mHead);
 }
 
-void Voronoi::GenerateListsBPA(BtreeElement *node)
+template<class T>
+void BasicVoronoi<T>::GenerateListsBPA(BtreeElement *node)
 {
   if(node == nullptr)
   {
@@ -189,17 +815,18 @@ void Voronoi::GenerateListsBPA(BtreeElement *node)
   }
 }
 
-void Voronoi::PrintListsBPA()
+template<class T>
+void BasicVoronoi<T>::PrintListsBPA()
 {
   printf("arcs: ");
   for(auto it = mListArc.begin(); it != mListArc.end(); ++it)
   {
-    printf("%i, ", static_cast<ArcElement *>((*it)->element)->site);
+    printf("%i, ", (*it)->site);
   }
   printf("\nbp:     ");
   for(auto it = mListBP.begin(); it != mListBP.end(); ++it)
   {
-    printf("%i, ", static_cast<BPElement *>((*it)->element)->id);
+    printf("%i, ", (*it)->bp);
   }
   printf("\n");
 
@@ -208,14 +835,17 @@ void Voronoi::PrintListsBPA()
 #endif
 
 
-void Voronoi::InsertSiteFirstHead(const SiteIndex site)
+template<class T>
+void BasicVoronoi<T>::InsertSiteFirstHead(const SiteIndex site)
 {
   assert(mHead == nullptr);
-  mHead = new BtreeElement(new ArcElement(site));
+  mHead = AllocElement(NO_POINT, site);
+  mArcCount = 1;
 }
 
 
-void Voronoi::InsertSiteTop(const SiteIndex site)
+template<class T>
+void BasicVoronoi<T>::InsertSiteTop(const SiteIndex site)
 {
   assert(site < mListSite.size());
   assert(mHead);
@@ -227,11 +857,14 @@ void Voronoi::InsertSiteTop(const SiteIndex site)
   //              arc2  arc1
   // Где BP - новый брекпоинт, arc2 - новая арка, arc1 - старый корень дерева.
 
+  // Арка справа от нового брекпоинта - самая левая арка старого дерева.
+  const SiteIndex rightSite = RightArc(mHead)->site;
+
   // Создаем элементы.
-  PointIndex newBpIndex = NewBPElement();
-  PointIndex bpTopIndex = NewBPElement();
-  BtreeElement *newArc = new BtreeElement(new ArcElement(site));
-  BtreeElement *newBp = new BtreeElement(mListPoints[newBpIndex]);
+  PointIndex newBpIndex = NewBPElement(site, rightSite);
+  PointIndex bpTopIndex = NewBPElement(site, rightSite);
+  BtreeElement *newArc = AllocElement(NO_POINT, site);
+  BtreeElement *newBp = AllocElement(newBpIndex, site);
 
   // Связываем элементы дерева.
   newBp->left = newArc;
@@ -241,57 +874,51 @@ void Voronoi::InsertSiteTop(const SiteIndex site)
   mHead->parent = newBp;
 
   mHead = newBp;
+  ++mArcCount;
 
   // Новая грань появилась между аркой в которую вставляем и новой аркой.
-  NewEdge(newBpIndex, bpTopIndex,
-          static_cast<ArcElement *>(newArc->element)->site,
-          static_cast<ArcElement *>(RightArc(newBp->right)->element)->site);
+  NewEdge(newBpIndex, bpTopIndex, site, rightSite);
 }
 
 
-void Voronoi::InsertArc(BtreeElement *btreeElement, const SiteIndex site)
+template<class T>
+void BasicVoronoi<T>::InsertArc(BtreeElement *btreeElement, const SiteIndex site)
 {
   // параметры должны существовать, элемент дерева должен быть листом,
   // листом дерева должна быть арка.
   assert(site < mListSite.size());
   assert(btreeElement);
   assert(IsList(btreeElement));
-  assert(btreeElement->element);
-  assert(btreeElement->element->type == IElement::ARC);
 
   // Если существует событие круга для арки, его нужно удалить.
-  if(static_cast<ArcElement *>(btreeElement->element)->event)
+  if(btreeElement->event)
   {
-    RemoveCircleEvent(static_cast<ArcElement *>(btreeElement->element)->event);
-    static_cast<ArcElement *>(btreeElement->element)->event = nullptr;
+    RemoveCircleEvent(btreeElement->event);
   }
 
-  // Удаляем элемент текущего листа (arc1) и вставляем новое поддерево вида:
+  // Превращаем текущий лист (arc1) в узел и вставляем новое поддерево вида:
   //      BP1
   //     |   |
   //  arc1   BP2
   //        |   |
   //     arc2   arc1
 
-  const SiteIndex siteArc1 = static_cast<ArcElement *>(btreeElement->element)->site;
-
-  // Удаляем элемент узла arc1 и сам узел.
-  delete static_cast<ArcElement *>(btreeElement->element);
-  btreeElement->element = nullptr;
+  const SiteIndex siteArc1 = btreeElement->site;
 
   // Создаем 4 новых элемента дерева.
   // И 1 элемент заменяем.
   // 3 арки и 2 брекпоинта.
 
-  BtreeElement *arcLeft = new BtreeElement(new ArcElement(siteArc1));
-  BtreeElement *arcMid = new BtreeElement(new ArcElement(site));
-  BtreeElement *arcRight = new BtreeElement(new ArcElement(siteArc1));
+  BtreeElement *arcLeft = AllocElement(NO_POINT, siteArc1);
+  BtreeElement *arcMid = AllocElement(NO_POINT, site);
+  BtreeElement *arcRight = AllocElement(NO_POINT, siteArc1);
 
-  IElement *bpLeft = mListPoints[NewBPElement()];
-  BtreeElement *bpRight = new BtreeElement(mListPoints[NewBPElement()]);
+  const PointIndex bpLeft = NewBPElement(siteArc1, site);
+  const PointIndex bpRightIndex = NewBPElement(site, siteArc1);
+  BtreeElement *bpRight = AllocElement(bpRightIndex, site);
 
   // Связываем элементы.
-  btreeElement->element = bpLeft;
+  btreeElement->bp = bpLeft;
 
   btreeElement->left = arcLeft;
   arcLeft->parent = btreeElement;
@@ -305,23 +932,27 @@ void Voronoi::InsertArc(BtreeElement *btreeElement, const SiteIndex site)
   bpRight->right = arcRight;
   arcRight->parent = bpRight;
 
+  // Одна арка стала тремя.
+  mArcCount += 2;
+
   // Проверяем событие круга для левой и правой арки.
    CheckCircleEvent(LeftArcBP(arcLeft).second, arcLeft, arcMid);
    CheckCircleEvent(arcMid, arcRight, RightArcBP(arcRight).second);
 
+  // Следующий поиск начнется с новой арки.
+  mFinger = arcMid;
+
   // Новая грань появилась между аркой в которую вставляем и новой аркой.
-   NewEdge(static_cast<BPElement *>(bpLeft)->pos,
-           static_cast<BPElement *>(bpRight->element)->pos,
-           siteArc1, site);
+   NewEdge(bpLeft, bpRightIndex, siteArc1, site);
 }
 
 
-void Voronoi::RemoveArc(BtreeElement *arc)
+template<class T>
+void BasicVoronoi<T>::RemoveArc(BtreeElement *arc)
 {
   assert(arc);
-  assert(arc->element);
-  assert(arc->element->type == IElement::ARC);
-  assert(static_cast<ArcElement *>(arc->element)->event);
+  assert(IsList(arc));
+  assert(arc->event);
 
   std::pair<BtreeElement *, BtreeElement *> left = LeftArcBP(arc);
   std::pair<BtreeElement *, BtreeElement *> right = RightArcBP(arc);
@@ -329,18 +960,24 @@ void Voronoi::RemoveArc(BtreeElement *arc)
   // Арки слева и справа должны существовать.
   assert(left.second && right.second);
 
+  // Арка удаляется, следующий поиск начнем с соседней.
+  if(mFinger == arc)
+  {
+    mFinger = left.second;
+  }
+
   // Ищем левый и правый брекпоинты от арки.
   BtreeElement *bpLeft = left.first;
   BtreeElement *bpRight = right.first;
 
   // Удаляем событие круга для левой и правой арки.
-  if(static_cast<ArcElement *>(left.second->element)->event)
+  if(left.second->event)
   {
-    RemoveCircleEvent(static_cast<ArcElement *>(left.second->element)->event);
+    RemoveCircleEvent(left.second->event);
   }
-  if(static_cast<ArcElement *>(right.second->element)->event)
+  if(right.second->event)
   {
-    RemoveCircleEvent(static_cast<ArcElement *>(right.second->element)->event);
+    RemoveCircleEvent(right.second->event);
   }
 
   // Смотрим какой из брекпоинтов является родителем арки, а какой нет.
@@ -358,27 +995,19 @@ void Voronoi::RemoveArc(BtreeElement *arc)
   assert(bpArcModify);
 
   // Точка соединения трех граней
-  unsigned int endPointPos =
-    NewEPElement(static_cast<ArcElement *>(left.second->element)->site,
-                 static_cast<ArcElement *>(arc->element)->site,
-                 static_cast<ArcElement *>(right.second->element)->site);
+  PointIndex endPointPos = NewEPElement(left.second->site, arc->site, right.second->site);
 
   // Новый брекпоинт.
-  PointIndex newBreakPointPos = NewBPElement();
-  IElement *newBreakPoint = mListPoints[newBreakPointPos];
+  PointIndex newBreakPointPos = NewBPElement(left.second->site, right.second->site);
 
   // Обновляем текущие грани
-  UpdateEdge(static_cast<BPElement *>(bpLeft->element)->pos,
-             static_cast<BPElement *>(bpRight->element)->pos,
-             endPointPos);
+  UpdateEdge(bpLeft->bp, bpRight->bp, endPointPos);
   // И добавляем новую грань.
-  NewEdge(newBreakPointPos, endPointPos,
-          static_cast<ArcElement *>(left.second->element)->site,
-          static_cast<ArcElement *>(right.second->element)->site);
+  NewEdge(newBreakPointPos, endPointPos, left.second->site, right.second->site);
 
   // Брекпоинты которые мы заменили нам больше не нужны, удалим.
-  DeleteBPElement(static_cast<BPElement *>(bpLeft->element)->pos);
-  DeleteBPElement(static_cast<BPElement *>(bpRight->element)->pos);
+  DeleteBPElement(bpLeft->bp);
+  DeleteBPElement(bpRight->bp);
 
   //      BPM                 BPM
   //     |   |               |   |
@@ -388,8 +1017,8 @@ void Voronoi::RemoveArc(BtreeElement *arc)
 
   // Изменяем брекпоинты
   // Вместо двух брекпоинтов будет один.
-  bpArcRemove->element = nullptr;
-  bpArcModify->element = newBreakPoint;
+  bpArcRemove->bp = NO_POINT;
+  bpArcModify->bp = newBreakPointPos;
 
   // Ищем второго ребенка для первого брекпоинта(который нужно удалить).
   // Первый ребенок - наша арка.
@@ -423,9 +1052,9 @@ void Voronoi::RemoveArc(BtreeElement *arc)
   }
 
   // Удаляем арку и первый брекпоинт.
-  delete static_cast<ArcElement *>(arc->element);
-  delete arc;
-  delete bpArcRemove;
+  FreeElement(arc);
+  --mArcCount;
+  FreeElement(bpArcRemove);
 
   // Проверяем событие круга для левой и правой арки от удаленной.
    CheckCircleEvent(LeftArcBP(left.second).second, left.second, right.second);
@@ -433,35 +1062,33 @@ void Voronoi::RemoveArc(BtreeElement *arc)
 }
 
 
-void Voronoi::CheckCircleEvent(BtreeElement *leftArc, BtreeElement *arc, BtreeElement *rightArc)
+template<class T>
+void BasicVoronoi<T>::CheckCircleEvent(BtreeElement *leftArc, BtreeElement *arc, BtreeElement *rightArc)
 {
   assert(arc);
   if(!leftArc || !rightArc)
   {
     return;
   }
-  assert(leftArc->element->type == IElement::ARC);
-  assert(arc->element->type == IElement::ARC);
-  assert(rightArc->element->type == IElement::ARC);
+  assert(IsList(leftArc) && IsList(arc) && IsList(rightArc));
 
   // Если событие существует для этой арки, ничего не делаем.
-  if(static_cast<ArcElement *>(arc->element)->event)
+  if(arc->event)
   {
     return;
   }
 
   // Проверяем на совпадение точек.
-  if(static_cast<ArcElement *>(leftArc->element)->site  == static_cast<ArcElement *>(arc->element)->site ||
-    static_cast<ArcElement *>(arc->element)->site       == static_cast<ArcElement *>(rightArc->element)->site ||
-    static_cast<ArcElement *>(rightArc->element)->site  == static_cast<ArcElement *>(leftArc->element)->site)
+  if(leftArc->site  == arc->site ||
+     arc->site      == rightArc->site ||
+     rightArc->site == leftArc->site)
   {
     return;
   }
 
   // Если точки лежат на одной прямой - выходим.
-  double rotation = RotationPoint(mListSite[static_cast<ArcElement *>(leftArc->element)->site],
-                                  mListSite[static_cast<ArcElement *>(arc->element)->site],
-                                  mListSite[static_cast<ArcElement *>(rightArc->element)->site]);
+  // Знак ориентации вычисляется точно, даже для почти коллинеарных точек.
+  double rotation = predicates::Orient2d(mListSite[leftArc->site], mListSite[arc->site], mListSite[rightArc->site]);
 
   if(rotation == 0)
   {
@@ -474,51 +1101,44 @@ void Voronoi::CheckCircleEvent(BtreeElement *leftArc, BtreeElement *arc, BtreeEl
     return;
   }
 
-  // Ищем центр окружности по трем точкам.
-  Point c = CreateCircle(mListSite[static_cast<ArcElement *>(leftArc->element)->site],
-                         mListSite[static_cast<ArcElement *>(arc->element)->site],
-                         mListSite[static_cast<ArcElement *>(rightArc->element)->site]);
-
-  // Ищем радиус окружности.
-  double r = sqrt(pow(mListSite[static_cast<ArcElement *>(arc->element)->site].x - c.x, 2) +
-                  pow(mListSite[static_cast<ArcElement *>(arc->element)->site].y - c.y, 2));
-
-  float posy = static_cast<float>(c.y - r);
+  // Ищем нижнюю точку окружности по трем точкам.
+  T posy = CircleBottom<T>(mListSite[leftArc->site], mListSite[arc->site], mListSite[rightArc->site]);
 
   // Добавляем событие в том случае, если оно не выше заметающей прямой.
-  if(posy <= mSweepLine + EPS)
+  if(posy <= mSweepLine + static_cast<T>(EPS))
   {
     NewCircleEvent(arc, posy);
   }
 }
 
-void Voronoi::NewCircleEvent(BtreeElement *arc, float posy)
+template<class T>
+void BasicVoronoi<T>::NewCircleEvent(BtreeElement *arc, T posy)
 {
   assert(arc);
-  assert(arc->element);
-  assert(arc->element->type == IElement::ARC);
-  assert(!static_cast<ArcElement *>(arc->element)->event);
+  assert(IsList(arc));
+  assert(!arc->event);
 
   // Создаем событие круга для данной арки.
-  CircleEvent *event = new CircleEvent(posy, arc);
+  CircleEvent *event = AllocEvent(posy, arc);
 
   // Добавляем событие в арку
-  static_cast<ArcElement *>(arc->element)->event = event;
+  arc->event = event;
 
   // Добавляем событие в список.
   mCircleEvents.insert(event);
+  mMemoryStats.peakCircleEvents = std::max(mMemoryStats.peakCircleEvents, mCircleEvents.size());
 }
 
-void Voronoi::RemoveCircleEvent(CircleEvent *event)
+template<class T>
+void BasicVoronoi<T>::RemoveCircleEvent(CircleEvent *event)
 {
   assert(event);
   assert(event->arc);
-  assert(event->arc->element);
-  assert(event->arc->element->type == IElement::ARC);
-  assert(static_cast<ArcElement *>(event->arc->element)->event == event);
+  assert(IsList(event->arc));
+  assert(event->arc->event == event);
 
   // Для данной арки больше нет события круга.
-  static_cast<ArcElement *>(event->arc->element)->event = nullptr;
+  event->arc->event = nullptr;
 
   // Ищем все события с такой высотой.
   auto range = mCircleEvents.equal_range(event);
@@ -532,10 +1152,11 @@ void Voronoi::RemoveCircleEvent(CircleEvent *event)
       break;
     }
   }
-  delete event;
+  FreeEvent(event);
 }
 
-std::pair<Voronoi::BtreeElement *, Voronoi::BtreeElement *> Voronoi::LeftArcBP(BtreeElement *element)
+template<class T>
+std::pair<typename BasicVoronoi<T>::BtreeElement *, typename BasicVoronoi<T>::BtreeElement *> BasicVoronoi<T>::LeftArcBP(BtreeElement *element)
 {
   assert(element);
 
@@ -549,7 +1170,8 @@ std::pair<Voronoi::BtreeElement *, Voronoi::BtreeElement *> Voronoi::LeftArcBP(B
   return std::pair<BtreeElement *, BtreeElement *>(bp, arc);
 }
 
-std::pair<Voronoi::BtreeElement *, Voronoi::BtreeElement *> Voronoi::RightArcBP(BtreeElement *element)
+template<class T>
+std::pair<typename BasicVoronoi<T>::BtreeElement *, typename BasicVoronoi<T>::BtreeElement *> BasicVoronoi<T>::RightArcBP(BtreeElement *element)
 {
   assert(element);
 
@@ -563,7 +1185,8 @@ std::pair<Voronoi::BtreeElement *, Voronoi::BtreeElement *> Voronoi::RightArcBP(
   return std::pair<BtreeElement *, BtreeElement *>(bp, arc);
 }
 
-Voronoi::BtreeElement *Voronoi::LeftBP(BtreeElement *element)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::LeftBP(BtreeElement *element)
 {
   assert(element);
 
@@ -580,7 +1203,8 @@ Voronoi::BtreeElement *Voronoi::LeftBP(BtreeElement *element)
   return element->parent;
 }
 
-Voronoi::BtreeElement *Voronoi::LeftArc(BtreeElement *element)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::LeftArc(BtreeElement *element)
 {
   assert(element);
 
@@ -593,7 +1217,8 @@ Voronoi::BtreeElement *Voronoi::LeftArc(BtreeElement *element)
   return element;
 }
 
-Voronoi::BtreeElement *Voronoi::RightBP(BtreeElement *element)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::RightBP(BtreeElement *element)
 {
   assert(element);
 
@@ -610,7 +1235,8 @@ Voronoi::BtreeElement *Voronoi::RightBP(BtreeElement *element)
   return element->parent;
 }
 
-Voronoi::BtreeElement *Voronoi::RightArc(BtreeElement *element)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::RightArc(BtreeElement *element)
 {
   assert(element);
 
@@ -623,52 +1249,131 @@ Voronoi::BtreeElement *Voronoi::RightArc(BtreeElement *element)
   return element;
 }
 
-Voronoi::PointIndex Voronoi::NewBPElement()
+template<class T>
+typename BasicVoronoi<T>::PointIndex BasicVoronoi<T>::NewBPElement(const SiteIndex left, const SiteIndex right)
 {
-  BPElement *element = new BPElement(mListPoints.size());
-  mListPoints.push_back(element);
-  return mListPoints.size() - 1;
-}
+  BreakPoint bp;
+  bp.left = left;
+  bp.right = right;
+  bp.edge = -1;
 
-void Voronoi::DeleteBPElement(PointIndex el)
-{
-  assert(mListPoints.size() > el);
-  assert(mListPoints[el]);
-  assert(mListPoints[el]->type == IElement::BREAK_POINT);
+  PointIndex index = mFreeBreakPoint;
+  if(index != NO_POINT)
+  {
+    mFreeBreakPoint = mBreakPoints[index].left;
+    mBreakPoints[index] = bp;
+  }
+  else
+  {
+    mBreakPoints.push_back(bp);
+    index = static_cast<PointIndex>(mBreakPoints.size() - 1);
+    assert(mBreakPoints.size() <= END_POINT_TAG);
+  }
 
-  delete static_cast<BPElement *>(mListPoints[el]);
-  mListPoints[el] = nullptr;
+  ++mBreakPointCount;
+  mMemoryStats.peakBreakPoints = std::max(mMemoryStats.peakBreakPoints, mBreakPointCount);
+  return index;
 }
 
-void Voronoi::Process()
+template<class T>
+void BasicVoronoi<T>::DeleteBPElement(PointIndex el)
 {
-  if(mSiteEvents.empty())
+  assert(!IsEndPoint(el));
+  assert(mBreakPoints.size() > el);
+  assert(mBreakPoints[el].edge != DELETED_BREAK_POINT);
+
+  mBreakPoints[el].edge = DELETED_BREAK_POINT;
+  --mBreakPointCount;
+
+  if(mFlags & LOW_MEMORY)
   {
-    return;
+    mBreakPoints[el].left = mFreeBreakPoint;
+    mFreeBreakPoint = el;
   }
+}
 
-  // Вставляем первую арку.
-  assert(mSiteEvents[mSiteEventsIndex] < mListSite.size());
-  InsertSiteFirstHead(mSiteEvents[mSiteEventsIndex]);
-  mSweepLine = mListSite[mSiteEvents[mSiteEventsIndex]].y;
-  ++mSiteEventsIndex;
+template<class T>
+bool BasicVoronoi<T>::IsEndPoint(PointIndex p)
+{
+  return (p & END_POINT_TAG) != 0;
+}
 
-  // Вставляем все самые верхние точки, лежащие на одной высоте.
-  while(mSiteEventsIndex < mSiteEvents.size())
-  {
-    assert(mSiteEvents[mSiteEventsIndex] < mListSite.size());
+template<class T>
+typename BasicVoronoi<T>::BreakPoint &BasicVoronoi<T>::GetBreakPoint(PointIndex p)
+{
+  assert(!IsEndPoint(p) && p < mBreakPoints.size());
+  return mBreakPoints[p];
+}
+
+template<class T>
+const typename BasicVoronoi<T>::BreakPoint &BasicVoronoi<T>::GetBreakPoint(PointIndex p) const
+{
+  assert(!IsEndPoint(p) && p < mBreakPoints.size());
+  return mBreakPoints[p];
+}
+
+template<class T>
+typename BasicVoronoi<T>::EndPoint &BasicVoronoi<T>::GetEndPoint(PointIndex p)
+{
+  assert(IsEndPoint(p) && (p & ~END_POINT_TAG) < mEndPoints.size());
+  return mEndPoints[p & ~END_POINT_TAG];
+}
+
+template<class T>
+const typename BasicVoronoi<T>::EndPoint &BasicVoronoi<T>::GetEndPoint(PointIndex p) const
+{
+  assert(IsEndPoint(p) && (p & ~END_POINT_TAG) < mEndPoints.size());
+  return mEndPoints[p & ~END_POINT_TAG];
+}
+
+template<class T>
+void BasicVoronoi<T>::DeletePoint(PointIndex p)
+{
+  IsEndPoint(p) ? DeleteEPElement(p) : DeleteBPElement(p);
+}
+
+template<class T>
+size_t BasicVoronoi<T>::MemoryFootprint() const
+{
+  // Узел std::multiset - значение и 3 указателя с цветом.
+  const size_t eventBytes = sizeof(CircleEvent) + sizeof(CircleEvent *) + 4 * sizeof(void *);
+  // Дерево из k арок содержит k листьев и k - 1 узлов.
+  const size_t treeNodes = mArcCount > 0 ? 2 * mArcCount - 1 : 0;
+
+  return mListSite.capacity() * sizeof(Point) +
+         mSiteOrder.capacity() * sizeof(unsigned int) +
+         mPeriodicSource.capacity() * sizeof(unsigned int) +
+         mSiteEvents.capacity() * sizeof(SiteIndex) +
+         mBreakPoints.capacity() * sizeof(BreakPoint) +
+         mEndPoints.capacity() * sizeof(EndPoint) +
+         mListEdgeElement.capacity() * sizeof(EdgeElement) +
+         mListVertex.capacity() * sizeof(Point) +
+         mListEdge.capacity() * sizeof(Edge) +
+         treeNodes * sizeof(BtreeElement) +
+         mCircleEvents.size() * eventBytes;
+}
+
+template<class T>
+void BasicVoronoi<T>::SampleMemory()
+{
+  mMemoryStats.peakBytes = std::max(mMemoryStats.peakBytes, MemoryFootprint());
+}
 
-    if(mSweepLine > mListSite[mSiteEvents[mSiteEventsIndex]].y)
+template<class T>
+bool BasicVoronoi<T>::ProcessEvents(size_t maxEvents)
+{
+  for(size_t processed = 0; processed < maxEvents; ++processed)
+  {
+    if(mSiteEventsIndex >= mSiteEvents.size() && mCircleEvents.empty())
     {
       break;
     }
 
-    InsertSiteTop(mSiteEvents[mSiteEventsIndex]);
-    ++mSiteEventsIndex;
-  }
+    if(++mEventCount % MEMORY_SAMPLE_PERIOD == 0)
+    {
+      SampleMemory();
+    }
 
-  while(mSiteEventsIndex < mSiteEvents.size() || !mCircleEvents.empty())
-  {
     auto cEvent = mCircleEvents.begin();
 
     bool isCircleEvent;
@@ -691,15 +1396,16 @@ void Voronoi::Process()
     {
       mSweepLine = (*cEvent)->posy;
       RemoveArc((*cEvent)->arc);
-      delete *cEvent;
+      FreeEvent(*cEvent);
       mCircleEvents.erase(cEvent);
+      ++mProgress.circleEvents;
     }
     else
     {
       assert(mSiteEvents[mSiteEventsIndex] < mListSite.size());
       mSweepLine = mListSite[mSiteEvents[mSiteEventsIndex]].y;
       // Обрабатываем событие точки.
-      InsertArc(FindArc(mListSite[mSiteEvents[mSiteEventsIndex]].x), mSiteEvents[mSiteEventsIndex]);
+      InsertArc(LocateArc(mListSite[mSiteEvents[mSiteEventsIndex]].x), mSiteEvents[mSiteEventsIndex]);
 
       // Удаляем событие точки.
       ++mSiteEventsIndex;
@@ -708,55 +1414,130 @@ void Voronoi::Process()
     //GenerateListsBPA();
     //PrintListsBPA();
   }
-  ReleaseProcess();
 
-  PostProcess();
-  ReleasePostProcess();
+  mProgress.sweepLine = mSweepLine;
+  mProgress.siteEvents = mSiteEventsIndex;
+  return mSiteEventsIndex >= mSiteEvents.size() && mCircleEvents.empty();
 }
 
-Voronoi::BtreeElement *Voronoi::FindArc(float x)
+template<class T>
+T BasicVoronoi<T>::BreakPointX(const BtreeElement *node) const
 {
-  return FindArc(mHead, x);
+  // Брекпоинт хранит точки арок слева и справа от себя,
+  // поэтому спускаться к соседним листьям не нужно.
+  const BreakPoint &bp = GetBreakPoint(node->bp);
+  return IntersectParabols<T>(mSweepLine, mListSite[bp.left], mListSite[bp.right]);
 }
 
-Voronoi::BtreeElement *Voronoi::FindArc(BtreeElement *bp, float x)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::LocateArc(T x)
 {
-  assert(bp);
-  assert(bp->element);
-  assert(bp->element->type == IElement::BREAK_POINT ||
-         bp->element->type == IElement::ARC);
+  if(!(mFlags & FINGER_SEARCH) || !mFinger)
+  {
+    unsigned int count = 0;
+    return FindArc(mHead, x, count);
+  }
+
+  // Выбираем поиск с меньшей средней стоимостью. Периодически пробуем другой,
+  // чтобы его оценка успевала за изменением расположения точек.
+  bool finger = mFingerCost <= mRootCost;
+  if(++mSearchCount % SEARCH_SAMPLE_PERIOD == 0)
+  {
+    finger = !finger;
+  }
+
+  unsigned int count = 0;
+  BtreeElement *arc = finger ? FindArcFrom(mFinger, x, count) : FindArc(mHead, x, count);
+
+  float &cost = finger ? mFingerCost : mRootCost;
+  cost += (static_cast<float>(count) - cost) / SEARCH_COST_WINDOW;
+
+  return arc;
+}
 
-  if(bp->element->type == IElement::ARC)
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::FindArc(BtreeElement *node, T x, unsigned int &count)
+{
+  assert(node);
+  while(node->bp != NO_POINT)
   {
-    assert(IsList(bp));
-    return bp;
+    assert(GetBreakPoint(node->bp).left == LeftArc(node->left)->site);
+    assert(GetBreakPoint(node->bp).right == RightArc(node->right)->site);
+
+    // Вычисляем x координату брекпоинта.
+    T bpx = BreakPointX(node);
+    ++count;
+
+    node = x > bpx ? node->right : node->left;
   }
 
-  // Ищем арки слева и справа от текущего брекпоинта.
-  BtreeElement *left = LeftArc(bp->left);
-  BtreeElement *right = RightArc(bp->right);
+  assert(IsList(node));
+  return node;
+}
+
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::FindArcFrom(BtreeElement *finger, T x, unsigned int &count)
+{
+  assert(finger);
+  assert(IsList(finger));
 
-  // Вычисляем x координату брекпоинта.
-  float bpx = static_cast<float>(IntersectParabols(mSweepLine,
-                                 mListSite[static_cast<ArcElement *>(left->element)->site],
-                                 mListSite[static_cast<ArcElement *>(right->element)->site]));
+  // Брекпоинты слева и справа от арки - ее границы.
+  BtreeElement *right = RightBP(finger);
+  if(right)
+  {
+    ++count;
+    if(x > BreakPointX(right))
+    {
+      // Точка правее арки. Поднимаемся по правым границам: поддерево справа от
+      // брекпоинта занимает промежуток до следующей правой границы.
+      for(BtreeElement *next = RightBP(right); next; next = RightBP(right))
+      {
+        ++count;
+        if(!(x > BreakPointX(next)))
+        {
+          break;
+        }
+        right = next;
+      }
+      return FindArc(right->right, x, count);
+    }
+  }
 
-  if(x > bpx)
+  BtreeElement *left = LeftBP(finger);
+  if(left)
   {
-    return FindArc(bp->right, x);
+    ++count;
+    if(!(x > BreakPointX(left)))
+    {
+      // Точка левее арки, поднимаемся по левым границам.
+      for(BtreeElement *next = LeftBP(left); next; next = LeftBP(left))
+      {
+        ++count;
+        if(x > BreakPointX(next))
+        {
+          break;
+        }
+        left = next;
+      }
+      return FindArc(left->left, x, count);
+    }
   }
 
-  return FindArc(bp->left, x);
+  // Точка попала в арку.
+  return finger;
 }
 
 
-void Voronoi::RemoveTree()
+template<class T>
+void BasicVoronoi<T>::RemoveTree()
 {
   RemoveTree(mHead);
   mHead = nullptr;
+  mFinger = nullptr;
 }
 
-void Voronoi::RemoveTree(BtreeElement *node)
+template<class T>
+void BasicVoronoi<T>::RemoveTree(BtreeElement *node)
 {
   if(node == nullptr)
   {
@@ -773,285 +1554,708 @@ void Voronoi::RemoveTree(BtreeElement *node)
     RemoveTree(node->right);
   }
 
-  if(node->element->type == IElement::ARC)
+  FreeElement(node);
+}
+
+template<class T>
+bool BasicVoronoi<T>::IsListEdgeElementEmpty()
+{
+  return mEdgeElementCount == 0;
+}
+
+template<class T>
+typename BasicVoronoi<T>::BtreeElement *BasicVoronoi<T>::AllocElement(PointIndex bp, SiteIndex site)
+{
+  if(mFreeElements.empty())
   {
-    delete static_cast<ArcElement *>(node->element);
+    return new BtreeElement(bp, site);
   }
-  delete node;
+  BtreeElement *element = mFreeElements.back();
+  mFreeElements.pop_back();
+  return new(element) BtreeElement(bp, site);
+}
+
+template<class T>
+void BasicVoronoi<T>::FreeElement(BtreeElement *element)
+{
+  mFreeElements.push_back(element);
 }
 
-bool Voronoi::IsListEdgeElementEmpty()
+template<class T>
+typename BasicVoronoi<T>::CircleEvent *BasicVoronoi<T>::AllocEvent(T posy, BtreeElement *arc)
 {
-  for(EdgeIndex i = 0; i < static_cast<int>(mListEdgeElement.size()); ++i)
+  if(mFreeEvents.empty())
   {
-    if(mListEdgeElement[i])
-    {
-      return false;
-    }
+    return new CircleEvent(posy, arc);
   }
-  return true;
+  CircleEvent *event = mFreeEvents.back();
+  mFreeEvents.pop_back();
+  return new(event) CircleEvent(posy, arc);
+}
+
+template<class T>
+void BasicVoronoi<T>::FreeEvent(CircleEvent *event)
+{
+  mFreeEvents.push_back(event);
 }
 
-bool Voronoi::IsListPointsEmpty()
+template<class T>
+void BasicVoronoi<T>::ReleaseFreeLists()
 {
-  for(PointIndex i = 0; i < mListPoints.size(); ++i)
+  assert(mHead == nullptr);
+  assert(mCircleEvents.empty());
+  for(auto it = mFreeElements.begin(); it != mFreeElements.end(); ++it)
   {
-    if(mListPoints[i])
-    {
-      return false;
-    }
+    delete *it;
   }
-  return true;
+  for(auto it = mFreeEvents.begin(); it != mFreeEvents.end(); ++it)
+  {
+    delete *it;
+  }
+  for(auto it = mFreeEventNodes.begin(); it != mFreeEventNodes.end(); ++it)
+  {
+    ::operator delete(*it);
+  }
+  std::vector<BtreeElement *>().swap(mFreeElements);
+  std::vector<CircleEvent *>().swap(mFreeEvents);
+  std::vector<void *>().swap(mFreeEventNodes);
+}
+
+template<class T>
+bool BasicVoronoi<T>::IsListPointsEmpty()
+{
+  return mBreakPointCount == 0 && mEndPointCount == 0;
 }
 
-void Voronoi::NewEdge(PointIndex el1, PointIndex el2, const SiteIndex site1, const SiteIndex site2)
+template<class T>
+void BasicVoronoi<T>::NewEdge(PointIndex el1, PointIndex el2, const SiteIndex site1, const SiteIndex site2)
 {
   assert(site1 < mListSite.size() && site2 < mListSite.size());
-  assert(mListPoints[el1] && mListPoints[el2]);
-  assert(mListPoints[el1]->type == IElement::BREAK_POINT || mListPoints[el1]->type == IElement::END_POINT);
-  assert(mListPoints[el2]->type == IElement::BREAK_POINT || mListPoints[el2]->type == IElement::END_POINT);
 
-  EdgeElement *edge = new EdgeElement(el1, el2, site1, site2);
+  EdgeIndex index = mFreeEdgeElement;
+  if(index >= 0)
+  {
+    mFreeEdgeElement = static_cast<EdgeIndex>(mListEdgeElement[index].el2);
+    mListEdgeElement[index] = EdgeElement(el1, el2, site1, site2);
+  }
+  else
+  {
+    mListEdgeElement.push_back(EdgeElement(el1, el2, site1, site2));
+    index = static_cast<EdgeIndex>(mListEdgeElement.size() - 1);
+  }
 
-  mListEdgeElement.push_back(edge);
+  ++mEdgeElementCount;
+  mMemoryStats.peakEdgeElements = std::max(mMemoryStats.peakEdgeElements, mEdgeElementCount);
 
-  if(mListPoints[el1]->type == IElement::BREAK_POINT)
+  if(!IsEndPoint(el1))
   {
-    static_cast<BPElement *>(mListPoints[el1])->edge = mListEdgeElement.size() - 1;
+    GetBreakPoint(el1).edge = index;
   }
-  if(mListPoints[el2]->type == IElement::BREAK_POINT)
+  if(!IsEndPoint(el2))
   {
-    static_cast<BPElement *>(mListPoints[el2])->edge = mListEdgeElement.size() - 1;
+    GetBreakPoint(el2).edge = index;
   }
 }
 
-Voronoi::PointIndex Voronoi::NewEPElement(const SiteIndex s1, const SiteIndex s2, const SiteIndex s3)
+template<class T>
+typename BasicVoronoi<T>::PointIndex BasicVoronoi<T>::NewEPElement(const SiteIndex s1, const SiteIndex s2, const SiteIndex s3)
 {
   assert(s1 < mListSite.size() && s2 < mListSite.size() && s3 < mListSite.size());
-  Point point = CreateCircle(mListSite[s1], mListSite[s2], mListSite[s3]);
+  Point point = CreateCircle<T>(mListSite[s1], mListSite[s2], mListSite[s3]);
+
+  EndPoint ep;
+  ep.pos = -1;
+  if(RectContainsPoint(mBounds, point) &&
+     (mBoundary.empty() || ConvexContainsPoint<double>(&mBoundary[0], mBoundary.size(), geometry::Point(point))))
+  {
+    ep.pos = NewVertex(point);
+  }
+  ep.site1 = s1;
+  ep.site2 = s2;
+  ep.site3 = s3;
+  ep.refCount = 3;
 
-  VertexIndex pointIndex = -1;
-  if(RectContainsPoint(mRect, point))
+  PointIndex index = mFreeEndPoint;
+  if(index != NO_POINT)
+  {
+    mFreeEndPoint = mEndPoints[index].site1;
+    mEndPoints[index] = ep;
+  }
+  else
   {
-    pointIndex = NewVertex(point);
+    mEndPoints.push_back(ep);
+    index = static_cast<PointIndex>(mEndPoints.size() - 1);
+    assert(mEndPoints.size() <= END_POINT_TAG);
   }
 
-  EPElement *element = new EPElement(pointIndex, s1, s2, s3);
-  mListPoints.push_back(element);
-  return mListPoints.size() - 1;
+  ++mEndPointCount;
+  mMemoryStats.peakEndPoints = std::max(mMemoryStats.peakEndPoints, mEndPointCount);
+  return index | END_POINT_TAG;
 }
 
-Voronoi::VertexIndex Voronoi::NewVertex(const glm::vec2 &point)
+template<class T>
+typename BasicVoronoi<T>::VertexIndex BasicVoronoi<T>::NewVertex(const Point &point)
 {
   mListVertex.push_back(point);
   return mListVertex.size() - 1;
 }
 
-void Voronoi::DeleteEPElement(PointIndex el)
+template<class T>
+void BasicVoronoi<T>::DeleteEPElement(PointIndex el)
 {
-  assert(mListPoints.size() > el);
-  assert(mListPoints[el]);
-  assert(mListPoints[el]->type == IElement::END_POINT);
-  assert(static_cast<EPElement *>(mListPoints[el])->refCount > 0);
+  EndPoint &ep = GetEndPoint(el);
+  assert(ep.refCount > 0);
 
-  --static_cast<EPElement *>(mListPoints[el])->refCount;
-  if(static_cast<EPElement *>(mListPoints[el])->refCount == 0)
+  --ep.refCount;
+  if(ep.refCount == 0)
   {
-    delete static_cast<EPElement *>(mListPoints[el]);
-    mListPoints[el] = nullptr;
+    --mEndPointCount;
+
+    if(mFlags & LOW_MEMORY)
+    {
+      ep.site1 = mFreeEndPoint;
+      mFreeEndPoint = el & ~END_POINT_TAG;
+    }
   }
 }
 
-void Voronoi::UpdateEdge(PointIndex el1, PointIndex el2, PointIndex ep)
+template<class T>
+void BasicVoronoi<T>::UpdateEdge(PointIndex el1, PointIndex el2, PointIndex ep)
 {
-  assert(mListPoints[el1] && mListPoints[el2] && mListPoints[ep]);
-  assert(mListPoints[el1]->type == IElement::BREAK_POINT && 
-         mListPoints[el2]->type == IElement::BREAK_POINT);
-  EdgeIndex e1 = static_cast<BPElement *>(mListPoints[el1])->edge;
-  EdgeIndex e2 = static_cast<BPElement *>(mListPoints[el2])->edge;
-  assert(e1 >= 0 && e2 >= 0);
-  assert(mListEdgeElement[e1]->el1 == el1 ||
-         mListEdgeElement[e1]->el2 == el1);
-  assert(mListEdgeElement[e2]->el1 == el2 ||
-         mListEdgeElement[e2]->el2 == el2);
-
-  mListEdgeElement[e1]->el1 == el1 ? mListEdgeElement[e1]->el1 = ep : mListEdgeElement[e1]->el2 = ep;
-  static_cast<BPElement *>(mListPoints[el1])->edge = -1;
-
-  mListEdgeElement[e2]->el1 == el2 ? mListEdgeElement[e2]->el1 = ep : mListEdgeElement[e2]->el2 = ep;
-  static_cast<BPElement *>(mListPoints[el2])->edge = -1;
-
-  // Если мы нашли грань и она полностью лежит в рабочей области, обработаем ее и удалим.
-  if(mListPoints[mListEdgeElement[e1]->el1]->type == IElement::END_POINT &&
-     mListPoints[mListEdgeElement[e1]->el2]->type == IElement::END_POINT)
+  BreakPoint &bp1 = GetBreakPoint(el1);
+  BreakPoint &bp2 = GetBreakPoint(el2);
+  const EdgeIndex edges[2] = {bp1.edge, bp2.edge};
+  const PointIndex points[2] = {el1, el2};
+  assert(bp1.edge >= 0 && bp2.edge >= 0 && bp1.edge != bp2.edge);
+  bp1.edge = -1;
+  bp2.edge = -1;
+
+  for(int i = 0; i < 2; ++i)
   {
-    EPElement *ep1 = static_cast<EPElement *>(mListPoints[mListEdgeElement[e1]->el1]);
-    EPElement *ep2 = static_cast<EPElement *>(mListPoints[mListEdgeElement[e1]->el2]);
-    if(ep1->pos >= 0 && ep2->pos >= 0)
+    EdgeElement &edge = mListEdgeElement[edges[i]];
+    assert(edge.el1 == points[i] || edge.el2 == points[i]);
+    edge.el1 == points[i] ? edge.el1 = ep : edge.el2 = ep;
+
+    // Если мы нашли грань и она полностью лежит в рабочей области, обработаем ее и удалим.
+    if(IsEndPoint(edge.el1) && IsEndPoint(edge.el2))
     {
-      mListEdge.push_back(Edge(mListEdgeElement[e1]->site1, mListEdgeElement[e1]->site2,
-                                  static_cast<EPElement *>(mListPoints[mListEdgeElement[e1]->el1])->pos,
-                                  static_cast<EPElement *>(mListPoints[mListEdgeElement[e1]->el2])->pos));
-      DeleteEPElement(mListEdgeElement[e1]->el1);
-      DeleteEPElement(mListEdgeElement[e1]->el2);
-      DeleteEdge(e1);
+      const VertexIndex v1 = GetEndPoint(edge.el1).pos;
+      const VertexIndex v2 = GetEndPoint(edge.el2).pos;
+      if(v1 >= 0 && v2 >= 0)
+      {
+        mListEdge.push_back(Edge(edge.site1, edge.site2, v1, v2));
+        DeleteEPElement(edge.el1);
+        DeleteEPElement(edge.el2);
+        DeleteEdge(edges[i]);
+      }
     }
   }
-  if(mListPoints[mListEdgeElement[e2]->el1]->type == IElement::END_POINT &&
-     mListPoints[mListEdgeElement[e2]->el2]->type == IElement::END_POINT)
+}
+
+template<class T>
+void BasicVoronoi<T>::DeleteEdge(EdgeIndex el)
+{
+  assert(static_cast<int>(mListEdgeElement.size()) > el);
+  assert(mListEdgeElement[el].el1 != NO_POINT);
+
+  mListEdgeElement[el].el1 = NO_POINT;
+  --mEdgeElementCount;
+
+  if(mFlags & LOW_MEMORY)
   {
-    EPElement *ep1 = static_cast<EPElement *>(mListPoints[mListEdgeElement[e2]->el1]);
-    EPElement *ep2 = static_cast<EPElement *>(mListPoints[mListEdgeElement[e2]->el2]);
-    if(ep1->pos >= 0 && ep2->pos >= 0)
-    {
-      mListEdge.push_back(Edge(mListEdgeElement[e2]->site1, mListEdgeElement[e2]->site2,
-                               static_cast<EPElement *>(mListPoints[mListEdgeElement[e2]->el1])->pos,
-                               static_cast<EPElement *>(mListPoints[mListEdgeElement[e2]->el2])->pos));
-      DeleteEPElement(mListEdgeElement[e2]->el1);
-      DeleteEPElement(mListEdgeElement[e2]->el2);
-      DeleteEdge(e2);
-    }
+    mListEdgeElement[el].el2 = static_cast<PointIndex>(mFreeEdgeElement);
+    mFreeEdgeElement = el;
   }
 }
 
-void Voronoi::DeleteEdge(EdgeIndex el)
+template<class T>
+const std::vector<unsigned int> &BasicVoronoi<T>::GetSiteOrder() const
 {
-  assert(static_cast<int>(mListEdgeElement.size()) > el);
-  assert(mListEdgeElement[el]);
+  return mSiteOrder;
+}
 
-  delete mListEdgeElement[el];
-  mListEdgeElement[el] = nullptr;
+template<class T>
+const std::vector<unsigned int> &BasicVoronoi<T>::GetPeriodicSource() const
+{
+  return mPeriodicSource;
 }
 
-const std::vector<Voronoi::Edge> &Voronoi::GetEdges() const
+template<class T>
+const std::vector<typename BasicVoronoi<T>::Edge> &BasicVoronoi<T>::GetEdges() const
 {
   return mListEdge;
 }
 
-const std::vector<glm::vec2> &Voronoi::GetVertex() const
+template<class T>
+const std::vector<typename BasicVoronoi<T>::Point> &BasicVoronoi<T>::GetVertex() const
 {
   return mListVertex;
 }
 
-void Voronoi::PostProcess()
+template<class T>
+const geometry::Rect &BasicVoronoi<T>::GetRect() const
+{
+  return mRect;
+}
+
+template<class T>
+const std::vector<geometry::Point> &BasicVoronoi<T>::GetBoundary() const
+{
+  return mBoundary;
+}
+
+template<class T>
+unsigned int BasicVoronoi<T>::GetFlags() const
+{
+  return mFlags;
+}
+
+template<class T>
+const typename BasicVoronoi<T>::MemoryStats &BasicVoronoi<T>::GetMemoryStats() const
+{
+  return mMemoryStats;
+}
+
+template<>
+bool BasicVoronoi<float>::Save(const std::string &fileName, bool topology) const
+{
+  return storage::Save(fileName, mRect, mListSite, mListVertex, mListEdge, topology, mSiteOrder, mPeriodicSource);
+}
+
+template<>
+bool BasicVoronoi<float>::Load(const std::string &fileName)
+{
+  assert(mHead == nullptr);
+
+  MappedDiagram diagram;
+  return diagram.Open(fileName) && Load(diagram);
+}
+
+template<>
+bool BasicVoronoi<float>::Load(const MappedDiagram &diagram)
+{
+  assert(mHead == nullptr);
+
+  if(!diagram.Validate())
+  {
+    return false;
+  }
+
+  mRect = diagram.GetRect();
+  std::vector<geometry::Point>().swap(mBoundary);
+  mSiteOrder.assign(diagram.GetSiteOrder().begin(), diagram.GetSiteOrder().end());
+  mPeriodicSource.assign(diagram.GetPeriodicSource().begin(), diagram.GetPeriodicSource().end());
+  mListSite.assign(diagram.GetSites().begin(), diagram.GetSites().end());
+  mListVertex.assign(diagram.GetVertex().begin(), diagram.GetVertex().end());
+  mListEdge.assign(diagram.GetEdges().begin(), diagram.GetEdges().end());
+  return true;
+}
+
+template<>
+bool BasicVoronoi<float>::SaveArchive(const std::string &fileName, float grid, compression::Level level) const
+{
+  return archive::Save(fileName, mRect, mListSite, mListVertex, mListEdge, grid, level);
+}
+
+template<>
+bool BasicVoronoi<float>::LoadArchive(const std::string &fileName)
+{
+  assert(mHead == nullptr);
+  std::vector<geometry::Point>().swap(mBoundary);
+  std::vector<unsigned int>().swap(mSiteOrder);
+  std::vector<unsigned int>().swap(mPeriodicSource);
+  return archive::Load(fileName, mRect, mListSite, mListVertex, mListEdge);
+}
+
+template<class T>
+void BasicVoronoi<T>::ClipEdge(EdgeIndex i, ClippedEdge &out) const
 {
-  for(EdgeIndex i = 0; i < static_cast<int>(mListEdgeElement.size()); ++i)
+  // Обрезка выполняется в double для любого T: прямые задаются коэффициентами
+  // порядка квадрата координат, во float их точности не хватает.
+  typedef geometry::Point Point;
+
+  const EdgeElement *edge = &mListEdgeElement[i];
+  assert(edge->site1 < mListSite.size() && edge->site2 < mListSite.size());
+
+  out.edge = i;
+  out.site1 = edge->site1;
+  out.site2 = edge->site2;
+  out.v1 = -1;
+  out.v2 = -1;
+  out.valid = false;
+
+  Segment clipped;
+
+  if(IsEndPoint(edge->el1) && IsEndPoint(edge->el2))
+  {
+    // Обрабатываем отрезок.
+    // Отрезок не полностью лежит в рабочей области, поэтому его надо обрезать.
+
+    const EndPoint *ep1 = &GetEndPoint(edge->el1);
+    const EndPoint *ep2 = &GetEndPoint(edge->el2);
+
+    Point p1 = ep1->pos >= 0 ? Point(mListVertex[ep1->pos]) : 
+      CreateCircle<double>(mListSite[ep1->site1], mListSite[ep1->site2], mListSite[ep1->site3]);
+
+    Point p2 = ep2->pos >= 0 ? Point(mListVertex[ep2->pos]) : 
+      CreateCircle<double>(mListSite[ep2->site1], mListSite[ep2->site2], mListSite[ep2->site3]);
+
+    out.valid = mBoundary.empty() ? ClipRectSegment(mRect, Segment(p1, p2), clipped) :
+      ClipConvexSegment(&mBoundary[0], mBoundary.size(), Segment(p1, p2), clipped);
+    out.v1 = ep1->pos;
+    out.v2 = ep2->pos;
+  }
+  else if(!IsEndPoint(edge->el1) && !IsEndPoint(edge->el2))
+  {
+    // Обрабатываем прямую
+    const Line line = Perpendicular(Line(Point(mListSite[edge->site1]), Point(mListSite[edge->site2])),
+                                    Center<double>(mListSite[edge->site1], mListSite[edge->site2]));
+    out.valid = mBoundary.empty() ? ClipRectLine(mRect, line, clipped) :
+      ClipConvexLine(&mBoundary[0], mBoundary.size(), line, clipped);
+  }
+  else
   {
-    if(mListEdgeElement[i])
+    const EndPoint *ep = IsEndPoint(edge->el1) ? &GetEndPoint(edge->el1) : &GetEndPoint(edge->el2);
+
+    // Ищем точку C в треугольнике.
+    SiteIndex dirPoint = ep->site1;
+    if(dirPoint == edge->site1 || dirPoint == edge->site2)
     {
-      EdgeElement *edge = mListEdgeElement[i];
-      assert(edge->site1 < mListSite.size() && edge->site2 < mListSite.size());
-      assert(edge->el1 < mListPoints.size() && edge->el2 < mListPoints.size());
-      assert(mListPoints[edge->el1]->type == IElement::BREAK_POINT || 
-             mListPoints[edge->el1]->type == IElement::END_POINT);
-      assert(mListPoints[edge->el2]->type == IElement::BREAK_POINT || 
-             mListPoints[edge->el2]->type == IElement::END_POINT);
-
-      if(mListPoints[edge->el1]->type == IElement::END_POINT &&
-         mListPoints[edge->el2]->type == IElement::END_POINT)
+      dirPoint = ep->site2;
+      if(dirPoint == edge->site1 || dirPoint == edge->site2)
       {
-        // Обрабатываем отрезок.
-        // Отрезок не полностью лежит в рабочей области, поэтому его надо обрезать.
+        dirPoint = ep->site3;
+        assert(dirPoint != edge->site1 && dirPoint != edge->site2);
+      }
+    }
+  
+    // Ищем срединный перпендикуляр к AB.
+    // Эта линия должна проходить через E (центр окружности).
+    Point center = Center<double>(mListSite[edge->site1], mListSite[edge->site2]);
+    Line rayLine = Perpendicular(Line(Point(mListSite[edge->site1]), Point(mListSite[edge->site2])), center);
 
-        EPElement *ep1 = static_cast<EPElement *>(mListPoints[edge->el1]);
-        EPElement *ep2 = static_cast<EPElement *>(mListPoints[edge->el2]);
-        assert(ep1 && ep2);
+    // Ищем еще один перпендикуляр к данной линии в точку C.
+    Line perpRay = Perpendicular(rayLine, Point(mListSite[dirPoint]));
 
-        Point p1 = ep1->pos >= 0 ? Point(mListVertex[ep1->pos]) : 
-          CreateCircle(mListSite[ep1->site1], mListSite[ep1->site2], mListSite[ep1->site3]);
+    Point point = ep->pos >= 0 ? Point(mListVertex[ep->pos]) : 
+      CreateCircle<double>(mListSite[ep->site1], mListSite[ep->site2], mListSite[ep->site3]);
 
-        Point p2 = ep2->pos >= 0 ? Point(mListVertex[ep2->pos]) : 
-          CreateCircle(mListSite[ep2->site1], mListSite[ep2->site2], mListSite[ep2->site3]);
+    Point dir = point - IntersectLines(rayLine, perpRay);
 
-        auto points = IntersectRectSegment(mRect, Segment(p1, p2));
+    out.valid = mBoundary.empty() ? ClipRectRay(mRect, Ray(point, center + dir), clipped) :
+      ClipConvexRay(&mBoundary[0], mBoundary.size(), Ray(point, center + dir), clipped);
+    out.v1 = ep->pos;
+  }
 
-        if(points.size() == 2)
-        {
-          VertexIndex v1 = ep1->pos >= 0 ? ep1->pos : NewVertex(points[0]);
-          VertexIndex v2 = ep2->pos >= 0 ? ep2->pos : NewVertex(points[1]);
+  out.a = typename BasicVoronoi<T>::Point(clipped.a);
+  out.b = typename BasicVoronoi<T>::Point(clipped.b);
+}
 
-          mListEdge.push_back(Edge(edge->site1, edge->site2, v1, v2));
-        }
+template<class T>
+void BasicVoronoi<T>::PostProcess()
+{
+  const size_t count = mListEdgeElement.size();
+  const size_t chunks = (count + POST_PROCESS_GRAIN - 1) / POST_PROCESS_GRAIN;
+  const unsigned int threads = (mFlags & PARALLEL_POST_PROCESS) ? 0 : 1;
 
-        DeleteEPElement(edge->el1);
-        DeleteEPElement(edge->el2);
-        DeleteEdge(i);
-        
-        continue;
-      }
-      if(mListPoints[edge->el1]->type == IElement::BREAK_POINT &&
-         mListPoints[edge->el2]->type == IElement::BREAK_POINT)
+  // Первый проход: обрезаем грани каждого куска.
+  std::vector<std::vector<ClippedEdge> > clipped(chunks);
+  ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+  {
+    for(size_t chunk = begin; chunk < end; ++chunk)
+    {
+      const size_t last = std::min(count, (chunk + 1) * POST_PROCESS_GRAIN);
+      for(size_t i = chunk * POST_PROCESS_GRAIN; i < last; ++i)
       {
-        // Обрабатываем прямую
-        auto points = IntersectRectLine(
-          mRect, Perpendicular(Line(mListSite[edge->site1], mListSite[edge->site2]),
-                               Center(mListSite[edge->site1], mListSite[edge->site2])));
-       
-        if(points.size() == 2)
+        if(mListEdgeElement[i].el1 != NO_POINT)
         {
-          VertexIndex v1 = NewVertex(points[0]);
-          VertexIndex v2 = NewVertex(points[1]);
-
-          mListEdge.push_back(Edge(edge->site1, edge->site2, v1, v2));
+          clipped[chunk].push_back(ClippedEdge());
+          ClipEdge(static_cast<EdgeIndex>(i), clipped[chunk].back());
         }
-
-        DeleteBPElement(edge->el1);
-        DeleteBPElement(edge->el2);
-        DeleteEdge(i);
-
-        continue;
       }
+    }
+  }, threads);
 
-      EPElement *ep = mListPoints[edge->el1]->type == IElement::END_POINT ? 
-        static_cast<EPElement *>(mListPoints[edge->el1]) :
-        static_cast<EPElement *>(mListPoints[edge->el2]);
+  // Места новых вершин и граней каждого куска.
+  std::vector<size_t> vertexOffset(chunks + 1, mListVertex.size());
+  std::vector<size_t> edgeOffset(chunks + 1, mListEdge.size());
+  for(size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    size_t vertices = 0;
+    size_t edges = 0;
+    for(auto it = clipped[chunk].begin(); it != clipped[chunk].end(); ++it)
+    {
+      if((*it).valid)
+      {
+        vertices += ((*it).v1 < 0) + ((*it).v2 < 0);
+        ++edges;
+      }
+    }
+    vertexOffset[chunk + 1] = vertexOffset[chunk] + vertices;
+    edgeOffset[chunk + 1] = edgeOffset[chunk] + edges;
+  }
+  mListVertex.resize(vertexOffset[chunks]);
+  mListEdge.resize(edgeOffset[chunks], Edge(0, 0, 0, 0));
 
-      // Ищем точку C в треугольнике.
-      SiteIndex dirPoint = ep->site1;
-      if(dirPoint == edge->site1 || dirPoint == edge->site2)
+  // Второй проход: записываем вершины и грани.
+  ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+  {
+    for(size_t chunk = begin; chunk < end; ++chunk)
+    {
+      size_t vertex = vertexOffset[chunk];
+      size_t edge = edgeOffset[chunk];
+      for(auto it = clipped[chunk].begin(); it != clipped[chunk].end(); ++it)
+      {
+        if(!(*it).valid)
+        {
+          continue;
+        }
+        VertexIndex v1 = (*it).v1;
+        if(v1 < 0)
+        {
+          mListVertex[vertex] = (*it).a;
+          v1 = static_cast<VertexIndex>(vertex++);
+        }
+        VertexIndex v2 = (*it).v2;
+        if(v2 < 0)
+        {
+          mListVertex[vertex] = (*it).b;
+          v2 = static_cast<VertexIndex>(vertex++);
+        }
+        mListEdge[edge++] = Edge((*it).site1, (*it).site2, v1, v2);
+      }
+    }
+  }, threads);
+
+  // Вершины на границе многоугольника берутся из результатов обрезки.
+  // Здесь остались грани, у которых хотя бы один конец не внутри области,
+  // поэтому все новые вершины обрезанных граней лежат на границе. Если от грани
+  // после обрезки ничего не осталось, на границе лежит ее существующая вершина.
+  std::vector<BorderVertex> border;
+  if(!mBoundary.empty())
+  {
+    const size_t firstVertex = vertexOffset[0];
+    for(size_t i = edgeOffset[0]; i < mListEdge.size(); ++i)
+    {
+      const Edge &edge = mListEdge[i];
+      const unsigned int ends[2] = {edge.vertex1, edge.vertex2};
+      for(int k = 0; k < 2; ++k)
+      {
+        if(ends[k] >= firstVertex)
+        {
+          const BorderVertex vertex = {static_cast<VertexIndex>(ends[k]), edge.site1, edge.site2};
+          border.push_back(vertex);
+        }
+      }
+    }
+    for(size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+      for(auto it = clipped[chunk].begin(); it != clipped[chunk].end(); ++it)
       {
-        dirPoint = ep->site2;
-        if(dirPoint == edge->site1 || dirPoint == edge->site2)
+        const VertexIndex ends[2] = {(*it).v1, (*it).v2};
+        for(int k = 0; k < 2; ++k)
         {
-          dirPoint = ep->site3;
-          assert(dirPoint != edge->site1 && dirPoint != edge->site2);
+          if(!(*it).valid && ends[k] >= 0)
+          {
+            const BorderVertex vertex = {ends[k], (*it).site1, (*it).site2};
+            border.push_back(vertex);
+          }
         }
       }
-    
-      // Ищем срединный перпендикуляр к AB.
-      // Эта линия должна проходить через E (центр окружности).
-      Point center = Center(mListSite[edge->site1], mListSite[edge->site2]);
-      Line rayLine = Perpendicular(Line(mListSite[edge->site1], mListSite[edge->site2]), center);
+    }
+  }
+
+  // Освобождаем элементы. Концы граней общие, поэтому последовательно.
+  for(size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    for(auto it = clipped[chunk].begin(); it != clipped[chunk].end(); ++it)
+    {
+      const EdgeElement &edge = mListEdgeElement[(*it).edge];
+      DeletePoint(edge.el1);
+      DeletePoint(edge.el2);
+      DeleteEdge((*it).edge);
+    }
+  }
+
+  if(!mBoundary.empty())
+  {
+    CloseBoundary(border);
+  }
+}
+
+template<class T>
+void BasicVoronoi<T>::CloseBoundary(const std::vector<BorderVertex> &border)
+{
+  typedef geometry::Point Point;
+  const size_t sides = mBoundary.size();
+
+  // Положение на границе: номер стороны плюс доля длины стороны.
+  auto position = [this, sides](double param) -> Point
+  {
+    const size_t side = static_cast<size_t>(param) % sides;
+    const double t = param - std::floor(param);
+    return mBoundary[side] + (mBoundary[side + 1 == sides ? 0 : side + 1] - mBoundary[side]) * t;
+  };
+
+  // Вершина на границе и точки ее граней.
+  struct Border
+  {
+    double param;
+    VertexIndex vertex;
+    SiteIndex sites[6];
+    unsigned int count;
+  };
+  // Допуск совпадения вершин на границе - несколько единиц округления
+  // координат T в масштабе области.
+  const double scale = std::max(std::max(std::abs(mRect.lb.x), std::abs(mRect.lb.y)),
+                                std::max(std::abs(mRect.rt.x), std::abs(mRect.rt.y)));
+  const double tolerance = 8.0 * std::numeric_limits<T>::epsilon() * scale;
+
+  std::vector<Border> points;
+  points.reserve(border.size());
+  for(auto it = border.begin(); it != border.end(); ++it)
+  {
+    const Point p(mListVertex[(*it).vertex]);
 
-      // Ищем еще один перпендикуляр к данной линии в точку C.
-      Line perpRay = Perpendicular(rayLine, mListSite[dirPoint]);
+    // Ближайшая сторона.
+    double best = std::numeric_limits<double>::infinity();
+    double param = 0.0;
+    for(size_t i = 0; i < sides; ++i)
+    {
+      const Point &a = mBoundary[i];
+      const Point d = mBoundary[i + 1 == sides ? 0 : i + 1] - a;
+      const double t = std::min(std::max(glm::dot(p - a, d) / glm::dot(d, d), 0.0), 1.0);
+      const double distance = glm::length(a + d * t - p);
+      if(distance < best)
+      {
+        best = distance;
+        param = i + std::min(t, 1.0 - std::numeric_limits<double>::epsilon());
+      }
+    }
 
-      Point point = ep->pos >= 0 ? Point(mListVertex[ep->pos]) : 
-        CreateCircle(mListSite[ep->site1], mListSite[ep->site2], mListSite[ep->site3]);
+    Border point;
+    point.param = param;
+    point.vertex = (*it).vertex;
+    point.sites[0] = (*it).site1;
+    point.sites[1] = (*it).site2;
+    point.count = 2;
+    points.push_back(point);
+  }
 
-      Point dir = point - IntersectLines(rayLine, perpRay);
+  // Упорядочиваем вдоль границы и объединяем повторы одной вершины.
+  std::sort(points.begin(), points.end(), [](const Border &a, const Border &b) -> bool
+  {
+    return a.param < b.param || (a.param == b.param && a.vertex < b.vertex);
+  });
+  size_t count = 0;
+  for(size_t i = 0; i < points.size(); ++i)
+  {
+    if(count > 0 && points[count - 1].vertex == points[i].vertex)
+    {
+      Border &point = points[count - 1];
+      for(unsigned int k = 0; k < points[i].count && point.count < 6; ++k)
+      {
+        point.sites[point.count++] = points[i].sites[k];
+      }
+    }
+    else
+    {
+      points[count++] = points[i];
+    }
+  }
+  points.resize(count);
 
-      auto points = IntersectRectRay(mRect, Ray(point, center + dir));
+  // Вершины углов создаются по мере надобности.
+  std::vector<VertexIndex> corners(sides, -1);
+  auto corner = [this, &corners](size_t i) -> VertexIndex
+  {
+    if(corners[i] < 0)
+    {
+      corners[i] = NewVertex(Point(mBoundary[i]));
+    }
+    return corners[i];
+  };
 
-      if(points.size() == 2)
+  if(points.empty())
+  {
+    // Граница не пересекает граней: область целиком - ячейка ближайшей точки.
+    if(mListSite.empty())
+    {
+      return;
+    }
+    SiteIndex owner = 0;
+    for(SiteIndex i = 1; i < mListSite.size(); ++i)
+    {
+      if(glm::length(Point(mListSite[i]) - mBoundary[0]) < glm::length(Point(mListSite[owner]) - mBoundary[0]))
       {
-        VertexIndex v1 = ep->pos >= 0 ? ep->pos : NewVertex(points[0]);
-        VertexIndex v2 = NewVertex(points[1]);
+        owner = i;
+      }
+    }
+    for(size_t i = 0; i < sides; ++i)
+    {
+      mListEdge.push_back(Edge(owner, owner, corner(i), corner(i + 1 == sides ? 0 : i + 1)));
+    }
+    return;
+  }
+
+  for(size_t i = 0; i < points.size(); ++i)
+  {
+    const Border &from = points[i];
+    const Border &to = points[i + 1 == points.size() ? 0 : i + 1];
+    double length = to.param - from.param;
+    if(length <= 0.0)
+    {
+      // Участок через начало границы или вся граница для единственной вершины.
+      length += sides;
+    }
 
-        mListEdge.push_back(Edge(edge->site1, edge->site2, v1, v2));
+    // Владелец участка - ближайшая к середине точка среди точек граней его концов.
+    const Point middle = position(from.param + length / 2.0);
+    SiteIndex owner = from.sites[0];
+    double best = std::numeric_limits<double>::infinity();
+    for(int end = 0; end < 2; ++end)
+    {
+      const Border &point = end == 0 ? from : to;
+      for(unsigned int k = 0; k < point.count; ++k)
+      {
+        const double distance = glm::length(Point(mListSite[point.sites[k]]) - middle);
+        if(distance < best)
+        {
+          best = distance;
+          owner = point.sites[k];
+        }
       }
+    }
 
-      mListPoints[edge->el1]->type == IElement::END_POINT ? 
-        DeleteEPElement(edge->el1) : DeleteBPElement(edge->el1);
-      mListPoints[edge->el2]->type == IElement::END_POINT ? 
-        DeleteEPElement(edge->el2) : DeleteBPElement(edge->el2);
-      DeleteEdge(i);
+    // Грани вдоль границы через углы между концами участка.
+    // Угол, совпадающий с текущим концом, пропускается.
+    VertexIndex current = from.vertex;
+    const size_t first = static_cast<size_t>(from.param);
+    const size_t steps = static_cast<size_t>(std::floor(from.param + length)) - first;
+    for(size_t k = 1; k <= steps; ++k)
+    {
+      const size_t side = (first + k) % sides;
+      if(glm::length(Point(mListVertex[current]) - mBoundary[side]) < tolerance)
+      {
+        continue;
+      }
+      const VertexIndex vertex = corner(side);
+      mListEdge.push_back(Edge(owner, owner, current, vertex));
+      current = vertex;
+    }
+    if(current != to.vertex &&
+       glm::length(Point(mListVertex[current]) - Point(mListVertex[to.vertex])) >= tolerance)
+    {
+      mListEdge.push_back(Edge(owner, owner, current, to.vertex));
     }
   }
 }
 
-const std::vector<glm::vec2> &Voronoi::GetSites() const
+template<class T>
+const std::vector<typename BasicVoronoi<T>::Point> &BasicVoronoi<T>::GetSites() const
 {
   return mListSite;
 }
 
+template class BasicVoronoi<float>;
+template class BasicVoronoi<double>;
@@ -3,82 +3,306 @@
 
 
 #include "geometry.h"
+#include "compression.h"
+#include "parallel.h"
+#include <chrono>
+#include <functional>
+#include <future>
 #include <set>
+#include <string>
 #include <vector>
 
-//#define VORONOI_DEBUG_INFO
+class MappedDiagram;
 
-#ifdef VORONOI_DEBUG_INFO
-template<int T>
-struct Val
-{
-  static int Get()
-  {
-    static int id = 0;
-    return id++;
-  }
-};
-#endif
+//#define VORONOI_DEBUG_INFO
 
-class Voronoi
+/// Типы, общие для диаграмм с любым скалярным типом.
+/// Грани содержат только индексы, поэтому одинаковы для float и double.
+class VoronoiBase
 {
 public:
 
   /// Грань.
   /// Содержит индексы на две точки в списке точек, лежащих слева и справа от грани.
   /// Так же содержит индексы на две вершины в списке вершин, лежащих на концах грани.
+  /// Грань вдоль границы многоугольника области ограничивает одну ячейку:
+  /// у нее site1 == site2, ячейка лежит слева при обходе от vertex1 к vertex2.
   struct Edge
   {
     unsigned int site1;
     unsigned int site2;
     unsigned int vertex1;
     unsigned int vertex2;
+    /// Поля не инициализируются, для массивов граней.
+    Edge()
+    {
+    }
     Edge(unsigned int s1, unsigned int s2, unsigned int v1, unsigned int v2)
      : site1(s1), site2(s2), vertex1(v1), vertex2(v2)
     {
     }
   };
 
+  /// Флаги построения.
+  enum Flags
+  {
+    /// Точки уже упорядочены в порядке заметающей прямой:
+    /// по убыванию y, при равных y - по убыванию x.
+    /// Сортировка событий точек не выполняется.
+    SORTED_SITES = 1 << 0,
+
+    /// Перед построением скопировать точки в порядке заметающей прямой.
+    /// Алгоритм обращается к соседним по высоте точкам, поэтому обращения
+    /// к списку точек попадают в кэш. Точки и грани готовой диаграммы остаются
+    /// в новом порядке, исходные номера точек возвращает GetSiteOrder.
+    REORDER_SITES = 1 << 1,
+
+    /// Вместе с REORDER_SITES: после построения вернуть точки в исходный порядок
+    /// и перенумеровать точки в гранях.
+    RESTORE_SITE_ORDER = 1 << 2,
+
+    /// Искать арку для новой точки от арки предыдущей вставки, а не от корня.
+    /// Выгодно, когда соседние по высоте точки близки по x (ряды сетки с общим y).
+    /// Способ поиска выбирается по измеренной средней стоимости,
+    /// поэтому на случайных точках поиск остается обычным.
+    FINGER_SEARCH = 1 << 3,
+
+    /// Обрезать оставшиеся после заметания грани в несколько потоков.
+    /// Номера вершин и граней совпадают с последовательной обработкой
+    /// и не зависят от числа потоков.
+    PARALLEL_POST_PROCESS = 1 << 4,
+
+    /// Экономия памяти: места удаленных брекпоинтов, точек пересечения граней
+    /// и граней переиспользуются через списки свободных мест. Служебные таблицы
+    /// растут до наибольшего числа одновременно существующих элементов (порядка
+    /// корня из числа точек для равномерных точек), а не до 4n, 2n и 3n.
+    /// Грани, обрезанные областью, идут в результате в другом порядке.
+    LOW_MEMORY = 1 << 5,
+
+    /// Периодическая область: область диаграммы - тор, точки должны лежать
+    /// в [0, size). Копируются только точки в полосе у границ области, ширина
+    /// полосы - несколько средних расстояний между точками. Если ячейка исходной
+    /// точки может зависеть от точки вне полосы, полоса удваивается и диаграмма
+    /// строится заново.
+    /// В результате после исходных точек идут копии их соседей через границу
+    /// (GetPeriodicSource), в гранях остаются только грани ячеек исходных точек.
+    /// Ячейки исходных точек полные и не обрезаны, вершины у границы могут лежать
+    /// вне области. Грань через границу есть дважды: у ячейки каждой из точек.
+    /// С REORDER_SITES порядок точек всегда восстанавливается, SORTED_SITES
+    /// не используется - копии сортируются вместе с точками.
+    PERIODIC = 1 << 6,
+
+    /// Не освобождать память между построениями: служебные таблицы, списки
+    /// вершин и граней сохраняют емкость, свободные элементы дерева и события
+    /// круга остаются в объекте. Повторные построения одним объектом (Assign)
+    /// почти не обращаются к общему распределителю памяти.
+    /// Память освобождается деструктором.
+    REUSE_MEMORY = 1 << 7,
+  };
+
+  /// Статистика памяти последнего построения.
+  struct MemoryStats
+  {
+    /// Наибольшее число одновременно существующих брекпоинтов,
+    /// точек пересечения граней, граней и событий круга.
+    size_t peakBreakPoints;
+    size_t peakEndPoints;
+    size_t peakEdgeElements;
+    size_t peakCircleEvents;
+
+    /// Наибольший объем памяти, занятой диаграммой во время построения, в байтах.
+    /// Учитываются все списки и таблицы по их емкости, дерево и события круга
+    /// по числу узлов. Измеряется через каждые MEMORY_SAMPLE_PERIOD событий.
+    size_t peakBytes;
+
+    MemoryStats()
+      : peakBreakPoints(0), peakEndPoints(0), peakEdgeElements(0), peakCircleEvents(0), peakBytes(0)
+    {}
+  };
+
+  /// Ход построения.
+  struct Progress
+  {
+    /// Уровень заметающей прямой. Прямая опускается сверху вниз.
+    double sweepLine;
+
+    /// Обработано событий точек из siteCount и событий круга.
+    size_t siteEvents;
+    size_t siteCount;
+    size_t circleEvents;
+
+    /// Построение завершено, списки вершин и граней окончательные.
+    bool done;
+
+    Progress()
+      : sweepLine(0.0), siteEvents(0), siteCount(0), circleEvents(0), done(false)
+    {}
+  };
+
+  /// Функция, получающая ход построения.
+  typedef std::function<void(const Progress &)> ProgressCallback;
+};
+
+/// Диаграмма вороного со скалярным типом T (float или double).
+/// Точки, вершины, заметающая прямая и события круга хранятся в T, брекпоинты
+/// вычисляются в T. Знаки предикатов точные, высота события круга считается
+/// в double и округляется до T один раз (geometry::CircleBottom), обрезка
+/// граней областью выполняется в double.
+/// Voronoi (float) - быстрый путь, DVoronoi (double) - для больших координат.
+/// Определения и явные инстанцирования для float и double - в Voronoi.cpp.
+template<class T>
+class BasicVoronoi : public VoronoiBase
+{
+public:
+  /// Точка.
+  typedef geometry::BasicPoint<T> Point;
+
   /// Конструктор по умолчанию.
-  Voronoi();
+  BasicVoronoi();
 
   /// Конструктор.
   /// @param sites Список точек. Точки не должен содержать одинаковых точек.
   /// @param size Размер рабочей области.
-  Voronoi(const std::vector<glm::vec2> &sites, const glm::vec2 &size);
+  /// @param flags Флаги построения Flags.
+  BasicVoronoi(const std::vector<Point> &sites, const Point &size, unsigned int flags = 0);
+
+  /// Конструктор с выпуклой областью.
+  /// Грани обрезаются многоугольником, ячейки у границы замыкаются гранями
+  /// вдоль границы, у которых site1 == site2. GetRect возвращает ограничивающий
+  /// прямоугольник многоугольника. Не используется вместе с PERIODIC.
+  /// @param sites Список точек, точки должны лежать в многоугольнике.
+  /// @param boundary Вершины выпуклого многоугольника в любом направлении обхода.
+  /// @param flags Флаги построения Flags.
+  BasicVoronoi(const std::vector<Point> &sites, const std::vector<Point> &boundary, unsigned int flags = 0);
 
   /// Конструктор копирования.
   /// Копируются размер рабочей области, списки точек, вершин и граней.
-  Voronoi(const Voronoi &voronoi);
+  BasicVoronoi(const BasicVoronoi &voronoi);
 
   /// Оператор копирования.
-  Voronoi &operator=(const Voronoi &voronoi);
+  BasicVoronoi &operator=(const BasicVoronoi &voronoi);
 
   /// Конструктор перемещения.
   /// Перемещается размер рабочей области, списки точек, вершин и граней.
-  Voronoi(Voronoi &&voronoi);
+  BasicVoronoi(BasicVoronoi &&voronoi);
 
   /// Оператор перемещения.
-  Voronoi &operator=(Voronoi &&voronoi);
+  BasicVoronoi &operator=(BasicVoronoi &&voronoi);
 
-  ~Voronoi();
+  ~BasicVoronoi();
 
   /// Построить диаграмму вороного.
-  Voronoi &operator()();
+  /// Незавершенное пошаговое построение отменяется.
+  BasicVoronoi &operator()();
+
+  /// Начать пошаговое построение: отсортировать события точек и вставить
+  /// верхние точки. Дальше диаграмма строится вызовами Step.
+  /// Между шагами GetEdges и GetVertex содержат уже готовые грани,
+  /// оба конца которых лежат в области. Номера точек в них - номера в GetSites,
+  /// с RESTORE_SITE_ORDER точки возвращаются в исходный порядок на последнем шаге.
+  /// С PERIODIC диаграмма строится целиком в Start.
+  void Start();
+
+  /// Обработать не больше maxEvents событий.
+  /// Последний шаг дополнительно обрезает оставшиеся грани областью.
+  /// @return true, если построение завершено.
+  bool Step(size_t maxEvents);
+
+  /// Обрабатывать события, пока не пройдет время budget.
+  /// Время проверяется через каждые STEP_CLOCK_PERIOD событий.
+  /// @return true, если построение завершено.
+  bool StepFor(std::chrono::steady_clock::duration budget);
+
+  /// Отменить незавершенное пошаговое построение.
+  /// Служебные структуры освобождаются, списки вершин и граней очищаются.
+  void Cancel();
+
+  /// Вернуть ход последнего построения.
+  const Progress &GetProgress() const;
+
+  /// Построить диаграмму с возможностью отмены.
+  /// Отмена проверяется через каждые CANCEL_CHECK_PERIOD событий, после
+  /// проверки вызывается progress. С PERIODIC отмена проверяется только
+  /// перед построением.
+  /// @return false, если построение отменено. Списки вершин и граней тогда пусты.
+  bool Build(const CancelToken &cancel, const ProgressCallback &progress = ProgressCallback());
+
+  /// Построить диаграмму в пуле потоков, аналогично Build.
+  /// До готовности результата с диаграммой нельзя работать, progress
+  /// вызывается в потоке пула. Задача, отмененная до запуска,
+  /// не строит диаграмму.
+  std::future<bool> BuildAsync(ThreadPool &pool, const CancelToken &cancel = CancelToken(),
+                               const ProgressCallback &progress = ProgressCallback());
+
+  /// Построить диаграмму в общем пуле ThreadPool::Default.
+  std::future<bool> BuildAsync(const CancelToken &cancel = CancelToken(),
+                               const ProgressCallback &progress = ProgressCallback());
 
   /// Очистить диаграмму вороного.
-  /// Освобождаются списки вершин и граней.
+  /// Освобождаются списки вершин и граней, с REUSE_MEMORY они только очищаются.
   /// Список точек не освобождается.
   void Clear();
 
+  /// Заменить точки и размер прямоугольной области, сохранив флаги.
+  /// Диаграмма очищается. Вместе с REUSE_MEMORY объект строит
+  /// последовательность диаграмм без повторного выделения памяти.
+  void Assign(const std::vector<Point> &sites, const Point &size);
+
   /// Вернуть список точек.
-  const std::vector<glm::vec2> &GetSites() const;
+  const std::vector<Point> &GetSites() const;
+
+  /// Вернуть исходные номера точек после построения с REORDER_SITES.
+  /// Точка GetSites()[i] имеет номер GetSiteOrder()[i] в списке, переданном в конструктор.
+  /// Пустой список, если точки не переставлялись.
+  const std::vector<unsigned int> &GetSiteOrder() const;
+
+  /// Вернуть исходные точки копий после построения с PERIODIC.
+  /// Точка GetSites()[n + i] - копия точки GetPeriodicSource()[i],
+  /// где n - число точек, переданных в конструктор.
+  const std::vector<unsigned int> &GetPeriodicSource() const;
 
   /// Вернуть список граней.
   const std::vector<Edge> &GetEdges() const;
 
   /// Вернуть список вершин.
-  const std::vector<glm::vec2> &GetVertex() const;
+  const std::vector<Point> &GetVertex() const;
+
+  /// Вернуть ограничивающую область диаграммы.
+  const geometry::Rect &GetRect() const;
+
+  /// Вернуть вершины многоугольника области против часовой стрелки.
+  /// Пустой список, если область - прямоугольник.
+  const std::vector<geometry::Point> &GetBoundary() const;
+
+  /// Вернуть флаги построения.
+  unsigned int GetFlags() const;
+
+  /// Вернуть статистику памяти последнего построения.
+  const MemoryStats &GetMemoryStats() const;
+
+  /// Сохранить диаграмму в бинарный файл (формат описан в storage.h).
+  /// Форматы файлов хранят координаты во float, поэтому функции сохранения
+  /// и загрузки определены только для BasicVoronoi<float>.
+  /// @param topology Записать списки граней для каждой точки.
+  bool Save(const std::string &fileName, bool topology = false) const;
+
+  /// Загрузить диаграмму из бинарного файла.
+  /// Точки, вершины, грани и таблицы GetSiteOrder и GetPeriodicSource
+  /// копируются в диаграмму.
+  /// Для доступа без копирования используется MappedDiagram.
+  bool Load(const std::string &fileName);
+
+  /// Скопировать диаграмму из отображенного файла.
+  bool Load(const MappedDiagram &diagram);
+
+  /// Сохранить диаграмму в компактный архив (формат описан в archive.h).
+  /// @param grid Шаг сетки квантования вершин.
+  bool SaveArchive(const std::string &fileName, float grid,
+                   compression::Level level = compression::DEFAULT) const;
+
+  /// Загрузить диаграмму из архива.
+  /// Порядок граней и вершин может отличаться от сохраненного.
+  bool LoadArchive(const std::string &fileName);
 
 private:
   typedef unsigned int SiteIndex;
@@ -86,57 +310,28 @@ private:
   typedef int EdgeIndex;
   typedef int VertexIndex;
 
-  /// Интерфейс элемента.
-  /// Элемент может быть аркой, точкой пересечения арок, либо точкой пересечения граней.
-  struct IElement
-  {
-    enum ElementType
-    {
-      ARC,
-      BREAK_POINT,
-      END_POINT,
-    };
-
-    IElement(ElementType t)
-      : type(t)
-    {}
+  /// Номер точки - брекпоинта или точки пересечения граней.
+  /// Точки хранятся в двух таблицах, тип точки задает старший бит номера:
+  /// если он установлен, остальные биты - номер в mEndPoints, иначе - в mBreakPoints.
+  static const PointIndex END_POINT_TAG = 1u << 31;
 
-    const ElementType type;
-  };
+  /// Нет точки. У удаленной грани первый конец равен NO_POINT,
+  /// у листа дерева (арки) нет брекпоинта.
+  static const PointIndex NO_POINT = ~0u;
 
-  struct CircleEvent;
-  /// Арка. Содержит указатель на входную точку.
-  /// Так же содержит указатель на событие круга для этой арки, если такое существует.
-  struct ArcElement : public IElement
-  {
-    const SiteIndex site;
-    CircleEvent *event;
-    ArcElement(const SiteIndex s)
-      : IElement(ARC), site(s)
-    {
-      event = nullptr;
-    }
-  };
+  /// Брекпоинт удален.
+  static const EdgeIndex DELETED_BREAK_POINT = -2;
 
-  struct EdgeElement;
   /// Точка пересечения арок.
-  /// Содержит индекс на себя в списке и
-  /// указатель на грань, один из концов которой является данные брекпоинт.
-  struct BPElement : public IElement
+  /// Содержит грань, один из концов которой является данный брекпоинт,
+  /// и точки арок слева и справа. Пара арок брекпоинта не меняется:
+  /// при удалении арки соседние брекпоинты заменяются новым.
+  struct BreakPoint
   {
-    const PointIndex pos;
-#ifdef VORONOI_DEBUG_INFO
-    const unsigned int id;
-#endif
+    SiteIndex left;
+    SiteIndex right;
+    /// Грань брекпоинта, -1 - нет грани, DELETED_BREAK_POINT - брекпоинт удален.
     EdgeIndex edge;
-    BPElement(PointIndex p)
-      : IElement(BREAK_POINT), pos(p)
-#ifdef VORONOI_DEBUG_INFO
-      , id(Val<BREAK_POINT>::Get())
-#endif
-    {
-      edge = -1;
-    }
   };
 
   /// Точка пересечения граней.
@@ -145,24 +340,13 @@ private:
   /// Так же содержит счетчик ссылок. Изначально вершина содержится в 3-х гранях.
   /// По мере обработки граней, счетчик ссылок должен уменьшаться.
   /// Если вершина больше не содержится ни в одной грани, она удаляется.
-  struct EPElement : public IElement
+  struct EndPoint
   {
-    const VertexIndex pos;
-    const SiteIndex site1;
-    const SiteIndex site2;
-    const SiteIndex site3;
+    VertexIndex pos;
+    SiteIndex site1;
+    SiteIndex site2;
+    SiteIndex site3;
     unsigned int refCount;
-#ifdef VORONOI_DEBUG_INFO
-    const int id;
-#endif
-    EPElement(const VertexIndex p, const SiteIndex s1, const SiteIndex s2, const SiteIndex s3)
-      : IElement(END_POINT), pos(p), site1(s1), site2(s2), site3(s3)
-#ifdef VORONOI_DEBUG_INFO
-      , id(Val<END_POINT>::Get())
-#endif
-    {
-      refCount = 3;
-    }
   };
 
   /// Грань.
@@ -172,26 +356,34 @@ private:
   {
     PointIndex el1;
     PointIndex el2;
-    const SiteIndex site1;
-    const SiteIndex site2;
+    SiteIndex site1;
+    SiteIndex site2;
     EdgeElement(PointIndex e1, PointIndex e2, const SiteIndex s1, const SiteIndex s2)
       : el1(e1), el2(e2), site1(s1), site2(s2)
     {}
   };
 
+  struct CircleEvent;
+
   /// Элемент дерева.
+  /// Лист дерева - арка: содержит точку арки и событие круга для этой арки,
+  /// если такое существует. Узел дерева - брекпоинт: содержит номер брекпоинта.
   struct BtreeElement
   {
     BtreeElement *parent;
     BtreeElement *left;
     BtreeElement *right;
-    IElement *element;
-    BtreeElement(IElement *el)
+    PointIndex bp;
+    SiteIndex site;
+    CircleEvent *event;
+    BtreeElement(PointIndex b, SiteIndex s)
     {
       parent = nullptr;
       left = nullptr;
       right = nullptr;
-      element = el;
+      bp = b;
+      site = s;
+      event = nullptr;
     }
   };
 
@@ -199,9 +391,9 @@ private:
   /// к которой относится данное событие.
   struct CircleEvent
   {
-    const float posy;
+    const T posy;
     BtreeElement *arc;
-    CircleEvent(float p, BtreeElement *a)
+    CircleEvent(T p, BtreeElement *a)
       : posy(p), arc(a)
     {
     }
@@ -209,14 +401,33 @@ private:
 
 private:
   /// Список исходных точек.
-  std::vector<glm::vec2> mListSite;
+  std::vector<Point> mListSite;
 
   /// Ограничивающая область диаграммы.
   geometry::Rect mRect;
 
+  /// Ограничивающая область в типе построения.
+  geometry::BasicRect<T> mBounds;
+
+  /// Выпуклый многоугольник области против часовой стрелки.
+  /// Пустой, если область - mRect.
+  std::vector<geometry::Point> mBoundary;
+
+  /// Флаги построения.
+  unsigned int mFlags;
+
+  /// Исходные номера точек, если точки переставлены (REORDER_SITES).
+  std::vector<unsigned int> mSiteOrder;
+
+  /// Исходные точки копий (PERIODIC).
+  std::vector<unsigned int> mPeriodicSource;
+
+  /// Начальная ширина полосы копий при PERIODIC в средних расстояниях между точками.
+  static const unsigned int PERIODIC_BAND = 5;
+
   // Уровень заметающей прямой.
   // Прямая опускается сверху вниз.
-  float mSweepLine;
+  T mSweepLine;
 
   // Голова дерева.
   BtreeElement *mHead;
@@ -228,6 +439,42 @@ private:
   /// Номер текущего события в списке событий точек.
   unsigned int mSiteEventsIndex;
 
+  /// Арка последней вставки, с нее начинается поиск при FINGER_SEARCH.
+  BtreeElement *mFinger;
+
+  /// Средняя стоимость поиска от mFinger и от корня (число вычисленных брекпоинтов).
+  float mFingerCost;
+  float mRootCost;
+
+  /// Число поисков с начала построения.
+  unsigned int mSearchCount;
+
+  /// Каждый SEARCH_SAMPLE_PERIOD-й поиск выполняется другим способом,
+  /// чтобы обновить его оценку.
+  static const unsigned int SEARCH_SAMPLE_PERIOD = 16;
+
+  /// Число поисков, по которому усредняется стоимость.
+  static const unsigned int SEARCH_COST_WINDOW = 8;
+
+  /// Грань после обрезки областью.
+  struct ClippedEdge
+  {
+    EdgeIndex edge;
+    SiteIndex site1;
+    SiteIndex site2;
+    /// Существующие вершины концов или -1, если вершину нужно добавить.
+    VertexIndex v1;
+    VertexIndex v2;
+    Point a;
+    Point b;
+    /// Грань пересекает область.
+    bool valid;
+  };
+
+  /// Число элементов списка граней в одном куске обрезки.
+  /// Куски не зависят от числа потоков, поэтому порядок результата тоже.
+  static const size_t POST_PROCESS_GRAIN = 1 << 14;
+
   struct CircleEventComparator
   {
     bool operator()(CircleEvent *e1, CircleEvent *e2) const
@@ -236,18 +483,124 @@ private:
     }
   };
 
+  /// Распределитель узлов списка событий круга.
+  /// Освобожденные узлы попадают в список свободных узлов объекта
+  /// и выдаются снова, не обращаясь к общему распределителю памяти.
+  template<class U>
+  struct NodeAllocator
+  {
+    typedef U value_type;
+
+    std::vector<void *> *free;
+
+    explicit NodeAllocator(std::vector<void *> *f)
+      : free(f)
+    {}
+    template<class V>
+    NodeAllocator(const NodeAllocator<V> &allocator)
+      : free(allocator.free)
+    {}
+
+    U *allocate(size_t n)
+    {
+      if(n == 1 && !free->empty())
+      {
+        void *node = free->back();
+        free->pop_back();
+        return static_cast<U *>(node);
+      }
+      return static_cast<U *>(::operator new(n * sizeof(U)));
+    }
+
+    void deallocate(U *node, size_t n)
+    {
+      if(n == 1)
+      {
+        free->push_back(node);
+        return;
+      }
+      ::operator delete(node);
+    }
+
+    template<class V>
+    bool operator==(const NodeAllocator<V> &allocator) const
+    {
+      return free == allocator.free;
+    }
+    template<class V>
+    bool operator!=(const NodeAllocator<V> &allocator) const
+    {
+      return free != allocator.free;
+    }
+  };
+
+  typedef std::multiset<CircleEvent *, CircleEventComparator, NodeAllocator<CircleEvent *> > CircleEventSet;
+
+  /// Свободные элементы дерева, события круга и узлы списка событий круга.
+  /// Переиспользуются во время построения, с REUSE_MEMORY - и между построениями.
+  std::vector<BtreeElement *> mFreeElements;
+  std::vector<CircleEvent *> mFreeEvents;
+  std::vector<void *> mFreeEventNodes;
+
   /// Упорядоченный список событий кгура.
   /// Ключ - высота события, значение - номер арки, к которому относится событие.
-  std::multiset<CircleEvent *, CircleEventComparator> mCircleEvents;
+  CircleEventSet mCircleEvents;
 
-  /// Список граней.
-  std::vector<EdgeElement *> mListEdgeElement;
+  /// Список граней. Удаленные грани остаются в списке с el1 == NO_POINT.
+  std::vector<EdgeElement> mListEdgeElement;
+
+  /// Таблица брекпоинтов.
+  std::vector<BreakPoint> mBreakPoints;
+
+  /// Таблица точек пересечения граней.
+  std::vector<EndPoint> mEndPoints;
+
+  /// Число существующих граней, брекпоинтов и точек пересечения граней.
+  size_t mEdgeElementCount;
+  size_t mBreakPointCount;
+  size_t mEndPointCount;
 
-  /// Список брекпоинтов и точек пересечения граней.
-  std::vector<IElement *> mListPoints;
+  /// Число арок в дереве.
+  size_t mArcCount;
+
+  /// Первые свободные места таблиц при LOW_MEMORY. Свободное место хранит
+  /// номер следующего: брекпоинт в left, точка пересечения граней в site1, грань в el2.
+  PointIndex mFreeBreakPoint;
+  PointIndex mFreeEndPoint;
+  EdgeIndex mFreeEdgeElement;
+
+  /// Статистика памяти.
+  MemoryStats mMemoryStats;
+
+  /// Идет пошаговое построение: события обработаны не все.
+  bool mStepping;
+
+  /// Число обработанных событий с начала построения.
+  size_t mEventCount;
+
+  /// Ход построения.
+  Progress mProgress;
+
+  /// Через сколько событий StepFor проверяет время.
+  static const unsigned int STEP_CLOCK_PERIOD = 256;
+
+  /// Через сколько событий Build проверяет отмену.
+  static const unsigned int CANCEL_CHECK_PERIOD = 4096;
+
+  /// Через сколько событий измеряется объем памяти.
+  static const unsigned int MEMORY_SAMPLE_PERIOD = 1024;
+
+  /// Резерв служебных таблиц при LOW_MEMORY в корнях из числа точек.
+  /// Наибольшее число одновременно существующих элементов на равномерных точках
+  /// (10^4 - 10^6): 1.8 - 2.3 sqrt(n) брекпоинтов, до 7 sqrt(n) точек пересечения
+  /// граней и 7.2 sqrt(n) граней. Большая часть - грани у границы области,
+  /// ожидающие обрезки.
+  static const unsigned int LOW_MEMORY_BREAK_POINTS = 3;
+  static const unsigned int LOW_MEMORY_END_POINTS = 8;
+  static const unsigned int LOW_MEMORY_EDGES = 8;
 
   /// Список вершин полигонов.
-  std::vector<glm::vec2> mListVertex;
+  std::vector<Point> mListVertex;
 
   /// Список граней.
   std::vector<Edge> mListEdge;
@@ -255,8 +608,36 @@ private:
 
 private:
 
-  /// Основной цикл алгоритма.
-  void Process();
+  /// Построить диаграмму по текущему списку точек в области mRect.
+  void BuildDiagram();
+
+  /// Подготовить события точек и вставить верхние точки.
+  void BeginDiagram();
+
+  /// Обработать не больше maxEvents событий.
+  /// @return true, если события закончились.
+  bool ProcessEvents(size_t maxEvents);
+
+  /// Обрезать оставшиеся грани и освободить служебные структуры.
+  void EndDiagram();
+
+  /// Построить периодическую диаграмму (PERIODIC).
+  void BuildPeriodic();
+
+  /// Ячейки первых count точек не зависят от точек вне области:
+  /// у каждой есть грани, и круг с центром в любой вершине ячейки,
+  /// проходящий через точку, лежит в области.
+  bool IsPeriodicComplete(size_t count) const;
+
+  /// Оставить грани ячеек первых count точек и копии их соседей.
+  void FinishPeriodic(size_t count);
+
+  /// Переставить точки в порядке событий точек.
+  /// После перестановки события точек идут по порядку.
+  void ReorderSites();
+
+  /// Вернуть точки в исходный порядок и перенумеровать точки в гранях.
+  void RestoreSiteOrder();
 
   /// Добавить самую первую точку.
   /// @param site Индекс точки. Для данной точки будет создана новая арка.
@@ -279,11 +660,21 @@ private:
   void CheckCircleEvent(BtreeElement *leftArc, BtreeElement *arc, BtreeElement *rightArc);
 
   /// Добавить новое событие круга.
-  void NewCircleEvent(BtreeElement *arc, float posy);
+  void NewCircleEvent(BtreeElement *arc, T posy);
 
   /// Удалить событие круга.
   void RemoveCircleEvent(CircleEvent *event);
 
+  /// Создать и удалить элемент дерева и событие круга.
+  /// Удаленные элементы переиспользуются.
+  BtreeElement *AllocElement(PointIndex bp, SiteIndex site);
+  void FreeElement(BtreeElement *element);
+  CircleEvent *AllocEvent(T posy, BtreeElement *arc);
+  void FreeEvent(CircleEvent *event);
+
+  /// Освободить свободные элементы.
+  void ReleaseFreeLists();
+
   /// Найти арку и брекпоинт слева от текущей
   std::pair<BtreeElement *, BtreeElement *> LeftArcBP(BtreeElement *element);
 
@@ -291,7 +682,9 @@ private:
   std::pair<BtreeElement *, BtreeElement *> RightArcBP(BtreeElement *element);
 
   /// Создать брекпоинт.
-  PointIndex NewBPElement();
+  /// @param left Точка арки слева от брекпоинта.
+  /// @param right Точка арки справа от брекпоинта.
+  PointIndex NewBPElement(const SiteIndex left, const SiteIndex right);
 
   /// Удалить брекпоинт.
   void DeleteBPElement(PointIndex el);
@@ -306,7 +699,27 @@ private:
 
   void DeleteEPElement(PointIndex p);
 
-  VertexIndex NewVertex(const glm::vec2 &point);
+  /// Является ли точка точкой пересечения граней.
+  static bool IsEndPoint(PointIndex p);
+
+  /// Брекпоинт по номеру точки.
+  BreakPoint &GetBreakPoint(PointIndex p);
+  const BreakPoint &GetBreakPoint(PointIndex p) const;
+
+  /// Точка пересечения граней по номеру точки.
+  EndPoint &GetEndPoint(PointIndex p);
+  const EndPoint &GetEndPoint(PointIndex p) const;
+
+  /// Удалить конец грани любого типа.
+  void DeletePoint(PointIndex p);
+
+  /// Текущий объем памяти, занятой диаграммой, в байтах.
+  size_t MemoryFootprint() const;
+
+  /// Обновить наибольший объем памяти.
+  void SampleMemory();
+
+  VertexIndex NewVertex(const Point &point);
 
   /// Добавить новую грань.
   void NewEdge(PointIndex el1, PointIndex el2, const SiteIndex site1, const SiteIndex site2);
@@ -318,8 +731,28 @@ private:
   void DeleteEdge(EdgeIndex el);
 
   /// Обработать оставшиеся грани.
+  /// Первый проход обрезает грани по кускам списка граней, возможно в нескольких потоках.
+  /// Затем префиксная сумма по кускам назначает места новым вершинам и граням,
+  /// второй проход записывает их без синхронизации.
   void PostProcess();
 
+  /// Обрезать оставшуюся грань областью. Не изменяет диаграмму.
+  void ClipEdge(EdgeIndex i, ClippedEdge &out) const;
+
+  /// Вершина грани, которая может лежать на границе многоугольника области.
+  struct BorderVertex
+  {
+    VertexIndex vertex;
+    SiteIndex site1;
+    SiteIndex site2;
+  };
+
+  /// Замкнуть ячейки у границы многоугольника области.
+  /// Вершины, лежащие на границе, упорядочиваются вдоль нее. Участок границы
+  /// между соседними вершинами принадлежит ближайшей к его середине точке
+  /// из граней этих вершин и добавляется гранями через углы многоугольника.
+  void CloseBoundary(const std::vector<BorderVertex> &border);
+
 private:
   // Отладочные функции.
   bool IsList(BtreeElement *btreeElement);
@@ -357,14 +790,35 @@ private:
   BtreeElement *RightArc(BtreeElement *element);
 
   /// Найти арку, в которую попадает текущая координата по x.
-  BtreeElement *FindArc(float x);
-  BtreeElement *FindArc(BtreeElement *bp, float x);
+  /// С FINGER_SEARCH выбирает поиск от последней арки или от корня.
+  BtreeElement *LocateArc(T x);
+
+  /// Найти арку спуском от заданного узла.
+  /// @param count Увеличивается на число вычисленных брекпоинтов.
+  BtreeElement *FindArc(BtreeElement *node, T x, unsigned int &count);
+
+  /// Найти арку, поднимаясь от арки finger только до поддерева, содержащего x.
+  /// @param count Увеличивается на число вычисленных брекпоинтов.
+  BtreeElement *FindArcFrom(BtreeElement *finger, T x, unsigned int &count);
+
+  /// Координата x брекпоинта на текущем уровне заметающей прямой.
+  T BreakPointX(const BtreeElement *node) const;
 
   /// Удалить дерево.
   void RemoveTree();
   void RemoveTree(BtreeElement *node);
 };
 
+template<> bool BasicVoronoi<float>::Save(const std::string &fileName, bool topology) const;
+template<> bool BasicVoronoi<float>::Load(const std::string &fileName);
+template<> bool BasicVoronoi<float>::Load(const MappedDiagram &diagram);
+template<> bool BasicVoronoi<float>::SaveArchive(const std::string &fileName, float grid,
+                                                 compression::Level level) const;
+template<> bool BasicVoronoi<float>::LoadArchive(const std::string &fileName);
+
+typedef BasicVoronoi<float> Voronoi;
+typedef BasicVoronoi<double> DVoronoi;
+
 #endif // VORONOI_H
 
 
@@ -0,0 +1,715 @@
+#include "archive.h"
+#include "parallel.h"
+#include "storage.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace
+{
+  /// Количество точек в блоке.
+  const unsigned int BLOCK_SITES = 1 << 15;
+
+  /// Потоки varint блока.
+  enum Stream
+  {
+    STREAM_ORDER,   ///< Разности исходных индексов точек.
+    STREAM_SITES,   ///< Разности координат точек.
+    STREAM_COUNTS,  ///< Количество граней каждой точки.
+    STREAM_OTHERS,  ///< Разность номеров точек грани.
+    STREAM_REFS,    ///< Ссылки на вершины, 0 - новая вершина.
+    STREAM_COORDS,  ///< Квантованные координаты новых вершин относительно грани.
+    STREAM_COUNT,
+  };
+
+  /// Описание блока в таблице блоков.
+  /// Точки блока - номера точек в порядке кодирования.
+  struct Block
+  {
+    uint64_t firstSite;
+    uint64_t siteCount;
+    uint64_t firstEdge;
+    uint64_t edgeCount;
+    uint64_t firstVertex;
+    uint64_t vertexCount;
+    uint64_t rawSize;
+    uint64_t dataSize;
+  };
+
+  const size_t HEADER_SIZE = 4 + 4 + 4 + 8 + 4 * 8 + 3 * 8 + 4;
+  const size_t BLOCK_SIZE = 8 * 8;
+
+  void PutU32(std::vector<unsigned char> &out, uint32_t value)
+  {
+    for(unsigned int i = 0; i < 4; ++i)
+    {
+      out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+  }
+
+  void PutU64(std::vector<unsigned char> &out, uint64_t value)
+  {
+    for(unsigned int i = 0; i < 8; ++i)
+    {
+      out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+  }
+
+  void PutF64(std::vector<unsigned char> &out, double value)
+  {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutU64(out, bits);
+  }
+
+  uint32_t GetU32(const unsigned char *&p)
+  {
+    uint32_t value = 0;
+    for(unsigned int i = 0; i < 4; ++i)
+    {
+      value |= static_cast<uint32_t>(*p++) << (i * 8);
+    }
+    return value;
+  }
+
+  uint64_t GetU64(const unsigned char *&p)
+  {
+    uint64_t value = 0;
+    for(unsigned int i = 0; i < 8; ++i)
+    {
+      value |= static_cast<uint64_t>(*p++) << (i * 8);
+    }
+    return value;
+  }
+
+  double GetF64(const unsigned char *&p)
+  {
+    const uint64_t bits = GetU64(p);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  void PutVarint(std::vector<unsigned char> &out, uint64_t value)
+  {
+    while(value >= 0x80)
+    {
+      out.push_back(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+  }
+
+  bool GetVarint(const unsigned char *&p, const unsigned char *end, uint64_t &value)
+  {
+    value = 0;
+    for(unsigned int shift = 0; shift < 64 && p != end; shift += 7)
+    {
+      const unsigned char byte = *p++;
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if(!(byte & 0x80))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t ZigZag(int64_t value)
+  {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+  }
+
+  int64_t UnZigZag(uint64_t value)
+  {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+  /// Представить float целым, монотонным относительно значения.
+  /// Близкие значения дают близкие целые, что дает короткие разности.
+  int32_t FloatToOrdered(float value)
+  {
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? bits ^ 0x7FFFFFFF : bits;
+  }
+
+  float OrderedToFloat(int32_t bits)
+  {
+    bits = bits < 0 ? bits ^ 0x7FFFFFFF : bits;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /// Разредить 16 бит для чередования в коде Мортона.
+  uint32_t Spread(uint32_t value)
+  {
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+  }
+
+  uint32_t Quantize16(double value, double from, double to)
+  {
+    const double t = to > from ? (value - from) / (to - from) : 0.0;
+    return t > 0.0 ? static_cast<uint32_t>(std::min(t, 1.0) * 65535.0) : 0;
+  }
+
+  /// Система координат грани: середина отрезка между точками грани,
+  /// направление вдоль серединного перпендикуляра и нормаль к нему.
+  /// Вершины грани лежат на перпендикуляре, поэтому координата вдоль
+  /// нормали почти всегда квантуется в 0.
+  struct EdgeFrame
+  {
+    double mx, my;
+    double dx, dy;
+
+    EdgeFrame(const glm::vec2 &a, const glm::vec2 &b)
+    {
+      mx = (static_cast<double>(a.x) + b.x) * 0.5;
+      my = (static_cast<double>(a.y) + b.y) * 0.5;
+      const double nx = static_cast<double>(b.x) - a.x;
+      const double ny = static_cast<double>(b.y) - a.y;
+      const double length = sqrt(nx * nx + ny * ny);
+      dx = length > 0.0 ? -ny / length : 1.0;
+      dy = length > 0.0 ? nx / length : 0.0;
+    }
+
+    void ToLocal(const glm::vec2 &point, double grid, int64_t &t, int64_t &r) const
+    {
+      const double rx = point.x - mx;
+      const double ry = point.y - my;
+      t = llround((rx * dx + ry * dy) / grid);
+      r = llround((rx * dy - ry * dx) / grid);
+    }
+
+    glm::vec2 ToGlobal(int64_t t, int64_t r, double grid) const
+    {
+      const double lt = t * grid;
+      const double lr = r * grid;
+      return glm::vec2(static_cast<float>(mx + lt * dx + lr * dy), static_cast<float>(my + lt * dy - lr * dx));
+    }
+  };
+
+  /// Диаграмма в порядке кодирования.
+  /// Точки упорядочены по коду Мортона, поэтому у соседних по номеру точек
+  /// близки координаты и номера соседей. Грани сгруппированы по меньшему номеру
+  /// точки, вершины перенумерованы в порядке первого появления в гранях.
+  struct Layout
+  {
+    /// Исходные индексы точек в порядке кодирования.
+    std::vector<unsigned int> order;
+    /// Грани с site1 <= site2 в номерах порядка кодирования и вершинами в новой нумерации.
+    std::vector<Voronoi::Edge> edges;
+    /// Начало граней точки в edges, sites + 1 элементов.
+    std::vector<unsigned int> offsets;
+    /// Исходные индексы вершин в новом порядке.
+    std::vector<unsigned int> vertex;
+  };
+
+  void BuildLayout(const geometry::Rect &rect, const std::vector<glm::vec2> &sites, size_t vertexCount,
+                   const std::vector<Voronoi::Edge> &edges, Layout &layout)
+  {
+    const size_t siteCount = sites.size();
+    std::vector<uint64_t> keys(siteCount);
+    for(size_t i = 0; i < siteCount; ++i)
+    {
+      const uint32_t x = Quantize16(sites[i].x, rect.lb.x, rect.rt.x);
+      const uint32_t y = Quantize16(sites[i].y, rect.lb.y, rect.rt.y);
+      keys[i] = (static_cast<uint64_t>(Spread(x) | (Spread(y) << 1)) << 32) | i;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    layout.order.resize(siteCount);
+    std::vector<unsigned int> rank(siteCount);
+    for(size_t i = 0; i < siteCount; ++i)
+    {
+      layout.order[i] = static_cast<unsigned int>(keys[i]);
+      rank[layout.order[i]] = static_cast<unsigned int>(i);
+    }
+
+    layout.offsets.assign(siteCount + 1, 0);
+    for(auto it = edges.begin(); it != edges.end(); ++it)
+    {
+      ++layout.offsets[std::min(rank[(*it).site1], rank[(*it).site2]) + 1];
+    }
+    for(size_t i = 1; i < layout.offsets.size(); ++i)
+    {
+      layout.offsets[i] += layout.offsets[i - 1];
+    }
+
+    layout.edges.assign(edges.size(), Voronoi::Edge(0, 0, 0, 0));
+    std::vector<unsigned int> fill(layout.offsets.begin(), layout.offsets.end() - 1);
+    for(auto it = edges.begin(); it != edges.end(); ++it)
+    {
+      const unsigned int s1 = rank[(*it).site1];
+      const unsigned int s2 = rank[(*it).site2];
+      layout.edges[fill[std::min(s1, s2)]++] = s1 <= s2 ?
+        Voronoi::Edge(s1, s2, (*it).vertex1, (*it).vertex2) :
+        Voronoi::Edge(s2, s1, (*it).vertex2, (*it).vertex1);
+    }
+
+    const unsigned int NONE = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> index(vertexCount, NONE);
+    layout.vertex.clear();
+    layout.vertex.reserve(vertexCount);
+    for(auto it = layout.edges.begin(); it != layout.edges.end(); ++it)
+    {
+      unsigned int *refs[2] = {&(*it).vertex1, &(*it).vertex2};
+      for(unsigned int i = 0; i < 2; ++i)
+      {
+        unsigned int &id = index[*refs[i]];
+        if(id == NONE)
+        {
+          id = static_cast<unsigned int>(layout.vertex.size());
+          layout.vertex.push_back(*refs[i]);
+        }
+        *refs[i] = id;
+      }
+    }
+  }
+
+  /// Закодировать блок в потоки varint.
+  void EncodeBlock(const Block &block, const std::vector<glm::vec2> &sites, const std::vector<glm::vec2> &vertex,
+                   const Layout &layout, double grid, std::vector<unsigned char> &raw)
+  {
+    std::vector<unsigned char> streams[STREAM_COUNT];
+    const uint64_t siteEnd = block.firstSite + block.siteCount;
+
+    int64_t index = 0;
+    int64_t x = 0;
+    int64_t y = 0;
+    for(uint64_t i = block.firstSite; i < siteEnd; ++i)
+    {
+      const unsigned int site = layout.order[i];
+      const int64_t sx = FloatToOrdered(sites[site].x);
+      const int64_t sy = FloatToOrdered(sites[site].y);
+      PutVarint(streams[STREAM_ORDER], ZigZag(site - index));
+      PutVarint(streams[STREAM_SITES], ZigZag(sx - x));
+      PutVarint(streams[STREAM_SITES], ZigZag(sy - y));
+      index = site;
+      x = sx;
+      y = sy;
+      PutVarint(streams[STREAM_COUNTS], layout.offsets[i + 1] - layout.offsets[i]);
+    }
+
+    uint64_t next = block.firstVertex;
+    for(uint64_t i = block.firstEdge; i < block.firstEdge + block.edgeCount; ++i)
+    {
+      const Voronoi::Edge &edge = layout.edges[i];
+      PutVarint(streams[STREAM_OTHERS], edge.site2 - edge.site1);
+      const unsigned int refs[2] = {edge.vertex1, edge.vertex2};
+      for(unsigned int j = 0; j < 2; ++j)
+      {
+        if(refs[j] != next)
+        {
+          assert(refs[j] < next);
+          PutVarint(streams[STREAM_REFS], next - refs[j]);
+          continue;
+        }
+        PutVarint(streams[STREAM_REFS], 0);
+        ++next;
+
+        int64_t t, r;
+        EdgeFrame(sites[layout.order[edge.site1]], sites[layout.order[edge.site2]])
+          .ToLocal(vertex[layout.vertex[refs[j]]], grid, t, r);
+        PutVarint(streams[STREAM_COORDS], ZigZag(t));
+        PutVarint(streams[STREAM_COORDS], ZigZag(r));
+      }
+    }
+    assert(next == block.firstVertex + block.vertexCount);
+
+    raw.clear();
+    for(unsigned int i = 0; i < STREAM_COUNT; ++i)
+    {
+      PutVarint(raw, streams[i].size());
+    }
+    for(unsigned int i = 0; i < STREAM_COUNT; ++i)
+    {
+      raw.insert(raw.end(), streams[i].begin(), streams[i].end());
+    }
+  }
+
+  /// Распакованный блок при чтении.
+  struct BlockData
+  {
+    std::vector<unsigned char> raw;
+    const unsigned char *begins[STREAM_COUNT];
+    const unsigned char *ends[STREAM_COUNT];
+  };
+
+  /// Разобрать таблицу потоков блока.
+  bool ParseStreams(const unsigned char *data, size_t size, BlockData &block)
+  {
+    const unsigned char *p = data;
+    const unsigned char *end = data + size;
+    uint64_t lengths[STREAM_COUNT];
+    for(unsigned int i = 0; i < STREAM_COUNT; ++i)
+    {
+      if(!GetVarint(p, end, lengths[i]))
+      {
+        return false;
+      }
+    }
+    for(unsigned int i = 0; i < STREAM_COUNT; ++i)
+    {
+      if(lengths[i] > static_cast<uint64_t>(end - p))
+      {
+        return false;
+      }
+      block.begins[i] = p;
+      p += lengths[i];
+      block.ends[i] = p;
+    }
+    return true;
+  }
+
+  /// Раскодировать точки блока.
+  /// @param order Исходные индексы точек в порядке кодирования.
+  bool DecodeSites(const Block &block, BlockData &data, std::vector<unsigned int> &order,
+                   std::vector<glm::vec2> &sites)
+  {
+    int64_t index = 0;
+    int64_t x = 0;
+    int64_t y = 0;
+    for(uint64_t i = block.firstSite; i < block.firstSite + block.siteCount; ++i)
+    {
+      uint64_t di, dx, dy;
+      if(!GetVarint(data.begins[STREAM_ORDER], data.ends[STREAM_ORDER], di) ||
+         !GetVarint(data.begins[STREAM_SITES], data.ends[STREAM_SITES], dx) ||
+         !GetVarint(data.begins[STREAM_SITES], data.ends[STREAM_SITES], dy))
+      {
+        return false;
+      }
+      index += UnZigZag(di);
+      x += UnZigZag(dx);
+      y += UnZigZag(dy);
+      if(index < 0 || static_cast<uint64_t>(index) >= sites.size())
+      {
+        return false;
+      }
+      order[i] = static_cast<unsigned int>(index);
+      sites[order[i]] = glm::vec2(OrderedToFloat(static_cast<int32_t>(x)), OrderedToFloat(static_cast<int32_t>(y)));
+    }
+    return true;
+  }
+
+  /// Раскодировать грани и вершины блока прямо в выходные массивы.
+  /// Точки всех блоков уже должны быть раскодированы.
+  bool DecodeEdges(const Block &block, BlockData &data, const std::vector<unsigned int> &order,
+                   const std::vector<glm::vec2> &sites, double grid,
+                   std::vector<glm::vec2> &vertex, std::vector<Voronoi::Edge> &edges)
+  {
+    const uint64_t edgeEnd = block.firstEdge + block.edgeCount;
+    const uint64_t vertexEnd = block.firstVertex + block.vertexCount;
+
+    uint64_t edgeIndex = block.firstEdge;
+    uint64_t next = block.firstVertex;
+    for(uint64_t site = block.firstSite; site < block.firstSite + block.siteCount; ++site)
+    {
+      uint64_t count;
+      if(!GetVarint(data.begins[STREAM_COUNTS], data.ends[STREAM_COUNTS], count) || count > edgeEnd - edgeIndex)
+      {
+        return false;
+      }
+
+      for(uint64_t i = 0; i < count; ++i)
+      {
+        uint64_t other;
+        if(!GetVarint(data.begins[STREAM_OTHERS], data.ends[STREAM_OTHERS], other) || other >= order.size() - site)
+        {
+          return false;
+        }
+        const unsigned int site1 = order[site];
+        const unsigned int site2 = order[site + other];
+
+        uint64_t refs[2];
+        for(unsigned int j = 0; j < 2; ++j)
+        {
+          uint64_t ref;
+          if(!GetVarint(data.begins[STREAM_REFS], data.ends[STREAM_REFS], ref) || ref > next)
+          {
+            return false;
+          }
+          if(ref != 0)
+          {
+            refs[j] = next - ref;
+            continue;
+          }
+
+          uint64_t t, r;
+          if(next == vertexEnd ||
+             !GetVarint(data.begins[STREAM_COORDS], data.ends[STREAM_COORDS], t) ||
+             !GetVarint(data.begins[STREAM_COORDS], data.ends[STREAM_COORDS], r))
+          {
+            return false;
+          }
+          vertex[next] = EdgeFrame(sites[site1], sites[site2]).ToGlobal(UnZigZag(t), UnZigZag(r), grid);
+          refs[j] = next++;
+        }
+
+        edges[edgeIndex++] = site1 <= site2 ?
+          Voronoi::Edge(site1, site2, static_cast<unsigned int>(refs[0]), static_cast<unsigned int>(refs[1])) :
+          Voronoi::Edge(site2, site1, static_cast<unsigned int>(refs[1]), static_cast<unsigned int>(refs[0]));
+      }
+    }
+    return edgeIndex == edgeEnd && next == vertexEnd;
+  }
+
+  bool ReadFile(const std::string &fileName, std::vector<unsigned char> &data)
+  {
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if(!file)
+    {
+      return false;
+    }
+    bool good = fseek(file, 0, SEEK_END) == 0;
+    const long size = good ? ftell(file) : -1;
+    good = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if(good)
+    {
+      data.resize(static_cast<size_t>(size));
+      good = size == 0 || fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+    return good;
+  }
+}
+
+bool archive::Save(const std::string &fileName, const geometry::Rect &rect,
+                   const std::vector<glm::vec2> &sites, const std::vector<glm::vec2> &vertex,
+                   const std::vector<Voronoi::Edge> &edges, float grid,
+                   compression::Level level, unsigned int threads)
+{
+  assert(grid > 0.0f);
+
+  Layout layout;
+  BuildLayout(rect, sites, vertex.size(), edges, layout);
+
+  // Границы блоков. Вершины блока - новые вершины, впервые встреченные в его гранях.
+  std::vector<Block> blocks((sites.size() + BLOCK_SITES - 1) / BLOCK_SITES);
+  for(size_t i = 0; i < blocks.size(); ++i)
+  {
+    Block &block = blocks[i];
+    block.firstSite = i * BLOCK_SITES;
+    block.siteCount = std::min<uint64_t>(BLOCK_SITES, sites.size() - block.firstSite);
+    block.firstEdge = layout.offsets[block.firstSite];
+    block.edgeCount = layout.offsets[block.firstSite + block.siteCount] - block.firstEdge;
+    block.firstVertex = i == 0 ? 0 : blocks[i - 1].firstVertex + blocks[i - 1].vertexCount;
+    uint64_t last = block.firstVertex;
+    for(uint64_t e = block.firstEdge; e < block.firstEdge + block.edgeCount; ++e)
+    {
+      last = std::max<uint64_t>(last, std::max(layout.edges[e].vertex1, layout.edges[e].vertex2) + 1ull);
+    }
+    block.vertexCount = last - block.firstVertex;
+  }
+
+  std::vector<std::vector<unsigned char>> data(blocks.size());
+  ParallelFor(blocks.size(), 1, [&](size_t begin, size_t end)
+  {
+    std::vector<unsigned char> raw;
+    for(size_t i = begin; i < end; ++i)
+    {
+      EncodeBlock(blocks[i], sites, vertex, layout, grid, raw);
+      blocks[i].rawSize = raw.size();
+      if(level == compression::STORE)
+      {
+        data[i].swap(raw);
+      }
+      else
+      {
+        // Блоки уже сжимаются параллельно, поэтому внутри блока - один поток.
+        compression::Compress(raw.data(), raw.size(), level, data[i], 1);
+      }
+      blocks[i].dataSize = data[i].size();
+    }
+  }, threads);
+
+  std::vector<unsigned char> header;
+  header.reserve(HEADER_SIZE + blocks.size() * BLOCK_SIZE);
+  header.insert(header.end(), MAGIC, MAGIC + sizeof(MAGIC));
+  PutU32(header, VERSION);
+  PutU32(header, level);
+  PutF64(header, grid);
+  PutF64(header, rect.lb.x);
+  PutF64(header, rect.lb.y);
+  PutF64(header, rect.rt.x);
+  PutF64(header, rect.rt.y);
+  PutU64(header, sites.size());
+  PutU64(header, layout.vertex.size());
+  PutU64(header, layout.edges.size());
+  PutU32(header, static_cast<uint32_t>(blocks.size()));
+  for(auto it = blocks.begin(); it != blocks.end(); ++it)
+  {
+    PutU64(header, (*it).firstSite);
+    PutU64(header, (*it).siteCount);
+    PutU64(header, (*it).firstEdge);
+    PutU64(header, (*it).edgeCount);
+    PutU64(header, (*it).firstVertex);
+    PutU64(header, (*it).vertexCount);
+    PutU64(header, (*it).rawSize);
+    PutU64(header, (*it).dataSize);
+  }
+
+  // Пишем во временный файл, чтобы не оставить наполовину записанный архив.
+  const std::string temp = storage::TempName(fileName);
+  FILE *file = fopen(temp.c_str(), "wb");
+  if(!file)
+  {
+    return false;
+  }
+  bool good = fwrite(header.data(), 1, header.size(), file) == header.size();
+  for(size_t i = 0; good && i < data.size(); ++i)
+  {
+    good = data[i].empty() || fwrite(data[i].data(), 1, data[i].size(), file) == data[i].size();
+  }
+  good = fclose(file) == 0 && good;
+
+  if(!good)
+  {
+    remove(temp.c_str());
+    return false;
+  }
+  return storage::CommitFile(temp, fileName);
+}
+
+bool archive::Load(const std::string &fileName, geometry::Rect &rect,
+                   std::vector<glm::vec2> &sites, std::vector<glm::vec2> &vertex,
+                   std::vector<Voronoi::Edge> &edges, unsigned int threads)
+{
+  std::vector<unsigned char> file;
+  if(!ReadFile(fileName, file) || file.size() < HEADER_SIZE || memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0)
+  {
+    return false;
+  }
+
+  const unsigned char *p = file.data() + sizeof(MAGIC);
+  if(GetU32(p) != VERSION)
+  {
+    return false;
+  }
+  const bool compressed = GetU32(p) != compression::STORE;
+  const double grid = GetF64(p);
+  const double lbx = GetF64(p);
+  const double lby = GetF64(p);
+  const double rtx = GetF64(p);
+  const double rty = GetF64(p);
+  const uint64_t siteCount = GetU64(p);
+  const uint64_t vertexCount = GetU64(p);
+  const uint64_t edgeCount = GetU64(p);
+  const uint32_t blockCount = GetU32(p);
+
+  const uint64_t MAX_INDEX = std::numeric_limits<unsigned int>::max();
+  if(siteCount > MAX_INDEX || vertexCount > MAX_INDEX || edgeCount > MAX_INDEX ||
+     blockCount > (file.size() - HEADER_SIZE) / BLOCK_SIZE)
+  {
+    return false;
+  }
+
+  // Блоки должны покрывать массивы подряд и без пропусков.
+  std::vector<Block> blocks(blockCount);
+  std::vector<uint64_t> offsets(blockCount);
+  uint64_t offset = HEADER_SIZE + static_cast<uint64_t>(blockCount) * BLOCK_SIZE;
+  uint64_t site = 0, edge = 0, vert = 0;
+  for(uint32_t i = 0; i < blockCount; ++i)
+  {
+    Block &block = blocks[i];
+    block.firstSite = GetU64(p);
+    block.siteCount = GetU64(p);
+    block.firstEdge = GetU64(p);
+    block.edgeCount = GetU64(p);
+    block.firstVertex = GetU64(p);
+    block.vertexCount = GetU64(p);
+    block.rawSize = GetU64(p);
+    block.dataSize = GetU64(p);
+    if(block.firstSite != site || block.siteCount > siteCount - site ||
+       block.firstEdge != edge || block.edgeCount > edgeCount - edge ||
+       block.firstVertex != vert || block.vertexCount > vertexCount - vert ||
+       block.dataSize > file.size() - offset)
+    {
+      return false;
+    }
+    site += block.siteCount;
+    edge += block.edgeCount;
+    vert += block.vertexCount;
+    offsets[i] = offset;
+    offset += block.dataSize;
+  }
+  if(site != siteCount || edge != edgeCount || vert != vertexCount)
+  {
+    return false;
+  }
+
+  rect = geometry::Rect(geometry::Point(lbx, lby), geometry::Point(rtx, rty));
+  sites.resize(static_cast<size_t>(siteCount));
+  vertex.resize(static_cast<size_t>(vertexCount));
+  edges.assign(static_cast<size_t>(edgeCount), Voronoi::Edge(0, 0, 0, 0));
+
+  // Вершины кодируются относительно точек грани, а точки грани могут лежать
+  // в других блоках. Поэтому сначала раскодируются точки всех блоков.
+  std::vector<BlockData> data(blocks.size());
+  std::vector<unsigned int> order(static_cast<size_t>(siteCount));
+  std::atomic<bool> good(true);
+  ParallelFor(blocks.size(), 1, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end && good; ++i)
+    {
+      const unsigned char *raw = file.data() + offsets[i];
+      size_t size = static_cast<size_t>(blocks[i].dataSize);
+      if(compressed)
+      {
+        if(!compression::Decompress(raw, size, data[i].raw) || data[i].raw.size() != blocks[i].rawSize)
+        {
+          good = false;
+          return;
+        }
+        raw = data[i].raw.data();
+        size = data[i].raw.size();
+      }
+      if(size != blocks[i].rawSize || !ParseStreams(raw, size, data[i]) ||
+         !DecodeSites(blocks[i], data[i], order, sites))
+      {
+        good = false;
+        return;
+      }
+    }
+  }, threads);
+  if(!good)
+  {
+    return false;
+  }
+
+  std::vector<bool> used(order.size(), false);
+  for(auto it = order.begin(); it != order.end(); ++it)
+  {
+    if(used[*it])
+    {
+      return false;
+    }
+    used[*it] = true;
+  }
+
+  ParallelFor(blocks.size(), 1, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end && good; ++i)
+    {
+      if(!DecodeEdges(blocks[i], data[i], order, sites, grid, vertex, edges))
+      {
+        good = false;
+        return;
+      }
+    }
+  }, threads);
+
+  return good;
+}
@@ -0,0 +1,49 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "Voronoi.h"
+#include "compression.h"
+#include <string>
+#include <vector>
+
+/// Компактный архивный формат диаграммы.
+///
+/// В отличие от storage, формат не предназначен для отображения в память.
+/// Точки кодируются в порядке кода Мортона, поэтому у соседних по номеру
+/// точек близки координаты и номера соседей; исходный порядок точек хранится
+/// разностями индексов. Грани группируются по меньшему номеру точки, и индексы
+/// кодируются разностями в varint. Вершины перенумеровываются в порядке
+/// первого появления в гранях и хранятся в системе координат грани, которая
+/// их ввела (вдоль и поперек серединного перпендикуляра), квантованными
+/// на сетку с шагом grid. Точки хранятся без потерь. Данные разбиты на блоки
+/// по точкам, каждый блок сжимается отдельно и распаковывается независимо
+/// от остальных, поэтому блоки сжимаются и распаковываются параллельно.
+///
+/// После загрузки порядок точек сохраняется, порядок граней и вершин - нет.
+/// Для каждой грани site1 < site2, вершины переставляются вместе с точками,
+/// поэтому взаимное расположение точек относительно грани сохраняется.
+/// Вершины, на которые не ссылается ни одна грань, не сохраняются.
+namespace archive
+{
+  const char MAGIC[4] = {'V', 'O', 'R', 'A'};
+  const unsigned int VERSION = 1;
+
+  /// Записать диаграмму в архив.
+  /// @param grid Шаг сетки квантования вершин.
+  /// @param level Уровень сжатия блоков. При STORE блоки не сжимаются и
+  /// распаковка сводится к декодированию varint.
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  bool Save(const std::string &fileName, const geometry::Rect &rect,
+            const std::vector<glm::vec2> &sites, const std::vector<glm::vec2> &vertex,
+            const std::vector<Voronoi::Edge> &edges, float grid,
+            compression::Level level = compression::DEFAULT, unsigned int threads = 0);
+
+  /// Прочитать архив.
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  /// @return false, если файл не удалось прочитать или он поврежден.
+  bool Load(const std::string &fileName, geometry::Rect &rect,
+            std::vector<glm::vec2> &sites, std::vector<glm::vec2> &vertex,
+            std::vector<Voronoi::Edge> &edges, unsigned int threads = 0);
+}
+
+#endif // ARCHIVE_H
@@ -0,0 +1,155 @@
+#include "batch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+  /// Буферы результатов одного потока.
+  struct Arena
+  {
+    std::vector<glm::vec2> sites;
+    std::vector<glm::vec2> vertex;
+    std::vector<Voronoi::Edge> edges;
+  };
+
+  /// Где лежит результат диаграммы: поток и начала списков в его буферах.
+  struct Placement
+  {
+    unsigned int arena;
+    size_t siteBegin;
+    size_t vertexBegin;
+    size_t edgeBegin;
+  };
+
+  template<class V>
+  void Append(V &to, const V &from)
+  {
+    to.insert(to.end(), from.begin(), from.end());
+  }
+}
+
+DiagramBatch::DiagramBatch()
+{
+}
+
+void DiagramBatch::Build(const std::vector<std::vector<glm::vec2> > &siteSets, const glm::vec2 &size,
+                         unsigned int flags, unsigned int threads)
+{
+  Clear();
+  const size_t count = siteSets.size();
+  mSiteOffsets.assign(count + 1, 0);
+  mVertexOffsets.assign(count + 1, 0);
+  mEdgeOffsets.assign(count + 1, 0);
+  if(count == 0)
+  {
+    return;
+  }
+
+  // Строим диаграммы в буферы потоков.
+  const unsigned int arenaCount = static_cast<unsigned int>(std::min<size_t>(ThreadCount(threads), count));
+  std::vector<Arena> arenas(arenaCount);
+  std::vector<Placement> placement(count);
+  std::atomic<size_t> next(0);
+  ParallelFor(arenaCount, 1, [&](size_t begin, size_t end)
+  {
+    for(size_t a = begin; a < end; ++a)
+    {
+      Arena &arena = arenas[a];
+      Voronoi voronoi(std::vector<glm::vec2>(), size, flags | Voronoi::REUSE_MEMORY);
+      for(size_t i = next++; i < count; i = next++)
+      {
+        voronoi.Assign(siteSets[i], size);
+        voronoi();
+
+        Placement &place = placement[i];
+        place.arena = static_cast<unsigned int>(a);
+        place.siteBegin = arena.sites.size();
+        place.vertexBegin = arena.vertex.size();
+        place.edgeBegin = arena.edges.size();
+        Append(arena.sites, voronoi.GetSites());
+        Append(arena.vertex, voronoi.GetVertex());
+        Append(arena.edges, voronoi.GetEdges());
+
+        mSiteOffsets[i + 1] = static_cast<unsigned int>(voronoi.GetSites().size());
+        mVertexOffsets[i + 1] = static_cast<unsigned int>(voronoi.GetVertex().size());
+        mEdgeOffsets[i + 1] = static_cast<unsigned int>(voronoi.GetEdges().size());
+      }
+    }
+  }, arenaCount);
+
+  // Собираем результаты в порядке диаграмм.
+  for(size_t i = 0; i < count; ++i)
+  {
+    mSiteOffsets[i + 1] += mSiteOffsets[i];
+    mVertexOffsets[i + 1] += mVertexOffsets[i];
+    mEdgeOffsets[i + 1] += mEdgeOffsets[i];
+  }
+  mSites.resize(mSiteOffsets.back());
+  mVertex.resize(mVertexOffsets.back());
+  mEdges.resize(mEdgeOffsets.back(), Voronoi::Edge(0, 0, 0, 0));
+
+  ParallelFor(count, 64, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      const Placement &place = placement[i];
+      const Arena &arena = arenas[place.arena];
+      std::copy(arena.sites.begin() + place.siteBegin,
+                arena.sites.begin() + place.siteBegin + (mSiteOffsets[i + 1] - mSiteOffsets[i]),
+                mSites.begin() + mSiteOffsets[i]);
+      std::copy(arena.vertex.begin() + place.vertexBegin,
+                arena.vertex.begin() + place.vertexBegin + (mVertexOffsets[i + 1] - mVertexOffsets[i]),
+                mVertex.begin() + mVertexOffsets[i]);
+      std::copy(arena.edges.begin() + place.edgeBegin,
+                arena.edges.begin() + place.edgeBegin + (mEdgeOffsets[i + 1] - mEdgeOffsets[i]),
+                mEdges.begin() + mEdgeOffsets[i]);
+    }
+  }, threads);
+}
+
+void DiagramBatch::Clear()
+{
+  std::vector<glm::vec2>().swap(mSites);
+  std::vector<glm::vec2>().swap(mVertex);
+  std::vector<Voronoi::Edge>().swap(mEdges);
+  std::vector<unsigned int>().swap(mSiteOffsets);
+  std::vector<unsigned int>().swap(mVertexOffsets);
+  std::vector<unsigned int>().swap(mEdgeOffsets);
+}
+
+size_t DiagramBatch::GetCount() const
+{
+  return mSiteOffsets.empty() ? 0 : mSiteOffsets.size() - 1;
+}
+
+const std::vector<glm::vec2> &DiagramBatch::GetSites() const
+{
+  return mSites;
+}
+
+const std::vector<glm::vec2> &DiagramBatch::GetVertex() const
+{
+  return mVertex;
+}
+
+const std::vector<Voronoi::Edge> &DiagramBatch::GetEdges() const
+{
+  return mEdges;
+}
+
+const std::vector<unsigned int> &DiagramBatch::GetSiteOffsets() const
+{
+  return mSiteOffsets;
+}
+
+const std::vector<unsigned int> &DiagramBatch::GetVertexOffsets() const
+{
+  return mVertexOffsets;
+}
+
+const std::vector<unsigned int> &DiagramBatch::GetEdgeOffsets() const
+{
+  return mEdgeOffsets;
+}
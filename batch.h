@@ -0,0 +1,58 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Voronoi.h"
+#include <vector>
+
+/// Набор независимых диаграмм, построенных одним вызовом.
+///
+/// Диаграммы строятся параллельно: каждый поток берет следующую диаграмму
+/// из общего счетчика, пока диаграммы не кончатся, поэтому потоки с мелкими
+/// диаграммами не простаивают. Поток строит все свои диаграммы одним объектом
+/// Voronoi с REUSE_MEMORY и складывает результаты в свои буферы, так что
+/// память выделяется в основном на первых диаграммах потока.
+///
+/// Результаты всех диаграмм лежат подряд в общих списках точек, вершин
+/// и граней в порядке диаграмм. Диаграмма i занимает элементы
+/// [offsets[i], offsets[i + 1]) каждого списка. Номера точек и вершин
+/// в гранях - номера внутри своей диаграммы.
+class DiagramBatch
+{
+public:
+  DiagramBatch();
+
+  /// Построить диаграммы.
+  /// @param siteSets Списки точек диаграмм.
+  /// @param size Размер рабочей области, общий для всех диаграмм.
+  /// @param flags Флаги построения Voronoi::Flags.
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  void Build(const std::vector<std::vector<glm::vec2> > &siteSets, const glm::vec2 &size,
+             unsigned int flags = 0, unsigned int threads = 0);
+
+  /// Освободить память.
+  void Clear();
+
+  /// Число диаграмм.
+  size_t GetCount() const;
+
+  /// Точки, вершины и грани всех диаграмм.
+  /// Точки - как в Voronoi::GetSites после построения.
+  const std::vector<glm::vec2> &GetSites() const;
+  const std::vector<glm::vec2> &GetVertex() const;
+  const std::vector<Voronoi::Edge> &GetEdges() const;
+
+  /// Начала точек, вершин и граней диаграмм, GetCount() + 1 элементов.
+  const std::vector<unsigned int> &GetSiteOffsets() const;
+  const std::vector<unsigned int> &GetVertexOffsets() const;
+  const std::vector<unsigned int> &GetEdgeOffsets() const;
+
+private:
+  std::vector<glm::vec2> mSites;
+  std::vector<glm::vec2> mVertex;
+  std::vector<Voronoi::Edge> mEdges;
+  std::vector<unsigned int> mSiteOffsets;
+  std::vector<unsigned int> mVertexOffsets;
+  std::vector<unsigned int> mEdgeOffsets;
+};
+
+#endif // BATCH_H
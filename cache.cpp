@@ -0,0 +1,312 @@
+#include "cache.h"
+#include "storage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace
+{
+  /// Версия кэша. Увеличивается при изменениях построения, меняющих результат.
+  const uint64_t CACHE_VERSION = 3;
+
+  const char EXTENSION[] = ".vord";
+
+  const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+  const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+  const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+  const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+
+  uint64_t Rotl(uint64_t value, unsigned int bits)
+  {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  uint64_t Round(uint64_t acc, uint64_t input)
+  {
+    return Rotl(acc + input * PRIME2, 31) * PRIME1;
+  }
+
+  uint64_t Mix(uint64_t hash)
+  {
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+  /// Быстрый некриптографический хэш.
+  /// Данные обрабатываются четырьмя независимыми полосами по 8 байт, как в xxHash.
+  uint64_t Hash(const void *data, size_t size, uint64_t seed)
+  {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    uint64_t lanes[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+
+    for(; end - p >= 32; p += 32)
+    {
+      for(unsigned int i = 0; i < 4; ++i)
+      {
+        uint64_t word;
+        memcpy(&word, p + i * 8, sizeof(word));
+        lanes[i] = Round(lanes[i], word);
+      }
+    }
+
+    uint64_t hash = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) + Rotl(lanes[3], 18);
+    hash += size;
+    for(; end - p >= 8; p += 8)
+    {
+      uint64_t word;
+      memcpy(&word, p, sizeof(word));
+      hash = Rotl(hash ^ Round(0, word), 27) * PRIME1 + PRIME4;
+    }
+    for(; p != end; ++p)
+    {
+      hash = Rotl(hash ^ (*p * PRIME1), 11) * PRIME2;
+    }
+    return Mix(hash);
+  }
+
+  /// Файл кэша.
+  struct Entry
+  {
+    std::string fileName;
+    uint64_t size;
+    int64_t time;
+  };
+
+  /// Перечислить файлы кэша в каталоге.
+  void ListEntries(const std::string &directory, std::vector<Entry> &entries)
+  {
+    const size_t extension = sizeof(EXTENSION) - 1;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "\\*" + EXTENSION).c_str(), &data);
+    if(find == INVALID_HANDLE_VALUE)
+    {
+      return;
+    }
+    do
+    {
+      if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+      {
+        Entry entry;
+        entry.fileName = directory + "\\" + data.cFileName;
+        entry.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        entry.time = (static_cast<int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                     data.ftLastWriteTime.dwLowDateTime;
+        entries.push_back(entry);
+      }
+    }
+    while(FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *dir = opendir(directory.c_str());
+    if(!dir)
+    {
+      return;
+    }
+    while(dirent *item = readdir(dir))
+    {
+      const size_t length = strlen(item->d_name);
+      if(length <= extension || strcmp(item->d_name + length - extension, EXTENSION) != 0)
+      {
+        continue;
+      }
+      Entry entry;
+      entry.fileName = directory + "/" + item->d_name;
+      struct stat info;
+      if(stat(entry.fileName.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+      {
+        entry.size = static_cast<uint64_t>(info.st_size);
+        entry.time = static_cast<int64_t>(info.st_mtime);
+        entries.push_back(entry);
+      }
+    }
+    closedir(dir);
+#endif
+  }
+
+  /// Обновить время изменения файла.
+  void Touch(const std::string &fileName)
+  {
+#ifdef _WIN32
+    _utime(fileName.c_str(), nullptr);
+#else
+    utime(fileName.c_str(), nullptr);
+#endif
+  }
+}
+
+DiagramCache::DiagramCache(const std::string &directory, uint64_t maxSize)
+  : mDirectory(directory), mMaxSize(maxSize), mHits(0), mMisses(0)
+{
+}
+
+void DiagramCache::Source(const Voronoi &diagram, const std::vector<glm::vec2> &sites, uint32_t options,
+                          std::vector<unsigned char> &source)
+{
+  // options, флаги, число точек, точки, число вершин многоугольника, вершины.
+  const uint32_t header[4] = {options, diagram.GetFlags(), static_cast<uint32_t>(sites.size()),
+                              static_cast<uint32_t>(diagram.GetBoundary().size())};
+  const size_t siteBytes = sites.size() * sizeof(glm::vec2);
+  const size_t boundaryBytes = diagram.GetBoundary().size() * sizeof(geometry::Point);
+  source.resize(sizeof(header) + siteBytes + boundaryBytes);
+  memcpy(&source[0], header, sizeof(header));
+  if(siteBytes > 0)
+  {
+    memcpy(&source[sizeof(header)], sites.data(), siteBytes);
+  }
+  if(boundaryBytes > 0)
+  {
+    memcpy(&source[sizeof(header) + siteBytes], diagram.GetBoundary().data(), boundaryBytes);
+  }
+}
+
+uint64_t DiagramCache::Key(const std::vector<unsigned char> &source, const geometry::Rect &rect)
+{
+  const double bounds[4] = {rect.lb.x, rect.lb.y, rect.rt.x, rect.rt.y};
+  const uint64_t key = Hash(source.data(), source.size(), CACHE_VERSION);
+  return Hash(bounds, sizeof(bounds), key ^ storage::VERSION);
+}
+
+uint64_t DiagramCache::Key(const Voronoi &diagram, uint32_t options)
+{
+  std::vector<unsigned char> source;
+  Source(diagram, diagram.GetSites(), options, source);
+  return Key(source, diagram.GetRect());
+}
+
+bool DiagramCache::Build(Voronoi &diagram, uint32_t options)
+{
+  // Ключ считается до построения: построение может переставить точки
+  // и добавить копии.
+  std::vector<unsigned char> source;
+  Source(diagram, diagram.GetSites(), options, source);
+  const uint64_t key = Key(source, diagram.GetRect());
+  if(Load(diagram, source, key))
+  {
+    return true;
+  }
+  diagram();
+  Store(diagram, source, key);
+  return false;
+}
+
+bool DiagramCache::Load(Voronoi &diagram, uint32_t options)
+{
+  std::vector<unsigned char> source;
+  Source(diagram, diagram.GetSites(), options, source);
+  return Load(diagram, source, Key(source, diagram.GetRect()));
+}
+
+bool DiagramCache::Store(const Voronoi &diagram, const std::vector<glm::vec2> &sites, uint32_t options)
+{
+  std::vector<unsigned char> source;
+  Source(diagram, sites, options, source);
+  return Store(diagram, source, Key(source, diagram.GetRect()));
+}
+
+bool DiagramCache::Load(Voronoi &diagram, const std::vector<unsigned char> &source, uint64_t key)
+{
+  const std::string fileName = FileName(key);
+  MappedDiagram mapped;
+  if(!mapped.Open(fileName))
+  {
+    ++mMisses;
+    return false;
+  }
+
+  // Защита от коллизий хэша: файл должен быть построен из тех же данных.
+  const ArrayView<unsigned char> cached = mapped.GetSource();
+  const geometry::Rect &rect = diagram.GetRect();
+  const geometry::Rect &cachedRect = mapped.GetRect();
+  if(cached.size() != source.size() || memcmp(cached.data(), source.data(), source.size()) != 0 ||
+     cachedRect.lb != rect.lb || cachedRect.rt != rect.rt || !diagram.Load(mapped))
+  {
+    ++mMisses;
+    return false;
+  }
+
+  Touch(fileName);
+  ++mHits;
+  return true;
+}
+
+bool DiagramCache::Store(const Voronoi &diagram, const std::vector<unsigned char> &source, uint64_t key)
+{
+  // storage::Save пишет во временный файл с уникальным именем и атомарно переименовывает его.
+  if(!storage::Save(FileName(key), diagram.GetRect(), diagram.GetSites(), diagram.GetVertex(), diagram.GetEdges(),
+                    false, diagram.GetSiteOrder(), diagram.GetPeriodicSource(), source))
+  {
+    return false;
+  }
+  if(mMaxSize > 0)
+  {
+    Trim();
+  }
+  return true;
+}
+
+void DiagramCache::Trim()
+{
+  std::vector<Entry> entries;
+  ListEntries(mDirectory, entries);
+
+  uint64_t total = 0;
+  for(auto it = entries.begin(); it != entries.end(); ++it)
+  {
+    total += (*it).size;
+  }
+  if(mMaxSize == 0 || total <= mMaxSize)
+  {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry &e1, const Entry &e2)
+  {
+    return e1.time < e2.time;
+  });
+  for(auto it = entries.begin(); it != entries.end() && total > mMaxSize; ++it)
+  {
+    // Файл мог уже удалить другой процесс.
+    remove((*it).fileName.c_str());
+    total -= (*it).size;
+  }
+}
+
+unsigned int DiagramCache::GetHits() const
+{
+  return mHits;
+}
+
+unsigned int DiagramCache::GetMisses() const
+{
+  return mMisses;
+}
+
+std::string DiagramCache::FileName(uint64_t key) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(key), EXTENSION);
+#ifdef _WIN32
+  return mDirectory + "\\" + name;
+#else
+  return mDirectory + "/" + name;
+#endif
+}
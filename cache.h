@@ -0,0 +1,72 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Кэш построенных диаграмм на диске.
+///
+/// Диаграмма хранится в файле формата storage, имя файла - хэш исходных
+/// данных построения: входных точек, области, многоугольника области, флагов
+/// диаграммы и параметров. Исходные данные записываются в секцию SOURCE
+/// и при попадании сравниваются с входными, поэтому коллизия хэша не приводит
+/// к неверному результату.
+///
+/// Файлы записываются во временный файл с уникальным именем и атомарно
+/// переименовываются, поэтому кэшем могут одновременно пользоваться
+/// несколько процессов. Время изменения файла обновляется при каждом
+/// попадании; при превышении размера кэша удаляются давно не использованные
+/// файлы.
+class DiagramCache
+{
+public:
+  /// @param directory Каталог кэша. Каталог должен существовать.
+  /// @param maxSize Максимальный размер кэша в байтах. 0 - без ограничения.
+  DiagramCache(const std::string &directory, uint64_t maxSize = 0);
+
+  /// Ключ диаграммы, еще не построенной.
+  /// @param options Параметры построения, влияющие на результат.
+  static uint64_t Key(const Voronoi &diagram, uint32_t options = 0);
+
+  /// Построить диаграмму или загрузить ее из кэша.
+  /// Диаграмма должна содержать точки и область, но еще не быть построенной.
+  /// При промахе диаграмма строится и записывается в кэш.
+  /// @return true, если диаграмма загружена из кэша.
+  bool Build(Voronoi &diagram, uint32_t options = 0);
+
+  /// Загрузить диаграмму из кэша.
+  /// @return false, если диаграммы нет в кэше.
+  bool Load(Voronoi &diagram, uint32_t options = 0);
+
+  /// Записать построенную диаграмму в кэш.
+  /// @param sites Точки, из которых построена диаграмма. После построения
+  /// GetSites может отличаться от них (REORDER_SITES, PERIODIC).
+  bool Store(const Voronoi &diagram, const std::vector<glm::vec2> &sites, uint32_t options = 0);
+
+  /// Удалить давно не использованные файлы, пока размер кэша больше maxSize.
+  void Trim();
+
+  /// Количество попаданий и промахов.
+  unsigned int GetHits() const;
+  unsigned int GetMisses() const;
+
+private:
+  /// Исходные данные построения для секции SOURCE.
+  static void Source(const Voronoi &diagram, const std::vector<glm::vec2> &sites, uint32_t options,
+                     std::vector<unsigned char> &source);
+  static uint64_t Key(const std::vector<unsigned char> &source, const geometry::Rect &rect);
+
+  bool Load(Voronoi &diagram, const std::vector<unsigned char> &source, uint64_t key);
+  bool Store(const Voronoi &diagram, const std::vector<unsigned char> &source, uint64_t key);
+
+  std::string FileName(uint64_t key) const;
+
+  std::string mDirectory;
+  uint64_t mMaxSize;
+  unsigned int mHits;
+  unsigned int mMisses;
+};
+
+#endif // CACHE_H
@@ -0,0 +1,338 @@
+#include "compact.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+  /// Грань, у которой site1 < site2.
+  struct OrderedEdge
+  {
+    unsigned int site1;
+    unsigned int site2;
+    unsigned int vertex1;
+    unsigned int vertex2;
+  };
+
+  /// Квантовать координату на сетку [0, 65535].
+  uint16_t Quantize(float value, float origin, float step)
+  {
+    const double q = std::floor((static_cast<double>(value) - origin) / step + 0.5);
+    return static_cast<uint16_t>(std::min(std::max(q, 0.0), 65535.0));
+  }
+}
+
+CompactDiagram::CompactDiagram()
+  : mRect(geometry::Point(), geometry::Point())
+{
+}
+
+bool CompactDiagram::Build(const geometry::Rect &rect, const std::vector<glm::vec2> &sites,
+                           const std::vector<glm::vec2> &vertex, const std::vector<Voronoi::Edge> &edges)
+{
+  Clear();
+  mRect = rect;
+
+  // Упорядочиваем точки граней и группируем грани по меньшей точке.
+  std::vector<unsigned int> offsets(sites.size() + 1, 0);
+  for(auto it = edges.begin(); it != edges.end(); ++it)
+  {
+    if((*it).site1 >= sites.size() || (*it).site2 >= sites.size() ||
+       (*it).vertex1 >= vertex.size() || (*it).vertex2 >= vertex.size())
+    {
+      return false;
+    }
+    ++offsets[std::min((*it).site1, (*it).site2) + 1];
+  }
+  for(size_t i = 0; i < sites.size(); ++i)
+  {
+    offsets[i + 1] += offsets[i];
+  }
+
+  std::vector<OrderedEdge> ordered(edges.size());
+  {
+    std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+    for(auto it = edges.begin(); it != edges.end(); ++it)
+    {
+      const bool swap = (*it).site1 > (*it).site2;
+      OrderedEdge &edge = ordered[next[swap ? (*it).site2 : (*it).site1]++];
+      edge.site1 = swap ? (*it).site2 : (*it).site1;
+      edge.site2 = swap ? (*it).site1 : (*it).site2;
+      edge.vertex1 = swap ? (*it).vertex2 : (*it).vertex1;
+      edge.vertex2 = swap ? (*it).vertex1 : (*it).vertex2;
+    }
+  }
+
+  mSites.reserve(sites.size() * 2);
+  mVertex.reserve(vertex.size() * 2);
+  mEdges.reserve(edges.size());
+
+  // Вершины и точки второй стороны граней текущего тайла.
+  std::unordered_map<unsigned int, uint16_t> vertexLocal;
+  std::vector<unsigned int> vertexGlobal;
+  std::unordered_map<unsigned int, unsigned int> referenced;
+
+  unsigned int site = 0;
+  while(site < sites.size())
+  {
+    Tile tile;
+    tile.siteBegin = site;
+    tile.vertexBegin = static_cast<unsigned int>(mVertex.size() / 2);
+    tile.edgeBegin = static_cast<unsigned int>(mEdges.size());
+    tile.offsetBegin = static_cast<unsigned int>(mOffsets.size());
+    tile.remapBegin = static_cast<unsigned int>(mRemap.size());
+
+    vertexLocal.clear();
+    vertexGlobal.clear();
+    referenced.clear();
+
+    // Добавляем точки, пока номера вершин, граней и точек помещаются в 16 бит.
+    // Точки второй стороны граней считаем чужими, пока тайл не закрыт.
+    for(; site < sites.size(); ++site)
+    {
+      const unsigned int begin = offsets[site];
+      const unsigned int end = offsets[site + 1];
+
+      size_t newVertex = 0;
+      size_t newReferenced = 0;
+      for(unsigned int i = begin; i < end; ++i)
+      {
+        newVertex += vertexLocal.count(ordered[i].vertex1) == 0;
+        newVertex += vertexLocal.count(ordered[i].vertex2) == 0;
+        newReferenced += referenced.count(ordered[i].site2) == 0;
+      }
+      const size_t siteCount = site - tile.siteBegin + 1;
+      if(end - offsets[tile.siteBegin] > TILE_LIMIT ||
+         vertexGlobal.size() + newVertex > TILE_LIMIT + 1 ||
+         siteCount + referenced.size() + newReferenced > TILE_LIMIT + 1)
+      {
+        if(siteCount == 1)
+        {
+          // Грани одной точки не помещаются в тайл.
+          Clear();
+          return false;
+        }
+        break;
+      }
+
+      for(unsigned int i = begin; i < end; ++i)
+      {
+        const unsigned int v[2] = {ordered[i].vertex1, ordered[i].vertex2};
+        for(int k = 0; k < 2; ++k)
+        {
+          if(vertexLocal.insert(std::make_pair(v[k], static_cast<uint16_t>(vertexGlobal.size()))).second)
+          {
+            vertexGlobal.push_back(v[k]);
+          }
+        }
+        referenced.insert(std::make_pair(ordered[i].site2, 0u));
+      }
+    }
+
+    tile.siteCount = site - tile.siteBegin;
+    const unsigned int siteEnd = site;
+
+    // Система координат тайла.
+    glm::vec2 lb(sites[tile.siteBegin]);
+    glm::vec2 rt(sites[tile.siteBegin]);
+    for(unsigned int i = tile.siteBegin; i < siteEnd; ++i)
+    {
+      lb = glm::min(lb, sites[i]);
+      rt = glm::max(rt, sites[i]);
+    }
+    for(auto it = vertexGlobal.begin(); it != vertexGlobal.end(); ++it)
+    {
+      lb = glm::min(lb, vertex[*it]);
+      rt = glm::max(rt, vertex[*it]);
+    }
+    tile.origin = lb;
+    tile.step = (rt - lb) / 65535.0f;
+    tile.step.x = tile.step.x > 0.0f ? tile.step.x : 1.0f;
+    tile.step.y = tile.step.y > 0.0f ? tile.step.y : 1.0f;
+
+    for(unsigned int i = tile.siteBegin; i < siteEnd; ++i)
+    {
+      mSites.push_back(Quantize(sites[i].x, tile.origin.x, tile.step.x));
+      mSites.push_back(Quantize(sites[i].y, tile.origin.y, tile.step.y));
+    }
+    for(auto it = vertexGlobal.begin(); it != vertexGlobal.end(); ++it)
+    {
+      mVertex.push_back(Quantize(vertex[*it].x, tile.origin.x, tile.step.x));
+      mVertex.push_back(Quantize(vertex[*it].y, tile.origin.y, tile.step.y));
+    }
+
+    // Грани. Чужим точкам выдаем номера после своих в порядке появления.
+    std::unordered_map<unsigned int, uint16_t> foreign;
+    const unsigned int firstEdge = offsets[tile.siteBegin];
+    for(unsigned int i = tile.siteBegin; i <= siteEnd; ++i)
+    {
+      mOffsets.push_back(static_cast<uint16_t>(offsets[i] - firstEdge));
+    }
+    for(unsigned int i = firstEdge; i < offsets[siteEnd]; ++i)
+    {
+      Edge edge;
+      if(ordered[i].site2 < siteEnd)
+      {
+        edge.site2 = static_cast<uint16_t>(ordered[i].site2 - tile.siteBegin);
+      }
+      else
+      {
+        auto found = foreign.insert(std::make_pair(ordered[i].site2,
+                                                   static_cast<uint16_t>(tile.siteCount + foreign.size())));
+        if(found.second)
+        {
+          mRemap.push_back(ordered[i].site2);
+        }
+        edge.site2 = (*found.first).second;
+      }
+      edge.vertex1 = vertexLocal[ordered[i].vertex1];
+      edge.vertex2 = vertexLocal[ordered[i].vertex2];
+      mEdges.push_back(edge);
+    }
+
+    mTiles.push_back(tile);
+  }
+
+  mSites.shrink_to_fit();
+  mVertex.shrink_to_fit();
+  mOffsets.shrink_to_fit();
+  mRemap.shrink_to_fit();
+  mTiles.shrink_to_fit();
+  return true;
+}
+
+void CompactDiagram::Clear()
+{
+  std::vector<Tile>().swap(mTiles);
+  std::vector<uint16_t>().swap(mSites);
+  std::vector<uint16_t>().swap(mVertex);
+  std::vector<Edge>().swap(mEdges);
+  std::vector<uint16_t>().swap(mOffsets);
+  std::vector<unsigned int>().swap(mRemap);
+}
+
+const geometry::Rect &CompactDiagram::GetRect() const
+{
+  return mRect;
+}
+
+size_t CompactDiagram::GetSiteCount() const
+{
+  return mSites.size() / 2;
+}
+
+size_t CompactDiagram::GetVertexCount() const
+{
+  return mVertex.size() / 2;
+}
+
+size_t CompactDiagram::GetEdgeCount() const
+{
+  return mEdges.size();
+}
+
+size_t CompactDiagram::GetTileCount() const
+{
+  return mTiles.size();
+}
+
+const CompactDiagram::Tile &CompactDiagram::FindTile(unsigned int index, unsigned int Tile::*begin) const
+{
+  assert(!mTiles.empty());
+  // Последний тайл, начинающийся не позже index.
+  auto it = std::upper_bound(mTiles.begin(), mTiles.end(), index,
+    [begin](unsigned int value, const Tile &tile)
+  {
+    return value < tile.*begin;
+  });
+  assert(it != mTiles.begin());
+  return *(it - 1);
+}
+
+glm::vec2 CompactDiagram::Decode(const Tile &tile, const uint16_t *q) const
+{
+  return glm::vec2(tile.origin.x + q[0] * tile.step.x, tile.origin.y + q[1] * tile.step.y);
+}
+
+glm::vec2 CompactDiagram::GetSite(unsigned int site) const
+{
+  assert(site < GetSiteCount());
+  return Decode(FindTile(site, &Tile::siteBegin), &mSites[site * 2]);
+}
+
+glm::vec2 CompactDiagram::GetVertex(unsigned int vertex) const
+{
+  assert(vertex < GetVertexCount());
+  return Decode(FindTile(vertex, &Tile::vertexBegin), &mVertex[vertex * 2]);
+}
+
+Voronoi::Edge CompactDiagram::GetEdge(unsigned int edge) const
+{
+  assert(edge < GetEdgeCount());
+  // Тайл без граней имеет то же начало граней, что и следующий,
+  // поэтому берется последний из них - тот, в котором грань есть.
+  const Tile &tile = FindTile(edge, &Tile::edgeBegin);
+  const Edge &e = mEdges[edge];
+
+  // Первая точка - последняя точка тайла, грани которой начинаются не позже edge.
+  const uint16_t local = static_cast<uint16_t>(edge - tile.edgeBegin);
+  const uint16_t *offsets = &mOffsets[tile.offsetBegin];
+  const unsigned int site1 = tile.siteBegin +
+    static_cast<unsigned int>(std::upper_bound(offsets, offsets + tile.siteCount + 1, local) - offsets - 1);
+
+  const unsigned int site2 = e.site2 < tile.siteCount ? tile.siteBegin + e.site2 :
+    mRemap[tile.remapBegin + e.site2 - tile.siteCount];
+
+  return Voronoi::Edge(site1, site2, tile.vertexBegin + e.vertex1, tile.vertexBegin + e.vertex2);
+}
+
+void CompactDiagram::Unpack(std::vector<glm::vec2> &sites, std::vector<glm::vec2> &vertex,
+                            std::vector<Voronoi::Edge> &edges) const
+{
+  sites.clear();
+  vertex.clear();
+  edges.clear();
+  sites.reserve(GetSiteCount());
+  vertex.reserve(GetVertexCount());
+  edges.reserve(GetEdgeCount());
+
+  for(auto tile = mTiles.begin(); tile != mTiles.end(); ++tile)
+  {
+    const unsigned int vertexEnd = tile + 1 != mTiles.end() ? (*(tile + 1)).vertexBegin :
+      static_cast<unsigned int>(GetVertexCount());
+    for(unsigned int i = 0; i < (*tile).siteCount; ++i)
+    {
+      sites.push_back(Decode(*tile, &mSites[((*tile).siteBegin + i) * 2]));
+    }
+    for(unsigned int i = (*tile).vertexBegin; i < vertexEnd; ++i)
+    {
+      vertex.push_back(Decode(*tile, &mVertex[i * 2]));
+    }
+
+    const uint16_t *offsets = &mOffsets[(*tile).offsetBegin];
+    for(unsigned int s = 0; s < (*tile).siteCount; ++s)
+    {
+      for(unsigned int i = offsets[s]; i < offsets[s + 1]; ++i)
+      {
+        const Edge &e = mEdges[(*tile).edgeBegin + i];
+        const unsigned int site2 = e.site2 < (*tile).siteCount ? (*tile).siteBegin + e.site2 :
+          mRemap[(*tile).remapBegin + e.site2 - (*tile).siteCount];
+        edges.push_back(Voronoi::Edge((*tile).siteBegin + s, site2,
+                                      (*tile).vertexBegin + e.vertex1, (*tile).vertexBegin + e.vertex2));
+      }
+    }
+  }
+}
+
+size_t CompactDiagram::GetMemorySize() const
+{
+  return sizeof(*this) +
+         mTiles.capacity() * sizeof(Tile) +
+         mSites.capacity() * sizeof(uint16_t) +
+         mVertex.capacity() * sizeof(uint16_t) +
+         mEdges.capacity() * sizeof(Edge) +
+         mOffsets.capacity() * sizeof(uint16_t) +
+         mRemap.capacity() * sizeof(unsigned int);
+}
@@ -0,0 +1,109 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <vector>
+
+/// Компактное представление диаграммы в памяти.
+///
+/// Точки разбиваются на тайлы - отрезки подряд идущих номеров точек.
+/// Грань хранится в тайле меньшей из своих точек, грани тайла сгруппированы
+/// по этой точке, поэтому ее номер в грани не хранится. Вторая точка и вершины
+/// грани задаются 16-битными номерами внутри тайла: свои точки тайла нумеруются
+/// подряд, точки других тайлов - через небольшую таблицу глобальных номеров.
+/// Точки и вершины квантуются в 16-битные координаты относительно начала тайла
+/// с шагом (размер тайла) / 65535. Вершина, общая для граней разных тайлов,
+/// хранится в каждом из них.
+///
+/// Грань занимает 6 байт вместо 16, вершина и точка - 4 байта вместо 8.
+/// Тайлы получаются компактными в пространстве, если соседние по номеру точки
+/// близки, например после построения с Voronoi::REORDER_SITES. Для точек в
+/// случайном порядке тайл занимает всю область, растут таблица глобальных
+/// номеров и шаг квантования.
+///
+/// Доступ к точкам, вершинам и граням - с декодированием на лету.
+/// Номера вершин в гранях - номера вершин компактного представления.
+/// Для каждой грани site1 <= site2 (равны у граней вдоль границы области),
+/// вершины переставляются вместе с точками, поэтому взаимное расположение
+/// точек относительно грани сохраняется.
+class CompactDiagram
+{
+public:
+  CompactDiagram();
+
+  /// Построить компактное представление диаграммы.
+  /// @return false, если точка или вершина грани не существует
+  /// или грани одной точки не помещаются в тайл.
+  bool Build(const geometry::Rect &rect, const std::vector<glm::vec2> &sites,
+             const std::vector<glm::vec2> &vertex, const std::vector<Voronoi::Edge> &edges);
+
+  /// Освободить память.
+  void Clear();
+
+  /// Вернуть ограничивающую область диаграммы.
+  const geometry::Rect &GetRect() const;
+
+  size_t GetSiteCount() const;
+  size_t GetVertexCount() const;
+  size_t GetEdgeCount() const;
+  size_t GetTileCount() const;
+
+  /// Декодировать точку, вершину или грань.
+  glm::vec2 GetSite(unsigned int site) const;
+  glm::vec2 GetVertex(unsigned int vertex) const;
+  Voronoi::Edge GetEdge(unsigned int edge) const;
+
+  /// Декодировать все списки.
+  void Unpack(std::vector<glm::vec2> &sites, std::vector<glm::vec2> &vertex,
+              std::vector<Voronoi::Edge> &edges) const;
+
+  /// Занятая память в байтах.
+  size_t GetMemorySize() const;
+
+private:
+  /// Грань внутри тайла. Первая точка грани определяется по mOffsets.
+  struct Edge
+  {
+    uint16_t site2;
+    uint16_t vertex1;
+    uint16_t vertex2;
+  };
+
+  struct Tile
+  {
+    /// Начало координат и шаг квантования.
+    glm::vec2 origin;
+    glm::vec2 step;
+    /// Первая точка тайла и число точек.
+    unsigned int siteBegin;
+    unsigned int siteCount;
+    /// Начало вершин, граней, смещений граней точек и глобальных номеров.
+    unsigned int vertexBegin;
+    unsigned int edgeBegin;
+    unsigned int offsetBegin;
+    unsigned int remapBegin;
+  };
+
+  /// Наибольшее число точек, вершин и граней в тайле.
+  static const unsigned int TILE_LIMIT = 65535;
+
+  /// Тайл, содержащий точку, вершину или грань.
+  const Tile &FindTile(unsigned int index, unsigned int Tile::*begin) const;
+
+  glm::vec2 Decode(const Tile &tile, const uint16_t *q) const;
+
+  geometry::Rect mRect;
+  std::vector<Tile> mTiles;
+  /// Координаты точек и вершин, по 2 числа.
+  std::vector<uint16_t> mSites;
+  std::vector<uint16_t> mVertex;
+  std::vector<Edge> mEdges;
+  /// Для каждой точки тайла - начало ее граней относительно первой грани тайла,
+  /// siteCount + 1 элементов на тайл.
+  std::vector<uint16_t> mOffsets;
+  /// Глобальные номера точек других тайлов.
+  std::vector<unsigned int> mRemap;
+};
+
+#endif // COMPACT_H
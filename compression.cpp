@@ -0,0 +1,898 @@
+#include "compression.h"
+
+#include "parallel.h"
+#include "lodepng/lodepng.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace
+{
+  const unsigned int WINDOW_SIZE = 32768;
+  const unsigned int WINDOW_MASK = WINDOW_SIZE - 1;
+  const unsigned int HASH_BITS = 15;
+  const unsigned int HASH_SIZE = 1 << HASH_BITS;
+  const unsigned int MIN_MATCH = 3;
+  const unsigned int MAX_MATCH = 258;
+  const unsigned int MAX_STORED = 65535;
+  const unsigned int BLOCK_SYMBOLS = 1 << 16;
+  const size_t CHUNK_SIZE = 1 << 20;
+
+  const unsigned int LITLEN_CODES = 286;
+  const unsigned int DIST_CODES = 30;
+  const unsigned int CLEN_CODES = 19;
+  const unsigned int END_BLOCK = 256;
+
+  const unsigned short LENGTH_BASE[29] =
+    {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  const unsigned char LENGTH_EXTRA[29] =
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  const unsigned short DIST_BASE[30] =
+    {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+     513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  const unsigned char DIST_EXTRA[30] =
+    {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+     8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  const unsigned char CLEN_ORDER[CLEN_CODES] =
+    {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+  /// Параметры поиска совпадений для уровня сжатия.
+  struct Params
+  {
+    unsigned int chain;   ///< Максимальная длина просматриваемой цепочки.
+    unsigned int nice;    ///< Длина совпадения, после которой поиск прекращается.
+    bool lazy;            ///< Ленивое сопоставление.
+    bool skip;            ///< Не добавлять в хеш позиции внутри совпадения.
+    bool dynamic;         ///< Использовать динамические коды Хаффмана.
+  };
+
+  Params GetParams(compression::Level level)
+  {
+    switch(level)
+    {
+    case compression::FAST:
+      return Params{4, 32, false, true, false};
+    case compression::MAX:
+      return Params{1024, MAX_MATCH, true, false, true};
+    default:
+      return Params{32, 128, true, false, true};
+    }
+  }
+
+  /// Таблицы кодов длин и расстояний.
+  struct CodeTables
+  {
+    unsigned char lengthCode[MAX_MATCH + 1];
+    unsigned char distCode[512];
+
+    CodeTables()
+    {
+      for(unsigned int code = 0; code < 29; ++code)
+      {
+        const unsigned int end = code == 28 ? MAX_MATCH + 1 : LENGTH_BASE[code + 1];
+        for(unsigned int len = LENGTH_BASE[code]; len < end; ++len)
+        {
+          lengthCode[len] = static_cast<unsigned char>(code);
+        }
+      }
+      // Коды для расстояний до 256 хранятся напрямую,
+      // для больших расстояний - по старшим битам (dist - 1) >> 7.
+      for(unsigned int code = 0; code < DIST_CODES; ++code)
+      {
+        const unsigned int end = code == DIST_CODES - 1 ? WINDOW_SIZE + 1 : DIST_BASE[code + 1];
+        for(unsigned int dist = DIST_BASE[code]; dist < end; ++dist)
+        {
+          if(dist <= 256)
+          {
+            distCode[dist - 1] = static_cast<unsigned char>(code);
+          }
+          else
+          {
+            distCode[256 + ((dist - 1) >> 7)] = static_cast<unsigned char>(code);
+          }
+        }
+      }
+    }
+
+    unsigned int DistCode(unsigned int dist) const
+    {
+      return dist <= 256 ? distCode[dist - 1] : distCode[256 + ((dist - 1) >> 7)];
+    }
+  };
+
+  const CodeTables &Tables()
+  {
+    static const CodeTables tables;
+    return tables;
+  }
+
+  /// Побитовая запись в поток, младшие биты первыми.
+  class BitWriter
+  {
+  public:
+    BitWriter(std::vector<unsigned char> &out)
+      : mOut(out), mBits(0), mCount(0)
+    {}
+
+    void Put(unsigned int value, unsigned int count)
+    {
+      assert(count <= 32);
+      mBits |= static_cast<uint64_t>(value) << mCount;
+      mCount += count;
+      while(mCount >= 8)
+      {
+        mOut.push_back(static_cast<unsigned char>(mBits));
+        mBits >>= 8;
+        mCount -= 8;
+      }
+    }
+
+    /// Дописать неполный байт.
+    void Align()
+    {
+      if(mCount > 0)
+      {
+        mOut.push_back(static_cast<unsigned char>(mBits));
+      }
+      mBits = 0;
+      mCount = 0;
+    }
+
+    std::vector<unsigned char> &Out()
+    {
+      return mOut;
+    }
+
+  private:
+    std::vector<unsigned char> &mOut;
+    uint64_t mBits;
+    unsigned int mCount;
+  };
+
+  /// Код Хаффмана: длины и перевернутые канонические коды.
+  struct HuffmanCode
+  {
+    std::vector<unsigned char> lengths;
+    std::vector<unsigned short> codes;
+  };
+
+  unsigned int ReverseBits(unsigned int code, unsigned int length)
+  {
+    unsigned int result = 0;
+    for(unsigned int i = 0; i < length; ++i)
+    {
+      result = (result << 1) | (code & 1);
+      code >>= 1;
+    }
+    return result;
+  }
+
+  /// Построить канонические коды по длинам.
+  void BuildCodes(HuffmanCode &huffman)
+  {
+    unsigned int count[16] = {0};
+    unsigned int next[16] = {0};
+    for(auto it = huffman.lengths.begin(); it != huffman.lengths.end(); ++it)
+    {
+      ++count[*it];
+    }
+    count[0] = 0;
+    unsigned int code = 0;
+    for(unsigned int bits = 1; bits < 16; ++bits)
+    {
+      code = (code + count[bits - 1]) << 1;
+      next[bits] = code;
+    }
+    huffman.codes.assign(huffman.lengths.size(), 0);
+    for(size_t i = 0; i < huffman.lengths.size(); ++i)
+    {
+      const unsigned int length = huffman.lengths[i];
+      if(length)
+      {
+        huffman.codes[i] = static_cast<unsigned short>(ReverseBits(next[length]++, length));
+      }
+    }
+  }
+
+  /// Построить длины кодов Хаффмана с ограничением максимальной длины.
+  /// Всегда используется не меньше двух символов, чтобы код был полным.
+  void BuildLengths(const std::vector<unsigned int> &freq, unsigned int maxBits, HuffmanCode &huffman)
+  {
+    const unsigned int size = static_cast<unsigned int>(freq.size());
+    huffman.lengths.assign(size, 0);
+
+    std::vector<unsigned int> symbols;
+    for(unsigned int i = 0; i < size; ++i)
+    {
+      if(freq[i])
+      {
+        symbols.push_back(i);
+      }
+    }
+    for(unsigned int i = 0; symbols.size() < 2 && i < size; ++i)
+    {
+      if(!freq[i])
+      {
+        symbols.push_back(i);
+      }
+    }
+
+    // Сортируем символы по убыванию частоты.
+    std::stable_sort(symbols.begin(), symbols.end(), [&freq](unsigned int a, unsigned int b)
+    {
+      return freq[a] > freq[b];
+    });
+
+    // Строим дерево Хаффмана. Листья - первые symbols.size() узлов.
+    const unsigned int leaves = static_cast<unsigned int>(symbols.size());
+    std::vector<unsigned int> parent(leaves * 2 - 1, 0);
+    typedef std::pair<uint64_t, unsigned int> Node;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node> > queue;
+    for(unsigned int i = 0; i < leaves; ++i)
+    {
+      queue.push(Node(std::max(freq[symbols[i]], 1u), i));
+    }
+    unsigned int node = leaves;
+    while(queue.size() > 1)
+    {
+      Node a = queue.top();
+      queue.pop();
+      Node b = queue.top();
+      queue.pop();
+      parent[a.second] = node;
+      parent[b.second] = node;
+      queue.push(Node(a.first + b.first, node));
+      ++node;
+    }
+
+    // Глубины узлов. Родитель всегда создан позже детей.
+    std::vector<unsigned int> depth(node, 0);
+    unsigned int count[64] = {0};
+    for(unsigned int i = node - 1; i-- > 0;)
+    {
+      depth[i] = depth[parent[i]] + 1;
+      if(i < leaves)
+      {
+        ++count[std::min(depth[i], 63u)];
+      }
+    }
+
+    // Ограничиваем длину кодов, сохраняя неравенство Крафта.
+    for(unsigned int i = maxBits + 1; i < 64; ++i)
+    {
+      count[maxBits] += count[i];
+      count[i] = 0;
+    }
+    uint64_t total = 0;
+    for(unsigned int i = maxBits; i > 0; --i)
+    {
+      total += static_cast<uint64_t>(count[i]) << (maxBits - i);
+    }
+    while(total != (static_cast<uint64_t>(1) << maxBits))
+    {
+      --count[maxBits];
+      for(unsigned int i = maxBits - 1; i > 0; --i)
+      {
+        if(count[i])
+        {
+          --count[i];
+          count[i + 1] += 2;
+          break;
+        }
+      }
+      --total;
+    }
+
+    // Самым частым символам - самые короткие коды.
+    unsigned int symbol = 0;
+    for(unsigned int bits = 1; bits <= maxBits; ++bits)
+    {
+      for(unsigned int i = 0; i < count[bits]; ++i)
+      {
+        huffman.lengths[symbols[symbol++]] = static_cast<unsigned char>(bits);
+      }
+    }
+    assert(symbol == leaves);
+
+    BuildCodes(huffman);
+  }
+
+  const HuffmanCode &FixedLitLen()
+  {
+    static const HuffmanCode code = []()
+    {
+      HuffmanCode huffman;
+      huffman.lengths.assign(288, 8);
+      std::fill(huffman.lengths.begin() + 144, huffman.lengths.begin() + 256, 9);
+      std::fill(huffman.lengths.begin() + 256, huffman.lengths.begin() + 280, 7);
+      BuildCodes(huffman);
+      return huffman;
+    }();
+    return code;
+  }
+
+  const HuffmanCode &FixedDist()
+  {
+    static const HuffmanCode code = []()
+    {
+      HuffmanCode huffman;
+      huffman.lengths.assign(DIST_CODES, 5);
+      BuildCodes(huffman);
+      return huffman;
+    }();
+    return code;
+  }
+
+  /// Символ LZ77: литерал (dist == 0) или совпадение длины length на расстоянии dist.
+  struct Symbol
+  {
+    unsigned short length;
+    unsigned short dist;
+    Symbol(unsigned int l, unsigned int d)
+      : length(static_cast<unsigned short>(l)), dist(static_cast<unsigned short>(d))
+    {}
+    bool IsLiteral() const
+    {
+      return dist == 0;
+    }
+  };
+
+  /// Код длин кодов: символ 0..18 и значение дополнительных бит.
+  struct ClenSymbol
+  {
+    unsigned char symbol;
+    unsigned char extra;
+  };
+
+  void WriteStored(BitWriter &writer, const unsigned char *data, size_t size)
+  {
+    do
+    {
+      const unsigned int length = static_cast<unsigned int>(std::min<size_t>(size, MAX_STORED));
+      writer.Put(0, 3);
+      writer.Align();
+      std::vector<unsigned char> &out = writer.Out();
+      out.push_back(static_cast<unsigned char>(length));
+      out.push_back(static_cast<unsigned char>(length >> 8));
+      out.push_back(static_cast<unsigned char>(~length));
+      out.push_back(static_cast<unsigned char>(~length >> 8));
+      out.insert(out.end(), data, data + length);
+      data += length;
+      size -= length;
+    }
+    while(size > 0);
+  }
+
+  size_t StoredBits(size_t size)
+  {
+    return (std::max<size_t>((size + MAX_STORED - 1) / MAX_STORED, 1) * 5 + size) * 8;
+  }
+
+  /// Стоимость блока в битах без заголовка.
+  size_t SymbolsBits(const std::vector<unsigned int> &litFreq, const std::vector<unsigned int> &distFreq,
+                     const HuffmanCode &litlen, const HuffmanCode &dist)
+  {
+    size_t bits = 0;
+    for(unsigned int i = 0; i < LITLEN_CODES; ++i)
+    {
+      bits += static_cast<size_t>(litFreq[i]) * litlen.lengths[i];
+      if(i > END_BLOCK)
+      {
+        bits += static_cast<size_t>(litFreq[i]) * LENGTH_EXTRA[i - END_BLOCK - 1];
+      }
+    }
+    for(unsigned int i = 0; i < DIST_CODES; ++i)
+    {
+      bits += static_cast<size_t>(distFreq[i]) * (dist.lengths[i] + DIST_EXTRA[i]);
+    }
+    return bits;
+  }
+
+  void WriteSymbols(BitWriter &writer, const std::vector<Symbol> &symbols,
+                    const HuffmanCode &litlen, const HuffmanCode &dist)
+  {
+    const CodeTables &tables = Tables();
+    for(auto it = symbols.begin(); it != symbols.end(); ++it)
+    {
+      if((*it).IsLiteral())
+      {
+        writer.Put(litlen.codes[(*it).length], litlen.lengths[(*it).length]);
+        continue;
+      }
+      const unsigned int lc = tables.lengthCode[(*it).length];
+      writer.Put(litlen.codes[END_BLOCK + 1 + lc], litlen.lengths[END_BLOCK + 1 + lc]);
+      writer.Put((*it).length - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+
+      const unsigned int d = (*it).dist;
+      const unsigned int dc = tables.DistCode(d);
+      writer.Put(dist.codes[dc], dist.lengths[dc]);
+      writer.Put(d - DIST_BASE[dc], DIST_EXTRA[dc]);
+    }
+    writer.Put(litlen.codes[END_BLOCK], litlen.lengths[END_BLOCK]);
+  }
+
+  /// Закодировать длины кодов алгоритмом RLE (символы 16, 17, 18).
+  void EncodeLengths(const std::vector<unsigned char> &lengths, std::vector<ClenSymbol> &out)
+  {
+    for(size_t i = 0; i < lengths.size();)
+    {
+      const unsigned char value = lengths[i];
+      size_t run = 1;
+      while(i + run < lengths.size() && lengths[i + run] == value)
+      {
+        ++run;
+      }
+      i += run;
+
+      if(value == 0)
+      {
+        while(run >= 11)
+        {
+          const size_t n = std::min<size_t>(run, 138);
+          out.push_back(ClenSymbol{18, static_cast<unsigned char>(n - 11)});
+          run -= n;
+        }
+        if(run >= 3)
+        {
+          out.push_back(ClenSymbol{17, static_cast<unsigned char>(run - 3)});
+          run = 0;
+        }
+      }
+      else
+      {
+        out.push_back(ClenSymbol{value, 0});
+        --run;
+        while(run >= 3)
+        {
+          const size_t n = std::min<size_t>(run, 6);
+          out.push_back(ClenSymbol{16, static_cast<unsigned char>(n - 3)});
+          run -= n;
+        }
+      }
+      for(; run > 0; --run)
+      {
+        out.push_back(ClenSymbol{value, 0});
+      }
+    }
+  }
+
+  /// Записать блок с наименьшей стоимостью: stored, фиксированный или динамический.
+  void WriteBlock(BitWriter &writer, const std::vector<Symbol> &symbols,
+                  const unsigned char *data, size_t size, const Params &params)
+  {
+    const CodeTables &tables = Tables();
+    std::vector<unsigned int> litFreq(LITLEN_CODES, 0);
+    std::vector<unsigned int> distFreq(DIST_CODES, 0);
+    for(auto it = symbols.begin(); it != symbols.end(); ++it)
+    {
+      if((*it).IsLiteral())
+      {
+        ++litFreq[(*it).length];
+      }
+      else
+      {
+        ++litFreq[END_BLOCK + 1 + tables.lengthCode[(*it).length]];
+        ++distFreq[tables.DistCode((*it).dist)];
+      }
+    }
+    litFreq[END_BLOCK] = 1;
+
+    const size_t storedBits = StoredBits(size);
+    const size_t fixedBits = 3 + SymbolsBits(litFreq, distFreq, FixedLitLen(), FixedDist());
+
+    if(!params.dynamic)
+    {
+      if(storedBits < fixedBits)
+      {
+        WriteStored(writer, data, size);
+        return;
+      }
+      writer.Put(0, 1);
+      writer.Put(1, 2);
+      WriteSymbols(writer, symbols, FixedLitLen(), FixedDist());
+      return;
+    }
+
+    HuffmanCode litlen;
+    HuffmanCode dist;
+    BuildLengths(litFreq, 15, litlen);
+    BuildLengths(distFreq, 15, dist);
+
+    unsigned int hlit = LITLEN_CODES;
+    while(hlit > 257 && litlen.lengths[hlit - 1] == 0)
+    {
+      --hlit;
+    }
+    unsigned int hdist = DIST_CODES;
+    while(hdist > 1 && dist.lengths[hdist - 1] == 0)
+    {
+      --hdist;
+    }
+
+    std::vector<unsigned char> lengths(litlen.lengths.begin(), litlen.lengths.begin() + hlit);
+    lengths.insert(lengths.end(), dist.lengths.begin(), dist.lengths.begin() + hdist);
+    std::vector<ClenSymbol> clens;
+    EncodeLengths(lengths, clens);
+
+    std::vector<unsigned int> clenFreq(CLEN_CODES, 0);
+    for(auto it = clens.begin(); it != clens.end(); ++it)
+    {
+      ++clenFreq[(*it).symbol];
+    }
+    HuffmanCode clen;
+    BuildLengths(clenFreq, 7, clen);
+
+    unsigned int hclen = CLEN_CODES;
+    while(hclen > 4 && clen.lengths[CLEN_ORDER[hclen - 1]] == 0)
+    {
+      --hclen;
+    }
+
+    size_t dynamicBits = 3 + 5 + 5 + 4 + 3 * hclen + SymbolsBits(litFreq, distFreq, litlen, dist);
+    for(auto it = clens.begin(); it != clens.end(); ++it)
+    {
+      dynamicBits += clen.lengths[(*it).symbol];
+      dynamicBits += (*it).symbol == 16 ? 2 : (*it).symbol == 17 ? 3 : (*it).symbol == 18 ? 7 : 0;
+    }
+
+    if(storedBits <= fixedBits && storedBits <= dynamicBits)
+    {
+      WriteStored(writer, data, size);
+      return;
+    }
+    if(fixedBits <= dynamicBits)
+    {
+      writer.Put(0, 1);
+      writer.Put(1, 2);
+      WriteSymbols(writer, symbols, FixedLitLen(), FixedDist());
+      return;
+    }
+
+    writer.Put(0, 1);
+    writer.Put(2, 2);
+    writer.Put(hlit - 257, 5);
+    writer.Put(hdist - 1, 5);
+    writer.Put(hclen - 4, 4);
+    for(unsigned int i = 0; i < hclen; ++i)
+    {
+      writer.Put(clen.lengths[CLEN_ORDER[i]], 3);
+    }
+    for(auto it = clens.begin(); it != clens.end(); ++it)
+    {
+      writer.Put(clen.codes[(*it).symbol], clen.lengths[(*it).symbol]);
+      if((*it).symbol == 16)
+      {
+        writer.Put((*it).extra, 2);
+      }
+      else if((*it).symbol == 17)
+      {
+        writer.Put((*it).extra, 3);
+      }
+      else if((*it).symbol == 18)
+      {
+        writer.Put((*it).extra, 7);
+      }
+    }
+    WriteSymbols(writer, symbols, litlen, dist);
+  }
+
+  /// Поиск совпадений по хеш-цепочкам внутри окна.
+  class Matcher
+  {
+  public:
+    Matcher(const unsigned char *data, size_t size, const Params &params)
+      : mData(data), mSize(size), mParams(params), mHashed(0),
+        mHead(HASH_SIZE, -1), mPrev(WINDOW_SIZE, -1)
+    {}
+
+    /// Найти самое длинное совпадение для позиции pos.
+    /// Все позиции до pos включительно добавляются в хеш.
+    /// @return Длина совпадения и расстояние до него. Длина 0, если совпадения нет.
+    std::pair<unsigned int, unsigned int> Find(size_t pos)
+    {
+      while(mHashed < pos)
+      {
+        Insert(mHashed++);
+      }
+
+      unsigned int bestLength = 0;
+      unsigned int bestDist = 0;
+      if(pos + MIN_MATCH <= mSize)
+      {
+        const unsigned int maxLength = static_cast<unsigned int>(std::min<size_t>(MAX_MATCH, mSize - pos));
+        const unsigned char *current = mData + pos;
+        ptrdiff_t candidate = mHead[Hash(pos)];
+        for(unsigned int chain = mParams.chain; candidate >= 0 && chain > 0; --chain)
+        {
+          const size_t dist = pos - static_cast<size_t>(candidate);
+          if(dist > WINDOW_SIZE)
+          {
+            break;
+          }
+          const unsigned char *match = mData + candidate;
+          if(match[bestLength] == current[bestLength] && match[0] == current[0])
+          {
+            unsigned int length = 0;
+            while(length < maxLength && match[length] == current[length])
+            {
+              ++length;
+            }
+            if(length > bestLength)
+            {
+              bestLength = length;
+              bestDist = static_cast<unsigned int>(dist);
+              if(length >= mParams.nice || length == maxLength)
+              {
+                break;
+              }
+            }
+          }
+          const ptrdiff_t next = mPrev[candidate & WINDOW_MASK];
+          if(next >= candidate)
+          {
+            break;
+          }
+          candidate = next;
+        }
+      }
+
+      Insert(pos);
+      mHashed = pos + 1;
+
+      if(bestLength < MIN_MATCH)
+      {
+        bestLength = 0;
+      }
+      return std::make_pair(bestLength, bestDist);
+    }
+
+    /// Пропустить позиции до pos, не добавляя их в хеш.
+    void Skip(size_t pos)
+    {
+      mHashed = std::max(mHashed, pos);
+    }
+
+  private:
+    unsigned int Hash(size_t pos) const
+    {
+      const uint32_t value = mData[pos] | (mData[pos + 1] << 8) | (mData[pos + 2] << 16);
+      return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void Insert(size_t pos)
+    {
+      if(pos + MIN_MATCH > mSize)
+      {
+        return;
+      }
+      const unsigned int hash = Hash(pos);
+      mPrev[pos & WINDOW_MASK] = mHead[hash];
+      mHead[hash] = static_cast<ptrdiff_t>(pos);
+    }
+
+    const unsigned char *mData;
+    const size_t mSize;
+    const Params mParams;
+    size_t mHashed;
+    std::vector<ptrdiff_t> mHead;
+    std::vector<ptrdiff_t> mPrev;
+  };
+}
+
+void compression::CompressChunk(const unsigned char *data, size_t size, Level level, bool last,
+                            std::vector<unsigned char> &out)
+{
+  BitWriter writer(out);
+
+  if(level == STORE)
+  {
+    if(size > 0)
+    {
+      WriteStored(writer, data, size);
+    }
+  }
+  else
+  {
+    const Params params = GetParams(level);
+    Matcher matcher(data, size, params);
+
+    std::vector<Symbol> symbols;
+    symbols.reserve(BLOCK_SYMBOLS + 1);
+    size_t blockStart = 0;
+
+    for(size_t pos = 0; pos < size;)
+    {
+      std::pair<unsigned int, unsigned int> match = matcher.Find(pos);
+
+      // Если со следующей позиции совпадение длиннее, выводим литерал и берем его.
+      if(params.lazy)
+      {
+        while(match.first > 0 && match.first < params.nice && pos + 1 < size)
+        {
+          std::pair<unsigned int, unsigned int> next = matcher.Find(pos + 1);
+          if(next.first <= match.first)
+          {
+            break;
+          }
+          symbols.push_back(Symbol(data[pos], 0));
+          ++pos;
+          match = next;
+        }
+      }
+
+      if(match.first > 0)
+      {
+        symbols.push_back(Symbol(match.first, match.second));
+        pos += match.first;
+        if(params.skip)
+        {
+          matcher.Skip(pos);
+        }
+      }
+      else
+      {
+        symbols.push_back(Symbol(data[pos], 0));
+        ++pos;
+      }
+
+      if(symbols.size() >= BLOCK_SYMBOLS || pos >= size)
+      {
+        WriteBlock(writer, symbols, data + blockStart, pos - blockStart, params);
+        symbols.clear();
+        blockStart = pos;
+      }
+    }
+  }
+
+  if(last)
+  {
+    // Пустой финальный блок с фиксированными кодами.
+    writer.Put(1, 1);
+    writer.Put(1, 2);
+    writer.Put(FixedLitLen().codes[END_BLOCK], FixedLitLen().lengths[END_BLOCK]);
+  }
+  else
+  {
+    // Пустой stored блок выравнивает поток по байту.
+    writer.Put(0, 3);
+    writer.Align();
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0xFF);
+    out.push_back(0xFF);
+  }
+  writer.Align();
+}
+
+bool compression::Decompress(const unsigned char *data, size_t size, std::vector<unsigned char> &out)
+{
+  return lodepng::decompress(out, data, size) == 0;
+}
+
+void compression::ZlibHeader(Level level, std::vector<unsigned char> &out)
+{
+  // CMF: deflate, окно 32K. FLG: уровень сжатия и проверочные биты.
+  out.push_back(0x78);
+  switch(level)
+  {
+  case STORE:
+  case FAST:
+    out.push_back(0x01);
+    break;
+  case MAX:
+    out.push_back(0xDA);
+    break;
+  default:
+    out.push_back(0x9C);
+    break;
+  }
+}
+
+void compression::Compress(const unsigned char *data, size_t size, Level level,
+                       std::vector<unsigned char> &out, unsigned int threads)
+{
+  const size_t chunks = std::max<size_t>((size + CHUNK_SIZE - 1) / CHUNK_SIZE, 1);
+
+  std::vector<std::vector<unsigned char> > parts(chunks);
+  std::vector<unsigned int> adler(chunks, 1);
+
+  ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      const size_t offset = i * CHUNK_SIZE;
+      const size_t length = std::min(CHUNK_SIZE, size - std::min(offset, size));
+      CompressChunk(data + offset, length, level, i + 1 == chunks, parts[i]);
+      adler[i] = Adler32(data + offset, length);
+    }
+  }, threads);
+
+  ZlibHeader(level, out);
+  unsigned int checksum = adler[0];
+  for(size_t i = 0; i < chunks; ++i)
+  {
+    if(i > 0)
+    {
+      checksum = Adler32Combine(checksum, adler[i], std::min(CHUNK_SIZE, size - i * CHUNK_SIZE));
+    }
+    out.insert(out.end(), parts[i].begin(), parts[i].end());
+    std::vector<unsigned char>().swap(parts[i]);
+  }
+  out.push_back(static_cast<unsigned char>(checksum >> 24));
+  out.push_back(static_cast<unsigned char>(checksum >> 16));
+  out.push_back(static_cast<unsigned char>(checksum >> 8));
+  out.push_back(static_cast<unsigned char>(checksum));
+}
+
+unsigned int compression::Adler32(const unsigned char *data, size_t size, unsigned int adler)
+{
+  const unsigned int BASE = 65521;
+  // Наибольшее количество байт, при котором сумма не переполняет 32 бита.
+  const size_t NMAX = 5552;
+
+  unsigned int s1 = adler & 0xFFFF;
+  unsigned int s2 = adler >> 16;
+  while(size > 0)
+  {
+    const size_t length = std::min(size, NMAX);
+    for(size_t i = 0; i < length; ++i)
+    {
+      s1 += data[i];
+      s2 += s1;
+    }
+    s1 %= BASE;
+    s2 %= BASE;
+    data += length;
+    size -= length;
+  }
+  return (s2 << 16) | s1;
+}
+
+unsigned int compression::Adler32Combine(unsigned int adler1, unsigned int adler2, size_t size2)
+{
+  const unsigned int BASE = 65521;
+
+  const unsigned int rem = static_cast<unsigned int>(size2 % BASE);
+  unsigned int sum1 = adler1 & 0xFFFF;
+  unsigned int sum2 = static_cast<unsigned int>((static_cast<uint64_t>(rem) * sum1) % BASE);
+  sum1 += (adler2 & 0xFFFF) + BASE - 1;
+  sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + BASE - rem;
+  if(sum1 >= BASE) sum1 -= BASE;
+  if(sum1 >= BASE) sum1 -= BASE;
+  if(sum2 >= (BASE << 1)) sum2 -= (BASE << 1);
+  if(sum2 >= BASE) sum2 -= BASE;
+  return sum1 | (sum2 << 16);
+}
+
+unsigned int compression::Crc32(const unsigned char *data, size_t size, unsigned int crc)
+{
+  struct Table
+  {
+    unsigned int values[256];
+    Table()
+    {
+      for(unsigned int n = 0; n < 256; ++n)
+      {
+        unsigned int c = n;
+        for(int k = 0; k < 8; ++k)
+        {
+          c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        values[n] = c;
+      }
+    }
+  };
+  static const Table table;
+
+  crc = ~crc;
+  for(size_t i = 0; i < size; ++i)
+  {
+    crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
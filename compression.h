@@ -0,0 +1,53 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <vector>
+
+/// Сжатие в формате deflate/zlib.
+/// Данные можно разбивать на независимые куски и сжимать их параллельно:
+/// каждый кусок заканчивается выравнивающим пустым блоком, поэтому
+/// сжатые куски просто склеиваются в один поток.
+namespace compression
+{
+  /// Уровень сжатия.
+  enum Level
+  {
+    STORE,    ///< Без сжатия.
+    FAST,     ///< Короткий поиск совпадений, фиксированные коды Хаффмана.
+    DEFAULT,  ///< Ленивый поиск совпадений, динамические коды Хаффмана.
+    MAX,      ///< Длинный поиск совпадений, динамические коды Хаффмана.
+  };
+
+  /// Сжать кусок данных в raw deflate поток и дописать его в out.
+  /// Совпадения ищутся только внутри куска.
+  /// @param last Последний ли кусок в потоке. Если нет, кусок заканчивается
+  /// пустым stored блоком и выравнивается по байту.
+  void CompressChunk(const unsigned char *data, size_t size, Level level, bool last,
+                     std::vector<unsigned char> &out);
+
+  /// Сжать данные в zlib поток.
+  /// Данные разбиваются на куски, которые сжимаются параллельно.
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  void Compress(const unsigned char *data, size_t size, Level level,
+                std::vector<unsigned char> &out, unsigned int threads = 0);
+
+  /// Распаковать zlib поток.
+  /// @return false, если поток поврежден.
+  bool Decompress(const unsigned char *data, size_t size, std::vector<unsigned char> &out);
+
+  /// Заголовок zlib потока для заданного уровня.
+  void ZlibHeader(Level level, std::vector<unsigned char> &out);
+
+  /// Контрольная сумма Adler-32.
+  unsigned int Adler32(const unsigned char *data, size_t size, unsigned int adler = 1);
+
+  /// Объединить суммы Adler-32 двух соседних кусков.
+  /// @param size2 Размер второго куска.
+  unsigned int Adler32Combine(unsigned int adler1, unsigned int adler2, size_t size2);
+
+  /// Контрольная сумма CRC-32.
+  unsigned int Crc32(const unsigned char *data, size_t size, unsigned int crc = 0);
+}
+
+#endif // COMPRESSION_H
@@ -0,0 +1,387 @@
+#include "export.h"
+#include "storage.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+  /// Списки граней каждой ячейки в одном массиве.
+  class CellIndex
+  {
+  public:
+    CellIndex(const Voronoi &diagram)
+      : mEdges(diagram.GetEdges())
+    {
+      storage::BuildCellEdges(mEdges, diagram.GetSites().size(), mOffsets, mCellEdges);
+    }
+
+    const unsigned int *Begin(unsigned int site) const
+    {
+      return mCellEdges.data() + mOffsets[site];
+    }
+
+    const unsigned int *End(unsigned int site) const
+    {
+      return mCellEdges.data() + mOffsets[site + 1];
+    }
+
+    /// Собрать замкнутый контур ячейки.
+    /// @param ring Индексы вершин контура без повтора первой вершины.
+    /// @return false, если грани ячейки не образуют замкнутый контур.
+    bool Ring(unsigned int site, std::vector<unsigned int> &ring)
+    {
+      ring.clear();
+      const unsigned int *begin = Begin(site);
+      const unsigned int count = static_cast<unsigned int>(End(site) - begin);
+      if(count < 3)
+      {
+        return false;
+      }
+
+      mUsed.assign(count, false);
+      mUsed[0] = true;
+      ring.push_back(mEdges[begin[0]].vertex1);
+      unsigned int current = mEdges[begin[0]].vertex2;
+
+      for(unsigned int step = 1; step < count; ++step)
+      {
+        unsigned int next = count;
+        for(unsigned int i = 0; i < count; ++i)
+        {
+          if(!mUsed[i] && (mEdges[begin[i]].vertex1 == current || mEdges[begin[i]].vertex2 == current))
+          {
+            next = i;
+            break;
+          }
+        }
+        if(next == count)
+        {
+          return false;
+        }
+        mUsed[next] = true;
+        ring.push_back(current);
+        const Voronoi::Edge &edge = mEdges[begin[next]];
+        current = edge.vertex1 == current ? edge.vertex2 : edge.vertex1;
+      }
+
+      return current == ring.front();
+    }
+
+  private:
+    const std::vector<Voronoi::Edge> &mEdges;
+    std::vector<unsigned int> mOffsets;
+    std::vector<unsigned int> mCellEdges;
+    std::vector<bool> mUsed;
+  };
+
+  /// Удвоенная ориентированная площадь контура.
+  double RingArea(const std::vector<glm::vec2> &vertex, const std::vector<unsigned int> &ring)
+  {
+    double area = 0.0;
+    for(size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+    {
+      const glm::vec2 &a = vertex[ring[j]];
+      const glm::vec2 &b = vertex[ring[i]];
+      area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+    }
+    return area;
+  }
+
+  /// Количество отрезков в одном элементе path.
+  const unsigned int SVG_PATH_SEGMENTS = 1024;
+
+  void SvgPoint(BufferedFile &file, char command, const glm::vec2 &point, unsigned int precision)
+  {
+    char prefix[2] = {command, 0};
+    file.Write(prefix, 1);
+    file.WriteFixed(point.x, precision);
+    file.Write(" ", 1);
+    file.WriteFixed(point.y, precision);
+  }
+
+  void JsonPoint(BufferedFile &file, const glm::vec2 &point, unsigned int precision)
+  {
+    file.Write("[", 1);
+    file.WriteFixed(point.x, precision);
+    file.Write(",", 1);
+    file.WriteFixed(point.y, precision);
+    file.Write("]", 1);
+  }
+}
+
+BufferedFile::BufferedFile(const std::string &fileName, size_t bufferSize)
+  : mBuffer(std::max<size_t>(bufferSize, 64)), mSize(0)
+{
+  mFile = fopen(fileName.c_str(), "wb");
+  mGood = mFile != nullptr;
+}
+
+BufferedFile::~BufferedFile()
+{
+  if(mFile)
+  {
+    Flush();
+    fclose(mFile);
+  }
+}
+
+bool BufferedFile::IsGood() const
+{
+  return mGood;
+}
+
+void BufferedFile::Write(const char *data, size_t size)
+{
+  if(mSize + size > mBuffer.size())
+  {
+    Flush();
+    if(size > mBuffer.size())
+    {
+      if(mFile && fwrite(data, 1, size, mFile) != size)
+      {
+        mGood = false;
+      }
+      return;
+    }
+  }
+  memcpy(&mBuffer[mSize], data, size);
+  mSize += size;
+}
+
+void BufferedFile::Write(const char *str)
+{
+  Write(str, strlen(str));
+}
+
+void BufferedFile::WriteInt(long long value)
+{
+  char text[24];
+  char *end = text + sizeof(text);
+  char *p = end;
+  unsigned long long v = value < 0 ? 0ull - static_cast<unsigned long long>(value) : value;
+  do
+  {
+    *--p = static_cast<char>('0' + v % 10);
+    v /= 10;
+  }
+  while(v);
+  if(value < 0)
+  {
+    *--p = '-';
+  }
+  Write(p, end - p);
+}
+
+void BufferedFile::WriteFixed(double value, unsigned int precision)
+{
+  static const long long POW10[] =
+    {1ll, 10ll, 100ll, 1000ll, 10000ll, 100000ll, 1000000ll, 10000000ll, 100000000ll, 1000000000ll};
+  precision = std::min(precision, 9u);
+  assert(value == value);
+
+  const double scaled = value * static_cast<double>(POW10[precision]);
+  if(!(fabs(scaled) < 9.0e18))
+  {
+    // Значение не помещается в целое, печатаем как есть.
+    char text[64];
+    int size = snprintf(text, sizeof(text), "%.*e", precision, value);
+    Write(text, size > 0 ? static_cast<size_t>(size) : 0);
+    return;
+  }
+
+  long long fixed = llround(scaled);
+  if(fixed < 0)
+  {
+    Write("-", 1);
+    fixed = -fixed;
+  }
+  WriteInt(fixed / POW10[precision]);
+
+  long long fraction = fixed % POW10[precision];
+  if(fraction == 0)
+  {
+    return;
+  }
+  char text[16];
+  text[0] = '.';
+  unsigned int digits = precision;
+  while(fraction % 10 == 0)
+  {
+    fraction /= 10;
+    --digits;
+  }
+  for(unsigned int i = digits; i > 0; --i)
+  {
+    text[i] = static_cast<char>('0' + fraction % 10);
+    fraction /= 10;
+  }
+  Write(text, digits + 1);
+}
+
+void BufferedFile::Flush()
+{
+  if(mFile && mSize > 0 && fwrite(mBuffer.data(), 1, mSize, mFile) != mSize)
+  {
+    mGood = false;
+  }
+  mSize = 0;
+}
+
+bool ExportSvg(const Voronoi &diagram, const std::string &fileName, ExportMode mode, unsigned int precision)
+{
+  BufferedFile file(fileName);
+  if(!file.IsGood())
+  {
+    return false;
+  }
+
+  const geometry::Rect &rect = diagram.GetRect();
+  const std::vector<glm::vec2> &vertex = diagram.GetVertex();
+  const std::vector<Voronoi::Edge> &edges = diagram.GetEdges();
+
+  file.Write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"");
+  file.WriteFixed(rect.lb.x, precision);
+  file.Write(" ");
+  file.WriteFixed(rect.lb.y, precision);
+  file.Write(" ");
+  file.WriteFixed(rect.rt.x - rect.lb.x, precision);
+  file.Write(" ");
+  file.WriteFixed(rect.rt.y - rect.lb.y, precision);
+  // Отражаем ось y, чтобы она была направлена вверх.
+  file.Write("\">\n<g transform=\"matrix(1 0 0 -1 0 ");
+  file.WriteFixed(rect.lb.y + rect.rt.y, precision);
+  file.Write(")\" fill=\"none\" stroke=\"#00FF00\" stroke-width=\"0.5\">\n");
+
+  if(mode == EXPORT_EDGES)
+  {
+    for(size_t i = 0; i < edges.size(); ++i)
+    {
+      file.Write(i % SVG_PATH_SEGMENTS == 0 ? "<path d=\"" : " ");
+      SvgPoint(file, 'M', vertex[edges[i].vertex1], precision);
+      SvgPoint(file, 'L', vertex[edges[i].vertex2], precision);
+      if(i % SVG_PATH_SEGMENTS == SVG_PATH_SEGMENTS - 1 || i + 1 == edges.size())
+      {
+        file.Write("\"/>\n");
+      }
+    }
+  }
+  else
+  {
+    CellIndex cells(diagram);
+    std::vector<unsigned int> ring;
+    for(unsigned int site = 0; site < diagram.GetSites().size(); ++site)
+    {
+      if(cells.Begin(site) == cells.End(site))
+      {
+        continue;
+      }
+      file.Write("<path d=\"");
+      if(cells.Ring(site, ring))
+      {
+        for(size_t i = 0; i < ring.size(); ++i)
+        {
+          SvgPoint(file, i == 0 ? 'M' : 'L', vertex[ring[i]], precision);
+        }
+        file.Write("Z");
+      }
+      else
+      {
+        for(const unsigned int *it = cells.Begin(site); it != cells.End(site); ++it)
+        {
+          SvgPoint(file, 'M', vertex[edges[*it].vertex1], precision);
+          SvgPoint(file, 'L', vertex[edges[*it].vertex2], precision);
+        }
+      }
+      file.Write("\"/>\n");
+    }
+  }
+
+  file.Write("</g>\n</svg>\n");
+  file.Flush();
+  return file.IsGood();
+}
+
+bool ExportGeoJson(const Voronoi &diagram, const std::string &fileName, ExportMode mode, unsigned int precision)
+{
+  BufferedFile file(fileName);
+  if(!file.IsGood())
+  {
+    return false;
+  }
+
+  const std::vector<glm::vec2> &vertex = diagram.GetVertex();
+  const std::vector<Voronoi::Edge> &edges = diagram.GetEdges();
+
+  file.Write("{\"type\":\"FeatureCollection\",\"features\":[");
+
+  if(mode == EXPORT_EDGES)
+  {
+    for(size_t i = 0; i < edges.size(); ++i)
+    {
+      file.Write(i == 0 ? "\n" : ",\n");
+      file.Write("{\"type\":\"Feature\",\"properties\":{\"site1\":");
+      file.WriteInt(edges[i].site1);
+      file.Write(",\"site2\":");
+      file.WriteInt(edges[i].site2);
+      file.Write("},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[");
+      JsonPoint(file, vertex[edges[i].vertex1], precision);
+      file.Write(",");
+      JsonPoint(file, vertex[edges[i].vertex2], precision);
+      file.Write("]}}");
+    }
+  }
+  else
+  {
+    CellIndex cells(diagram);
+    std::vector<unsigned int> ring;
+    bool first = true;
+    for(unsigned int site = 0; site < diagram.GetSites().size(); ++site)
+    {
+      if(cells.Begin(site) == cells.End(site))
+      {
+        continue;
+      }
+      file.Write(first ? "\n" : ",\n");
+      first = false;
+      file.Write("{\"type\":\"Feature\",\"properties\":{\"site\":");
+      file.WriteInt(site);
+      if(cells.Ring(site, ring))
+      {
+        // Внешний контур полигона в GeoJSON обходится против часовой стрелки.
+        if(RingArea(vertex, ring) < 0.0)
+        {
+          std::reverse(ring.begin(), ring.end());
+        }
+        file.Write("},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[");
+        for(size_t i = 0; i < ring.size(); ++i)
+        {
+          JsonPoint(file, vertex[ring[i]], precision);
+          file.Write(",");
+        }
+        JsonPoint(file, vertex[ring.front()], precision);
+        file.Write("]]}}");
+      }
+      else
+      {
+        file.Write("},\"geometry\":{\"type\":\"MultiLineString\",\"coordinates\":[");
+        for(const unsigned int *it = cells.Begin(site); it != cells.End(site); ++it)
+        {
+          file.Write(it == cells.Begin(site) ? "[" : ",[");
+          JsonPoint(file, vertex[edges[*it].vertex1], precision);
+          file.Write(",");
+          JsonPoint(file, vertex[edges[*it].vertex2], precision);
+          file.Write("]");
+        }
+        file.Write("]}}");
+      }
+    }
+  }
+
+  file.Write("\n]}\n");
+  file.Flush();
+  return file.IsGood();
+}
@@ -0,0 +1,74 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "Voronoi.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/// Буферизованная запись в файл.
+/// Числа форматируются без iostream и без учета локали.
+class BufferedFile
+{
+public:
+  /// Открыть файл на запись.
+  /// @param bufferSize Размер буфера. Буфер сбрасывается в файл по заполнении.
+  BufferedFile(const std::string &fileName, size_t bufferSize = 1 << 16);
+
+  /// Сбросить буфер и закрыть файл.
+  ~BufferedFile();
+
+  /// Открыт ли файл и не было ли ошибок записи.
+  bool IsGood() const;
+
+  /// Записать строку.
+  void Write(const char *data, size_t size);
+  void Write(const char *str);
+
+  /// Записать целое число.
+  void WriteInt(long long value);
+
+  /// Записать число с фиксированным количеством знаков после запятой.
+  /// Незначащие нули в дробной части отбрасываются.
+  void WriteFixed(double value, unsigned int precision);
+
+  /// Сбросить буфер в файл.
+  void Flush();
+
+private:
+  BufferedFile(const BufferedFile &);
+  BufferedFile &operator=(const BufferedFile &);
+
+  FILE *mFile;
+  std::vector<char> mBuffer;
+  size_t mSize;
+  bool mGood;
+};
+
+/// Что экспортировать.
+enum ExportMode
+{
+  /// Грани диаграммы отрезками.
+  EXPORT_EDGES,
+  /// Ячейки диаграммы полигонами. Незамкнутые ячейки (на границе
+  /// прямоугольной области) выводятся ломаными из их граней. В области-
+  /// многоугольнике ячейки замкнуты гранями границы.
+  EXPORT_CELLS,
+};
+
+/// Записать диаграмму в SVG.
+/// Ось y направлена вверх, как в Image.
+/// @param precision Количество знаков после запятой в координатах.
+/// @return false, если файл не удалось записать.
+bool ExportSvg(const Voronoi &diagram, const std::string &fileName,
+               ExportMode mode = EXPORT_EDGES, unsigned int precision = 2);
+
+/// Записать диаграмму в GeoJSON (FeatureCollection).
+/// Грани выводятся как LineString со свойствами site1 и site2,
+/// ячейки - как Polygon или MultiLineString со свойством site.
+/// @param precision Количество знаков после запятой в координатах.
+/// @return false, если файл не удалось записать.
+bool ExportGeoJson(const Voronoi &diagram, const std::string &fileName,
+                   ExportMode mode = EXPORT_EDGES, unsigned int precision = 6);
+
+#endif // EXPORT_H
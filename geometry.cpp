@@ -1,200 +1,137 @@
 #include "geometry.h"
+#include "predicates.h"
 
 #include <assert.h> // Переделать на исключения
 
 #include <functional>
 #include <list>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 #define EPS 0.0001
 
-double geometry::RotationPoint(const Point &a, const Point &b, const Point &c)
+template<class T>
+T geometry::RotationPoint(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c)
 {
   return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
 }
 
-bool geometry::RectContainsPoint(const Rect &rect, const Point &point)
+template<class T>
+bool geometry::RectContainsPoint(const BasicRect<T> &rect, const BasicPoint<T> &point)
 {
-  return point.x >= (rect.lb.x - EPS) && point.x <= (rect.rt.x + EPS) && 
-    point.y >= (rect.lb.y - EPS) && point.y <= (rect.rt.y + EPS);
+  const T eps = static_cast<T>(EPS);
+  return point.x >= (rect.lb.x - eps) && point.x <= (rect.rt.x + eps) && 
+    point.y >= (rect.lb.y - eps) && point.y <= (rect.rt.y + eps);
 }
 
 
-bool geometry::IsIntersectionLine(const Line &a, const Line &b)
+template<class T>
+bool geometry::IsIntersectionLine(const BasicLine<T> &a, const BasicLine<T> &b)
 {
-  return a.a * b.b - b.a * a.b != 0.0;
+  return a.a * b.b - b.a * a.b != 0;
 }
 
-double geometry::FindLineX(const Line &line, double y)
+template<class T>
+T geometry::FindLineX(const BasicLine<T> &line, T y)
 {
   assert(LineContainsX(line));
   return (- line.c - line.b * y) / line.a;
 }
 
-double geometry::FindLineY(const Line &line, double x)
+template<class T>
+T geometry::FindLineY(const BasicLine<T> &line, T x)
 {
   assert(LineContainsY(line));
   return (- line.c - line.a * x) / line.b;
 }
 
-geometry::Point geometry::IntersectLines(const Line &a, const Line &b)
+template<class T>
+geometry::BasicPoint<T> geometry::IntersectLines(const BasicLine<T> &a, const BasicLine<T> &b)
 {
-  Point p;
-  double k = a.a * b.b - b.a * a.b;
+  BasicPoint<T> p;
+  T k = a.a * b.b - b.a * a.b;
   p.x = (b.c * a.b - a.c * b.b) / k;
   p.y = (a.c * b.a - b.c * a.a) / k;
   return p;
 }
 
-bool geometry::LineContainsX(const Line &line)
+template<class T>
+bool geometry::LineContainsX(const BasicLine<T> &line)
 {
-  return line.a != 0.0;
+  return line.a != 0;
 }
 
-bool geometry::LineContainsY(const Line &line)
+template<class T>
+bool geometry::LineContainsY(const BasicLine<T> &line)
 {
-  return line.b != 0.0;
+  return line.b != 0;
 }
 
-std::vector<geometry::Point> geometry::IntersectRectLine(const Rect &rect, const Line &line)
+template<class T>
+std::vector<geometry::BasicPoint<T> > geometry::IntersectRectLine(const BasicRect<T> &rect, const BasicLine<T> &line)
 {
-  // Примечание. Желательно в конце удалять одинаковые точки.
-  // Возникает в случае, если линия проходит через угол.
-  std::vector<Point> points;
-  points.reserve(4);
-
-  // Создаем прямые, проходащие через стороны ректа.
-  Point lb(rect.lb);
-  Point lt(rect.lb.x, rect.rt.y);
-  Point rt(rect.rt);
-  Point rb(rect.rt.x, rect.lb.y);
-  Line sides[4] = {Line(lb, lt), Line(lt, rt), Line(rt, rb), Line(rb, lb)};
-
-  // Ищем точки пересечения линий.
-  for(int i = 0; i < 4; ++i)
+  std::vector<BasicPoint<T> > points;
+  BasicSegment<T> segment;
+  if(ClipRectLine(rect, line, segment))
   {
-    if(IsIntersectionLine(line, sides[i]))
-    {
-      points.push_back(IntersectLines(line, sides[i]));
-    }
+    points.push_back(segment.a);
+    points.push_back(segment.b);
   }
-
-  for(auto it = points.begin(); it != points.end();)
-  {
-    // Если точка не лежит в области, удалим ее.
-    if(!RectContainsPoint(rect, *it))
-    {
-      it = points.erase(it);
-    }
-    else
-    {
-      ++it;
-    }
-  }
-
-  DublicatePoints(points);
-  assert(points.size() <= 2);
-
-  if(points.size() < 2)
-  {
-    return std::move(std::vector<Point>());
-  }
-
-  return std::move(points);
+  return points;
 }
 
-geometry::Line geometry::Perpendicular(const Line &line, const Point &point)
+template<class T>
+geometry::BasicLine<T> geometry::Perpendicular(const BasicLine<T> &line, const BasicPoint<T> &point)
 {
-  return Line(-line.b, line.a, line.b * point.x - line.a * point.y);
+  return BasicLine<T>(-line.b, line.a, line.b * point.x - line.a * point.y);
 }
 
-geometry::Point geometry::Center(const Point &a, const Point &b)
+template<class T>
+geometry::BasicPoint<T> geometry::Center(const BasicPoint<T> &a, const BasicPoint<T> &b)
 {
-  return Point((b.x + a.x) / 2.0, (b.y + a.y) / 2.0);
+  return BasicPoint<T>((b.x + a.x) / 2, (b.y + a.y) / 2);
 }
 
-geometry::Ray geometry::PerpRayLine(const Ray &ray, const Line &line)
+template<class T>
+geometry::BasicRay<T> geometry::PerpRayLine(const BasicRay<T> &ray, const BasicLine<T> &line)
 {
   // Строим перпендикулярную линию, проходящую через начало луча.
-  Line perp(Perpendicular(line, ray.point));
+  BasicLine<T> perp(Perpendicular(line, ray.point));
   // Строим еще один перпендикуляр к perp, проходящий через точку направления луча.
-  Line par(Perpendicular(perp, ray.dir));
+  BasicLine<T> par(Perpendicular(perp, ray.dir));
   // Ищем точку пересечения перпендикуляров.
-  Point p(IntersectLines(perp, par));
+  BasicPoint<T> p(IntersectLines(perp, par));
   // Теперь у нас есть луч, перпендикулярный заданной прямой, направленный по заданному лучу.
-  return Ray(ray.point, p);
+  return BasicRay<T>(ray.point, p);
 }
 
-std::vector<geometry::Point> geometry::IntersectRectRay(const Rect &rect, const Ray &ray)
+template<class T>
+std::vector<geometry::BasicPoint<T> > geometry::IntersectRectRay(const BasicRect<T> &rect, const BasicRay<T> &ray)
 {
-  std::vector<Point> points;
-  points.reserve(5);
-
-  Point lb(rect.lb);
-  Point lt(rect.lb.x, rect.rt.y);
-  Point rt(rect.rt);
-  Point rb(rect.rt.x, rect.lb.y);
-  Segment sides[4] = {Segment(lb, lt), Segment(lt, rt), Segment(rt, rb), Segment(rb, lb)};
-
-  points.push_back(ray.point);
-
-  for(int i = 0; i < 4; ++i)
-  {
-    if(IsIntersectionRaySegment(sides[i], ray))
-    {
-      points.push_back(IntersectLines(Line(ray.dir, ray.point), Line(sides[i].a, sides[i].b)));
-    }
-  }
-
-  for(auto it = points.begin(); it != points.end();)
-  {
-    // Если точка не лежит в области, удалим ее.
-    if(!RectContainsPoint(rect, *it))
-    {
-      it = points.erase(it);
-    }
-    else
-    {
-      ++it;
-    }
-  }
-
-  DublicatePoints(points);
-
-  assert(points.size() <= 2);
-  std::vector<Point> output;
-  if(points.size() < 2)
+  std::vector<BasicPoint<T> > points;
+  BasicSegment<T> segment;
+  if(ClipRectRay(rect, ray, segment))
   {
-    return std::move(output);
+    points.push_back(segment.a);
+    points.push_back(segment.b);
   }
-
-  // У нас есть 2 точки, ближняя к началу луча - начало, дальняя - конец.
-  if(glm::distance(ray.point, points[0]) < glm::distance(ray.point, points[1]))
-  {
-    output.push_back(points[0]);
-    output.push_back(points[1]);
-  }
-  else
-  {
-    output.push_back(points[1]);
-    output.push_back(points[0]);
-  }
-
-  return std::move(output);
+  return points;
 }
 
-bool geometry::IsIntersectionRaySegment(const Segment &segment, const Ray &ray)
+template<class T>
+bool geometry::IsIntersectionRaySegment(const BasicSegment<T> &segment, const BasicRay<T> &ray)
 {
-  Line line(segment.a, segment.b);
+  BasicLine<T> line(segment.a, segment.b);
   // Строим перпендикулярную линию, проходящую через начало луча.
-  Line perp(Perpendicular(line, ray.point));
+  BasicLine<T> perp(Perpendicular(line, ray.point));
   // Ищем точку пересечения перпендикуляра и линии.
-  Point p(IntersectLines(line, perp));
+  BasicPoint<T> p(IntersectLines(line, perp));
 
-  glm::dvec2 a(p.x - ray.point.x, p.y - ray.point.y);
-  glm::dvec2 b(ray.dir.x - ray.point.x, ray.dir.y - ray.point.y);
+  BasicPoint<T> a(p.x - ray.point.x, p.y - ray.point.y);
+  BasicPoint<T> b(ray.dir.x - ray.point.x, ray.dir.y - ray.point.y);
 
-  double cosa = (a.x * b.x + a.y * b.y) / (sqrt(a.x * a.x + a.y * a.y) * sqrt(b.x * b.x + b.y * b.y));
+  T cosa = (a.x * b.x + a.y * b.y) / (std::sqrt(a.x * a.x + a.y * a.y) * std::sqrt(b.x * b.x + b.y * b.y));
 
   if(cosa < 0)
   {
@@ -202,13 +139,14 @@ bool geometry::IsIntersectionRaySegment(const Segment &segment, const Ray &ray)
     return false;
   }
 
-  double t1 = RotationPoint(ray.point, ray.dir, segment.a);
-  double t2 = RotationPoint(ray.point, ray.dir, segment.b);
+  double t1 = predicates::Orient2d(ray.point, ray.dir, segment.a);
+  double t2 = predicates::Orient2d(ray.point, ray.dir, segment.b);
 
   return (t1 >= 0.0 && t2 <= 0.0) || (t2 >= 0.0 && t1 <= 0.0);
 }
 
-double geometry::IntersectParabols(double sl, const Point &p1, const Point &p2)
+template<class T>
+T geometry::IntersectParabols(T sl, const BasicPoint<T> &p1, const BasicPoint<T> &p2)
 {
   // Если фокус параболы лежит на заметающей прямой, они пересекаются там,
   // где находится эта парабола по x.
@@ -220,161 +158,435 @@ double geometry::IntersectParabols(double sl, const Point &p1, const Point &p2)
   {
     return p2.x;
   }
-  const double a = p2.y - p1.y;
-  if(a != 0)
-  {
-    const double b = p2.x * p1.y - p1.x * p2.y + sl * (p1.x - p2.x);
 
-    const double x12 = p1.x * p1.x;
-    const double y12 = p1.y * p1.y;
-    const double x22 = p2.x * p2.x;
-    const double y22 = p2.y * p2.y;
+  // Считаем относительно фокуса p1 и заметающей прямой: x = p1.x + u,
+  // h1 и h2 - высоты фокусов над прямой. Квадраты абсолютных координат
+  // не появляются, поэтому точности хватает и в float.
+  const T h1 = p1.y - sl;
+  const T h2 = p2.y - sl;
+  const T dx = p2.x - p1.x;
 
-    const double c = (sl * sl + p1.y * p2.y) * (p1.y - p2.y) +
-               sl * (x22 + y22 - x12 - y12) +
-               x12 * p2.y - x22 * p1.y;
+  const T a = h2 - h1;
+  if(a != 0)
+  {
+    //a * (u * u) + 2 * b * u + c = 0;
+    const T b = h1 * dx;
+    const T c = h1 * (h2 * (h1 - h2) - dx * dx);
 
-    //y = a * (x * x) + 2 * b * x + c;
-    const double d4 = b * b - a * c;
-    assert(d4 >= 0);
-    const double x1 = (-b + sqrt(d4)) / (a);
-    const double x2 = (-b - sqrt(d4)) / (a);
+    // Параболы с фокусами над заметающей прямой всегда пересекаются,
+    // отрицательный дискриминант возможен только из-за округления.
+    const T d4 = std::max(b * b - a * c, T(0));
 
-    // Нам не нужны координаты по y
-    //double y1 = (pow((x1 - p1.x), 2) + p1.y * p1.y - sl * sl) / (2 * (p1.y - sl));
-    //double y2 = (pow((x2 - p1.x), 2) + p1.y * p1.y - sl * sl) / (2 * (p1.y - sl));
+    // Корни без вычитания близких чисел: q / a и c / q.
+    const T q = b < 0 ? -b + std::sqrt(d4) : -b - std::sqrt(d4);
+    const T u1 = q / a;
+    const T u2 = q != 0 ? c / q : u1;
 
-    const double leftx = x1 < x2 ? x1 : x2;
-    const double rightx = x1 < x2 ? x2 : x1;
+    const T leftu = u1 < u2 ? u1 : u2;
+    const T rightu = u1 < u2 ? u2 : u1;
 
     // Мы получили отрезок, при чем отрезок расположен слева направо.
     if(p1.y > p2.y)
     {
-      return leftx;
+      return p1.x + leftu;
     }
     else
     {
-      return rightx;
+      return p1.x + rightu;
     }
   }
 
 
   // Если фокусы парабол на одном уровне, они пересекаются по x в центре между фокусами.
-  const double x = (p1.x + p2.x) / 2;
-
-  //double y = (p1.y + p2.y) / 2;
-  //double y = (pow(x - p1.x, 2.0) + p1.y * p1.y - sl * sl) / (2 * (p1.y - sl));
+  const T x = (p1.x + p2.x) / 2;
 
   return x;
 }
 
-geometry::Point geometry::CreateCircle(const Point &a, const Point &b, const Point &c)
+namespace
 {
-  const double x1 = a.x;
-  const double y1 = a.y;
-  const double x2 = b.x;
-  const double y2 = b.y;
-  const double x3 = c.x;
-  const double y3 = c.y;
+  // Центр окружности по трем точкам в double.
+  glm::dvec2 CircleCenter(const glm::dvec2 &a, const glm::dvec2 &b, const glm::dvec2 &c)
+  {
+    // Считаем относительно точки a, чтобы не возводить в квадрат абсолютные координаты.
+    const double bx = b.x - a.x;
+    const double by = b.y - a.y;
+    const double cx = c.x - a.x;
+    const double cy = c.y - a.y;
 
-  const double xy3 = x3 * x3 + y3 * y3;
-  const double xy1 = x1 * x1 + y1 * y1;
-  const double xy2 = x2 * x2 + y2 * y2;
+    const double bb = bx * bx + by * by;
+    const double cc = cx * cx + cy * cy;
 
-  const double zx = (y1 - y2) * (xy3) + (y2 - y3) * (xy1) + (y3 - y1) * (xy2);
-  const double zy = (x1 - x2) * (xy3) + (x2 - x3) * (xy1) + (x3 - x1) * (xy2);
-  const double z  = (x1 - x2) * (y3 - y1) - (y1 - y2) * (x3 - x1);
+    // Знаменатель с точным знаком. Для почти коллинеарных точек обычное вычисление
+    // может дать 0 или неверный знак.
+    const double z = 2 * predicates::Orient2d(a, b, c);
 
-  assert(z != 0);
+    assert(z != 0);
 
-  return Point(-(zx) / (2 * z), (zy) / (2 * z));
+    return glm::dvec2(a.x + (cy * bb - by * cc) / z, a.y + (bx * cc - cx * bb) / z);
+  }
 }
 
-std::vector<geometry::Point> geometry::IntersectRectSegment(const Rect &rect, const Segment &segment)
+template<class T>
+geometry::BasicPoint<T> geometry::CreateCircle(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c)
 {
-  std::vector<Point> points;
-  points.reserve(6);
+  return BasicPoint<T>(CircleCenter(glm::dvec2(a), glm::dvec2(b), glm::dvec2(c)));
+}
 
-  points.push_back(segment.a);
-  points.push_back(segment.b);
+template<class T>
+T geometry::CircleBottom(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c)
+{
+  const glm::dvec2 center = CircleCenter(glm::dvec2(a), glm::dvec2(b), glm::dvec2(c));
+  const double dx = b.x - center.x;
+  const double dy = b.y - center.y;
+  return static_cast<T>(center.y - std::sqrt(dx * dx + dy * dy));
+}
 
-  // Создаем прямые, проходящие через стороны ректа.
-  Point lb(rect.lb);
-  Point lt(rect.lb.x, rect.rt.y);
-  Point rt(rect.rt);
-  Point rb(rect.rt.x, rect.lb.y);
-  Line sides[4] = {Line(lb, lt), Line(lt, rt), Line(rt, rb), Line(rb, lb)};
-  Line line(segment.a, segment.b);
+template<class T>
+std::vector<geometry::BasicPoint<T> > geometry::IntersectRectSegment(const BasicRect<T> &rect, const BasicSegment<T> &segment)
+{
+  std::vector<BasicPoint<T> > points;
+  BasicSegment<T> clipped;
+  if(ClipRectSegment(rect, segment, clipped))
+  {
+    points.push_back(clipped.a);
+    points.push_back(clipped.b);
+  }
+  return points;
+}
+
+namespace
+{
+  // Отсечение прямой o + d * t, t из [t0, t1], областью по Лиангу-Барски.
+  // Записано без ветвлений, чтобы цикл по массиву векторизовался.
+  template<class T>
+  inline bool ClipParametric(const geometry::BasicRect<T> &rect, const geometry::BasicPoint<T> &o,
+                             const geometry::BasicPoint<T> &d, T &t0, T &t1)
+  {
+    const T eps = static_cast<T>(EPS);
+    const T inf = std::numeric_limits<T>::infinity();
+
+    // Если направление параллельно оси, по этой оси параметр не ограничен,
+    // достаточно, чтобы прямая лежала в полосе области.
+    const bool zx = d.x == 0;
+    const bool zy = d.y == 0;
+    const bool inx = (o.x >= rect.lb.x - eps) & (o.x <= rect.rt.x + eps);
+    const bool iny = (o.y >= rect.lb.y - eps) & (o.y <= rect.rt.y + eps);
+
+    const T dx = zx ? T(1) : d.x;
+    const T dy = zy ? T(1) : d.y;
+    const T ax = (rect.lb.x - o.x) / dx;
+    const T bx = (rect.rt.x - o.x) / dx;
+    const T ay = (rect.lb.y - o.y) / dy;
+    const T by = (rect.rt.y - o.y) / dy;
+
+    const T lox = zx ? -inf : std::min(ax, bx);
+    const T hix = zx ? inf : std::max(ax, bx);
+    const T loy = zy ? -inf : std::min(ay, by);
+    const T hiy = zy ? inf : std::max(ay, by);
+
+    t0 = std::max(t0, std::max(lox, loy));
+    t1 = std::min(t1, std::min(hix, hiy));
+
+    return (!zx | inx) & (!zy | iny) & (t0 < t1);
+  }
+
+  // Совпадают ли концы отрезка (так же, как в DublicatePoints).
+  template<class T>
+  inline bool IsDegenerate(const geometry::BasicPoint<T> &a, const geometry::BasicPoint<T> &b)
+  {
+    return (glm::abs(a.x - b.x) < EPS) & (glm::abs(a.y - b.y) < EPS);
+  }
+
+  template<class T>
+  inline bool ClipSegment(const geometry::BasicRect<T> &rect, const geometry::BasicSegment<T> &segment,
+                          geometry::BasicSegment<T> &out)
+  {
+    const geometry::BasicPoint<T> d = segment.b - segment.a;
+    T t0 = 0;
+    T t1 = 1;
+    const bool hit = ClipParametric(rect, segment.a, d, t0, t1);
+
+    // Неотсеченные концы берем как есть, чтобы не терять точность на a + d.
+    out.a.x = t0 == 0 ? segment.a.x : segment.a.x + d.x * t0;
+    out.a.y = t0 == 0 ? segment.a.y : segment.a.y + d.y * t0;
+    out.b.x = t1 == 1 ? segment.b.x : segment.a.x + d.x * t1;
+    out.b.y = t1 == 1 ? segment.b.y : segment.a.y + d.y * t1;
+    return hit & !IsDegenerate<T>(out.a, out.b);
+  }
 
-  // Ищем точки пересечения линий.
-  for(int i = 0; i < 4; ++i)
+  template<class T>
+  inline bool ClipRay(const geometry::BasicRect<T> &rect, const geometry::BasicRay<T> &ray,
+                      geometry::BasicSegment<T> &out)
   {
-    if(IsIntersectionLine(line, sides[i]))
+    const geometry::BasicPoint<T> d = ray.dir - ray.point;
+    T t0 = 0;
+    T t1 = std::numeric_limits<T>::infinity();
+    const bool hit = ClipParametric(rect, ray.point, d, t0, t1);
+
+    out.a.x = t0 == 0 ? ray.point.x : ray.point.x + d.x * t0;
+    out.a.y = t0 == 0 ? ray.point.y : ray.point.y + d.y * t0;
+    out.b = ray.point + d * t1;
+    return hit & !IsDegenerate<T>(out.a, out.b);
+  }
+}
+
+namespace
+{
+  // Отсечение прямой o + d * t, t из [t0, t1], выпуклым многоугольником по Кирусу-Беку.
+  // Каждая сторона ограничивает параметр с одной стороны, как пара границ области
+  // в ClipParametric.
+  template<class T>
+  inline bool ClipConvexParametric(const geometry::BasicPoint<T> *polygon, size_t count,
+                                   const geometry::BasicPoint<T> &o, const geometry::BasicPoint<T> &d,
+                                   T &t0, T &t1)
+  {
+    assert(count >= 3);
+    const T eps = static_cast<T>(EPS);
+    for(size_t i = 0; i < count; ++i)
     {
-      points.push_back(IntersectLines(line, sides[i]));
+      const geometry::BasicPoint<T> &a = polygon[i];
+      const geometry::BasicPoint<T> &b = polygon[i + 1 == count ? 0 : i + 1];
+
+      // Внутренняя нормаль стороны длиной в сторону. Для точек многоугольника num >= 0.
+      const geometry::BasicPoint<T> n(a.y - b.y, b.x - a.x);
+      const T num = n.x * (o.x - a.x) + n.y * (o.y - a.y);
+      const T den = n.x * d.x + n.y * d.y;
+      if(den == 0)
+      {
+        // Прямая параллельна стороне и должна лежать по внутреннюю сторону от нее.
+        if(num < -eps * glm::length(n))
+        {
+          return false;
+        }
+        continue;
+      }
+
+      const T t = -num / den;
+      if(den > 0)
+      {
+        t0 = std::max(t0, t);
+      }
+      else
+      {
+        t1 = std::min(t1, t);
+      }
     }
+    return t0 < t1;
   }
+}
 
-  Rect sr = CreateRect(segment);
+template<class T>
+bool geometry::ConvexContainsPoint(const BasicPoint<T> *polygon, size_t count, const BasicPoint<T> &point)
+{
+  assert(count >= 3);
+  const T eps = static_cast<T>(EPS);
 
-  // Оставляем только те точки, которые входят в оба ректа.
-  for(auto it = points.begin(); it != points.end();)
+  // Лежит ли точка по внутреннюю сторону от стороны i.
+  auto inside = [&](size_t i) -> bool
+  {
+    const BasicPoint<T> &a = polygon[i];
+    const BasicPoint<T> &b = polygon[i + 1 == count ? 0 : i + 1];
+    const BasicPoint<T> n(a.y - b.y, b.x - a.x);
+    return n.x * (point.x - a.x) + n.y * (point.y - a.y) >= -eps * glm::length(n);
+  };
+
+  // Веер треугольников из первой вершины: точка между первой и последней
+  // сторонами попадает в треугольник, найденный двоичным поиском, и
+  // проверяется только по его стороне многоугольника.
+  if(!inside(0) || !inside(count - 1))
   {
-    if(!RectContainsPoint(rect, *it) || !RectContainsPoint(sr, *it))
+    return false;
+  }
+  const BasicPoint<T> &o = polygon[0];
+  size_t lo = 1;
+  size_t hi = count - 1;
+  while(hi - lo > 1)
+  {
+    const size_t mid = (lo + hi) / 2;
+    const BasicPoint<T> &m = polygon[mid];
+    if((m.x - o.x) * (point.y - o.y) - (m.y - o.y) * (point.x - o.x) >= 0)
     {
-      it = points.erase(it);
+      lo = mid;
     }
     else
     {
-      ++it;
+      hi = mid;
     }
   }
+  return inside(lo);
+}
+
+template<class T>
+bool geometry::ClipConvexLine(const BasicPoint<T> *polygon, size_t count, const BasicLine<T> &line,
+                              BasicSegment<T> &out)
+{
+  const T nn = line.a * line.a + line.b * line.b;
+  if(nn == 0)
+  {
+    return false;
+  }
+
+  // Начало параметризации - проекция центра вершин многоугольника на прямую.
+  BasicPoint<T> center(0, 0);
+  for(size_t i = 0; i < count; ++i)
+  {
+    center += polygon[i];
+  }
+  center /= static_cast<T>(count);
+  const T k = (line.a * center.x + line.b * center.y + line.c) / nn;
+  const BasicPoint<T> o(center.x - line.a * k, center.y - line.b * k);
+  const BasicPoint<T> d(line.b, -line.a);
+
+  T t0 = -std::numeric_limits<T>::infinity();
+  T t1 = std::numeric_limits<T>::infinity();
+  if(!ClipConvexParametric(polygon, count, o, d, t0, t1))
+  {
+    return false;
+  }
+
+  out.a = o + d * t0;
+  out.b = o + d * t1;
+  if(IsDegenerate<T>(out.a, out.b))
+  {
+    return false;
+  }
+
+  // Сверху вниз, затем справа налево.
+  if(out.a.y < out.b.y || (out.a.y == out.b.y && out.a.x < out.b.x))
+  {
+    std::swap(out.a, out.b);
+  }
+  return true;
+}
+
+template<class T>
+bool geometry::ClipConvexRay(const BasicPoint<T> *polygon, size_t count, const BasicRay<T> &ray,
+                             BasicSegment<T> &out)
+{
+  const BasicPoint<T> d = ray.dir - ray.point;
+  T t0 = 0;
+  T t1 = std::numeric_limits<T>::infinity();
+  if(!ClipConvexParametric(polygon, count, ray.point, d, t0, t1))
+  {
+    return false;
+  }
 
-  DublicatePoints(points);
+  out.a = t0 == 0 ? ray.point : ray.point + d * t0;
+  out.b = ray.point + d * t1;
+  return !IsDegenerate<T>(out.a, out.b);
+}
 
-  assert(points.size() <= 2);
-  std::vector<Point> output;
-  if(points.size() < 2)
+template<class T>
+bool geometry::ClipConvexSegment(const BasicPoint<T> *polygon, size_t count, const BasicSegment<T> &segment,
+                                 BasicSegment<T> &out)
+{
+  const BasicPoint<T> d = segment.b - segment.a;
+  T t0 = 0;
+  T t1 = 1;
+  if(!ClipConvexParametric(polygon, count, segment.a, d, t0, t1))
   {
-    return std::move(output);
+    return false;
   }
 
-  // Если точка находится внутри рабочей области, оставляем ее, 
-  // иначе ищем ближайшую к ней точку.
-  if(RectContainsPoint(rect, segment.a))
+  // Неотсеченные концы берем как есть.
+  out.a = t0 == 0 ? segment.a : segment.a + d * t0;
+  out.b = t1 == 1 ? segment.b : segment.a + d * t1;
+  return !IsDegenerate<T>(out.a, out.b);
+}
+
+template<class T>
+bool geometry::ClipRectLine(const BasicRect<T> &rect, const BasicLine<T> &line, BasicSegment<T> &out)
+{
+  const T nn = line.a * line.a + line.b * line.b;
+  if(nn == 0)
   {
-    output.push_back(segment.a);
+    return false;
   }
-  else
+
+  // Начало параметризации - проекция центра области на прямую,
+  // тогда параметры концов порядка размера области.
+  const BasicPoint<T> center = Center<T>(rect.lb, rect.rt);
+  const T k = (line.a * center.x + line.b * center.y + line.c) / nn;
+  const BasicPoint<T> o(center.x - line.a * k, center.y - line.b * k);
+  const BasicPoint<T> d(line.b, -line.a);
+
+  T t0 = -std::numeric_limits<T>::infinity();
+  T t1 = std::numeric_limits<T>::infinity();
+  if(!ClipParametric(rect, o, d, t0, t1))
   {
-    glm::distance(segment.a, points[0]) < glm::distance(segment.a, points[1]) ?
-      output.push_back(points[0]) : output.push_back(points[1]);
+    return false;
   }
-  if(RectContainsPoint(rect, segment.b))
+
+  out.a = o + d * t0;
+  out.b = o + d * t1;
+  if(IsDegenerate<T>(out.a, out.b))
   {
-    output.push_back(segment.b);
+    return false;
   }
-  else
+
+  // Сверху вниз, затем справа налево.
+  if(out.a.y < out.b.y || (out.a.y == out.b.y && out.a.x < out.b.x))
   {
-    glm::distance(segment.b, points[0]) < glm::distance(segment.b, points[1]) ?
-      output.push_back(points[0]) : output.push_back(points[1]);
+    std::swap(out.a, out.b);
   }
+  return true;
+}
 
-  return std::move(output);
+template<class T>
+bool geometry::ClipRectRay(const BasicRect<T> &rect, const BasicRay<T> &ray, BasicSegment<T> &out)
+{
+  return ClipRay(rect, ray, out);
 }
 
-geometry::Rect geometry::CreateRect(const Segment &segment)
+template<class T>
+bool geometry::ClipRectSegment(const BasicRect<T> &rect, const BasicSegment<T> &segment, BasicSegment<T> &out)
 {
-  double leftx = segment.a.x < segment.b.x ? segment.a.x : segment.b.x;
-  double rightx = segment.a.x >= segment.b.x ? segment.a.x : segment.b.x;
-  double bottomy = segment.a.y < segment.b.y ? segment.a.y : segment.b.y;
-  double topy = segment.a.y >= segment.b.y ? segment.a.y : segment.b.y;
+  return ClipSegment(rect, segment, out);
+}
 
-  return Rect(Point(leftx, bottomy), Point(rightx, topy));
+template<class T>
+size_t geometry::ClipRectSegments(const BasicRect<T> &rect, const BasicSegment<T> *segments, size_t count,
+                                  BasicSegment<T> *out, bool *valid)
+{
+  size_t clipped = 0;
+  for(size_t i = 0; i < count; ++i)
+  {
+    valid[i] = ClipSegment(rect, segments[i], out[i]);
+    clipped += valid[i];
+  }
+  return clipped;
+}
+
+template<class T>
+size_t geometry::ClipRectRays(const BasicRect<T> &rect, const BasicRay<T> *rays, size_t count,
+                              BasicSegment<T> *out, bool *valid)
+{
+  size_t clipped = 0;
+  for(size_t i = 0; i < count; ++i)
+  {
+    valid[i] = ClipRay(rect, rays[i], out[i]);
+    clipped += valid[i];
+  }
+  return clipped;
+}
+
+template<class T>
+geometry::BasicRect<T> geometry::CreateRect(const BasicSegment<T> &segment)
+{
+  T leftx = segment.a.x < segment.b.x ? segment.a.x : segment.b.x;
+  T rightx = segment.a.x >= segment.b.x ? segment.a.x : segment.b.x;
+  T bottomy = segment.a.y < segment.b.y ? segment.a.y : segment.b.y;
+  T topy = segment.a.y >= segment.b.y ? segment.a.y : segment.b.y;
+
+  return BasicRect<T>(BasicPoint<T>(leftx, bottomy), BasicPoint<T>(rightx, topy));
 }
 
-void geometry::DublicatePoints(std::vector<Point> &points)
+template<class T>
+void geometry::DublicatePoints(std::vector<BasicPoint<T> > &points)
 {
+  typedef BasicPoint<T> Point;
+
   std::sort(points.begin(), points.end(), 
     [](const Point &p1, const Point &p2) -> bool
   {
@@ -392,7 +604,37 @@ void geometry::DublicatePoints(std::vector<Point> &points)
   points.resize(std::distance(points.begin(), it));
 }
 
-
-
-
-
+// Явные инстанцирования для float и double.
+#define GEOMETRY_INSTANTIATE(T) \
+  template T geometry::RotationPoint<T>(const BasicPoint<T> &, const BasicPoint<T> &, const BasicPoint<T> &); \
+  template bool geometry::RectContainsPoint<T>(const BasicRect<T> &, const BasicPoint<T> &); \
+  template bool geometry::IsIntersectionLine<T>(const BasicLine<T> &, const BasicLine<T> &); \
+  template T geometry::FindLineX<T>(const BasicLine<T> &, T); \
+  template T geometry::FindLineY<T>(const BasicLine<T> &, T); \
+  template geometry::BasicPoint<T> geometry::IntersectLines<T>(const BasicLine<T> &, const BasicLine<T> &); \
+  template bool geometry::LineContainsX<T>(const BasicLine<T> &); \
+  template bool geometry::LineContainsY<T>(const BasicLine<T> &); \
+  template std::vector<geometry::BasicPoint<T> > geometry::IntersectRectLine<T>(const BasicRect<T> &, const BasicLine<T> &); \
+  template geometry::BasicLine<T> geometry::Perpendicular<T>(const BasicLine<T> &, const BasicPoint<T> &); \
+  template geometry::BasicPoint<T> geometry::Center<T>(const BasicPoint<T> &, const BasicPoint<T> &); \
+  template geometry::BasicRay<T> geometry::PerpRayLine<T>(const BasicRay<T> &, const BasicLine<T> &); \
+  template std::vector<geometry::BasicPoint<T> > geometry::IntersectRectRay<T>(const BasicRect<T> &, const BasicRay<T> &); \
+  template bool geometry::IsIntersectionRaySegment<T>(const BasicSegment<T> &, const BasicRay<T> &); \
+  template T geometry::IntersectParabols<T>(T, const BasicPoint<T> &, const BasicPoint<T> &); \
+  template geometry::BasicPoint<T> geometry::CreateCircle<T>(const BasicPoint<T> &, const BasicPoint<T> &, const BasicPoint<T> &); \
+  template T geometry::CircleBottom<T>(const BasicPoint<T> &, const BasicPoint<T> &, const BasicPoint<T> &); \
+  template std::vector<geometry::BasicPoint<T> > geometry::IntersectRectSegment<T>(const BasicRect<T> &, const BasicSegment<T> &); \
+  template bool geometry::ClipRectLine<T>(const BasicRect<T> &, const BasicLine<T> &, BasicSegment<T> &); \
+  template bool geometry::ClipRectRay<T>(const BasicRect<T> &, const BasicRay<T> &, BasicSegment<T> &); \
+  template bool geometry::ClipRectSegment<T>(const BasicRect<T> &, const BasicSegment<T> &, BasicSegment<T> &); \
+  template size_t geometry::ClipRectSegments<T>(const BasicRect<T> &, const BasicSegment<T> *, size_t, BasicSegment<T> *, bool *); \
+  template size_t geometry::ClipRectRays<T>(const BasicRect<T> &, const BasicRay<T> *, size_t, BasicSegment<T> *, bool *); \
+  template bool geometry::ConvexContainsPoint<T>(const BasicPoint<T> *, size_t, const BasicPoint<T> &); \
+  template bool geometry::ClipConvexLine<T>(const BasicPoint<T> *, size_t, const BasicLine<T> &, BasicSegment<T> &); \
+  template bool geometry::ClipConvexRay<T>(const BasicPoint<T> *, size_t, const BasicRay<T> &, BasicSegment<T> &); \
+  template bool geometry::ClipConvexSegment<T>(const BasicPoint<T> *, size_t, const BasicSegment<T> &, BasicSegment<T> &); \
+  template geometry::BasicRect<T> geometry::CreateRect<T>(const BasicSegment<T> &); \
+  template void geometry::DublicatePoints<T>(std::vector<BasicPoint<T> > &);
+
+GEOMETRY_INSTANTIATE(float)
+GEOMETRY_INSTANTIATE(double)
@@ -9,134 +9,242 @@
 namespace geometry
 {
 
-  typedef glm::dvec2 Point;
+  /// Вектор glm для скалярного типа.
+  template<class T>
+  struct Vector;
 
-  struct Rect
+  template<>
+  struct Vector<float>
   {
-    Point lb;
-    Point rt;
-    Rect()
+    typedef glm::vec2 Type;
+  };
+
+  template<>
+  struct Vector<double>
+  {
+    typedef glm::dvec2 Type;
+  };
+
+  /// Точка со скалярным типом T.
+  template<class T>
+  using BasicPoint = typename Vector<T>::Type;
+
+  template<class T>
+  struct BasicRect
+  {
+    BasicPoint<T> lb;
+    BasicPoint<T> rt;
+    BasicRect()
       : lb(), rt()
     {}
-    Rect(const Point &_lb, const Point &_rt)
+    BasicRect(const BasicPoint<T> &_lb, const BasicPoint<T> &_rt)
       : lb(_lb), rt(_rt)
     {}
-    Rect(const Rect &rect)
+    BasicRect(const BasicRect &rect)
       : lb(rect.lb), rt(rect.rt)
     {}
+    template<class U>
+    explicit BasicRect(const BasicRect<U> &rect)
+      : lb(BasicPoint<T>(rect.lb)), rt(BasicPoint<T>(rect.rt))
+    {}
   };
 
   // Описание прямой
-  struct Line
+  template<class T>
+  struct BasicLine
   {
-    double a;
-    double b;
-    double c;
-    Line()
-      : a(0.0), b(0.0), c(0.0)
+    T a;
+    T b;
+    T c;
+    BasicLine()
+      : a(0), b(0), c(0)
     {}
-    Line(double _a,double _b,double _c)
+    BasicLine(T _a, T _b, T _c)
       : a(_a), b(_b), c(_c)
     {}
-    Line(const Line &line)
+    BasicLine(const BasicLine &line)
       : a(line.a), b(line.b), c(line.c)
     {}
-    Line(const Point &_a, const Point &_b)
+    BasicLine(const BasicPoint<T> &_a, const BasicPoint<T> &_b)
       : a(_a.y - _b.y), b(_b.x - _a.x), c(_a.x * _b.y - _b.x * _a.y)
     {}
   };
 
   // Отрезок.
-  struct Segment
+  template<class T>
+  struct BasicSegment
   {
-    Point a;
-    Point b;
-    Segment()
+    BasicPoint<T> a;
+    BasicPoint<T> b;
+    BasicSegment()
       : a(), b()
     {}
-    Segment(const Point &_a, const Point &_b)
+    BasicSegment(const BasicPoint<T> &_a, const BasicPoint<T> &_b)
       : a(_a), b(_b)
     {}
-    Segment(const Segment &segment)
+    BasicSegment(const BasicSegment &segment)
       : a(segment.a), b(segment.b)
     {}
   };
 
   // Луч. Луч задается двумя точками, первая точка - начало луча, вторая точка - направление луча.
-  struct Ray
+  template<class T>
+  struct BasicRay
   {
-    Point point;
-    Point dir;
-    Ray()
+    BasicPoint<T> point;
+    BasicPoint<T> dir;
+    BasicRay()
       : point(), dir()
     {}
-    Ray(const Point &p, const Point &d)
+    BasicRay(const BasicPoint<T> &p, const BasicPoint<T> &d)
       : point(p), dir(d)
     {}
-    Ray(const Ray &ray)
+    BasicRay(const BasicRay &ray)
       : point(ray.point), dir(ray.dir)
     {}
   };
 
+  typedef BasicPoint<double> Point;
+  typedef BasicRect<double> Rect;
+  typedef BasicLine<double> Line;
+  typedef BasicSegment<double> Segment;
+  typedef BasicRay<double> Ray;
+
+  // Функции ниже определены в geometry.cpp и инстанцированы для float и double.
+  // Для функций, принимающих только точки, тип указывается явно: CreateCircle<float>(a, b, c).
+
   // Содержит ли линия координату по x?
-  bool LineContainsX(const Line &line);
+  template<class T>
+  bool LineContainsX(const BasicLine<T> &line);
 
   // Содержит ли линия координату по y?
-  bool LineContainsY(const Line &line);
+  template<class T>
+  bool LineContainsY(const BasicLine<T> &line);
 
   // Найти x на прямой по заданному y
-  double FindLineX(const Line &line, double y);
+  template<class T>
+  T FindLineX(const BasicLine<T> &line, T y);
   // Найти y на прямой по заданному x
-  double FindLineY(const Line &line, double x);
+  template<class T>
+  T FindLineY(const BasicLine<T> &line, T x);
 
   // Пересекаются ли прямые?
-  bool IsIntersectionLine(const Line &a, const Line &b);
+  template<class T>
+  bool IsIntersectionLine(const BasicLine<T> &a, const BasicLine<T> &b);
 
   // Найти точку пересечения прямых.
-  Point IntersectLines(const Line &a, const Line &b);
+  template<class T>
+  BasicPoint<T> IntersectLines(const BasicLine<T> &a, const BasicLine<T> &b);
 
   // Содержит ли область точку?
-  bool RectContainsPoint(const Rect &rect, const Point &point);
+  template<class T>
+  bool RectContainsPoint(const BasicRect<T> &rect, const BasicPoint<T> &point);
 
   // Как расположены точки, по часовой стрелке или против?
   // Если результат больше 0, то против часовой.
-  double RotationPoint(const Point &a, const Point &b, const Point &c);
+  template<class T>
+  T RotationPoint(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c);
 
   // Найти перпендикулярную прямую к данной проходящий через заданную точку.
-  Line Perpendicular(const Line &line, const Point &point);
+  template<class T>
+  BasicLine<T> Perpendicular(const BasicLine<T> &line, const BasicPoint<T> &point);
 
   // Найти центральную точку между двумя точками.
-  Point Center(const Point &a, const Point &b);
+  template<class T>
+  BasicPoint<T> Center(const BasicPoint<T> &a, const BasicPoint<T> &b);
 
   // Даны прямая и луч. развернуть луч таким образом, что бы он стал перпендикулярен заданной прямой.
-  Ray PerpRayLine(const Ray &ray, const Line &line);
+  template<class T>
+  BasicRay<T> PerpRayLine(const BasicRay<T> &ray, const BasicLine<T> &line);
 
   // Найти пересечение парабол.
   // sl - координата по y заметающей прямой
   // p1 и p2 координыта центров парабол.
-  double IntersectParabols(double sl, const Point &p1, const Point &p2);
+  template<class T>
+  T IntersectParabols(T sl, const BasicPoint<T> &p1, const BasicPoint<T> &p2);
 
   // Пересекается ли луч и отрезок.
-  bool IsIntersectionRaySegment(const Segment &segment, const Ray &ray);
+  template<class T>
+  bool IsIntersectionRaySegment(const BasicSegment<T> &segment, const BasicRay<T> &ray);
 
   // Построить окружность по трем точкам.
-  // Вернуть центр окружности.
-  Point CreateCircle(const Point &a, const Point &b, const Point &c);
+  // Вернуть центр окружности. Центр считается в double и округляется до T.
+  template<class T>
+  BasicPoint<T> CreateCircle(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c);
+
+  // Найти нижнюю точку окружности по трем точкам (координату по y).
+  // Центр и радиус считаются в double и округляются до T один раз,
+  // поэтому для точек на одной окружности получается одна и та же высота.
+  template<class T>
+  T CircleBottom(const BasicPoint<T> &a, const BasicPoint<T> &b, const BasicPoint<T> &c);
 
   // Найти пересечение области линией.
-  std::vector<Point> IntersectRectLine(const Rect &rect, const Line &line);
+  template<class T>
+  std::vector<BasicPoint<T> > IntersectRectLine(const BasicRect<T> &rect, const BasicLine<T> &line);
 
   // Найти пересечение области лучем.
-  std::vector<Point> IntersectRectRay(const Rect &rect, const Ray &ray);
+  template<class T>
+  std::vector<BasicPoint<T> > IntersectRectRay(const BasicRect<T> &rect, const BasicRay<T> &ray);
 
   // Найти пересечение области отрезком.
-  std::vector<geometry::Point> IntersectRectSegment(const Rect &rect, const Segment &segment);
+  template<class T>
+  std::vector<BasicPoint<T> > IntersectRectSegment(const BasicRect<T> &rect, const BasicSegment<T> &segment);
+
+  // Обрезать прямую областью (Лианг-Барски, без выделения памяти).
+  // Вернуть false, если прямая не пересекает область по отрезку ненулевой длины.
+  // Концы отрезка упорядочены так же, как в IntersectRectLine.
+  template<class T>
+  bool ClipRectLine(const BasicRect<T> &rect, const BasicLine<T> &line, BasicSegment<T> &out);
+
+  // Обрезать луч областью. Первый конец отрезка ближе к началу луча.
+  template<class T>
+  bool ClipRectRay(const BasicRect<T> &rect, const BasicRay<T> &ray, BasicSegment<T> &out);
+
+  // Обрезать отрезок областью. Концы, лежащие в области, не меняются.
+  template<class T>
+  bool ClipRectSegment(const BasicRect<T> &rect, const BasicSegment<T> &segment, BasicSegment<T> &out);
+
+  // Обрезать массив отрезков областью.
+  // Цикл без ветвлений, компилятор векторизует его при -O3 и -fno-trapping-math.
+  // valid[i] - результат ClipRectSegment для segments[i]. Вернуть число обрезанных отрезков.
+  template<class T>
+  size_t ClipRectSegments(const BasicRect<T> &rect, const BasicSegment<T> *segments, size_t count,
+                          BasicSegment<T> *out, bool *valid);
+
+  // Обрезать массив лучей областью, аналогично ClipRectSegments.
+  template<class T>
+  size_t ClipRectRays(const BasicRect<T> &rect, const BasicRay<T> *rays, size_t count,
+                      BasicSegment<T> *out, bool *valid);
+
+  // Выпуклый многоугольник задается массивом вершин против часовой стрелки
+  // без повторения первой вершины в конце, count >= 3.
+
+  // Содержит ли выпуклый многоугольник точку? Допуск EPS, как в RectContainsPoint.
+  template<class T>
+  bool ConvexContainsPoint(const BasicPoint<T> *polygon, size_t count, const BasicPoint<T> &point);
+
+  // Обрезать прямую выпуклым многоугольником (Кирус-Бек, без выделения памяти).
+  // Вернуть false, если прямая не пересекает многоугольник по отрезку ненулевой длины.
+  // Концы отрезка упорядочены так же, как в ClipRectLine.
+  template<class T>
+  bool ClipConvexLine(const BasicPoint<T> *polygon, size_t count, const BasicLine<T> &line, BasicSegment<T> &out);
+
+  // Обрезать луч выпуклым многоугольником. Первый конец отрезка ближе к началу луча.
+  template<class T>
+  bool ClipConvexRay(const BasicPoint<T> *polygon, size_t count, const BasicRay<T> &ray, BasicSegment<T> &out);
+
+  // Обрезать отрезок выпуклым многоугольником. Концы, лежащие в многоугольнике, не меняются.
+  template<class T>
+  bool ClipConvexSegment(const BasicPoint<T> *polygon, size_t count, const BasicSegment<T> &segment,
+                         BasicSegment<T> &out);
 
   // Удалить продублированные точки
-  void DublicatePoints(std::vector<Point> &points);
+  template<class T>
+  void DublicatePoints(std::vector<BasicPoint<T> > &points);
 
   // Создать рект по заданной диагонали.
-  Rect CreateRect(const Segment &segment);
+  template<class T>
+  BasicRect<T> CreateRect(const BasicSegment<T> &segment);
 }
 
 
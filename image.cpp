@@ -1,9 +1,88 @@
 #include "image.h"
 
 #include <iostream>
+#include <fstream>
 #include "lodepng/lodepng.h"
+#include "parallel.h"
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
+
+namespace
+{
+  /// Минимальный размер куска строк, сжимаемого одним потоком.
+  const size_t PNG_CHUNK_BYTES = 1 << 16;
+
+  unsigned char Paeth(int a, int b, int c)
+  {
+    const int p = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if(pa <= pb && pa <= pc)
+    {
+      return static_cast<unsigned char>(a);
+    }
+    return static_cast<unsigned char>(pb <= pc ? b : c);
+  }
+
+  /// Отфильтровать строку RGBA.
+  /// @param prev Предыдущая строка или nullptr для первой строки.
+  void FilterRow(unsigned char type, const unsigned char *row, const unsigned char *prev,
+                 size_t size, unsigned char *out)
+  {
+    const size_t bpp = 4;
+    for(size_t i = 0; i < size; ++i)
+    {
+      const int a = i >= bpp ? row[i - bpp] : 0;
+      const int b = prev ? prev[i] : 0;
+      const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+      switch(type)
+      {
+      case 1: out[i] = static_cast<unsigned char>(row[i] - a); break;
+      case 2: out[i] = static_cast<unsigned char>(row[i] - b); break;
+      case 3: out[i] = static_cast<unsigned char>(row[i] - ((a + b) >> 1)); break;
+      case 4: out[i] = static_cast<unsigned char>(row[i] - Paeth(a, b, c)); break;
+      default: out[i] = row[i]; break;
+      }
+    }
+  }
+
+  /// Оценка сжимаемости отфильтрованной строки: сумма модулей байтов со знаком.
+  size_t FilterCost(const unsigned char *data, size_t size)
+  {
+    size_t cost = 0;
+    for(size_t i = 0; i < size; ++i)
+    {
+      cost += data[i] < 128 ? data[i] : 256 - data[i];
+    }
+    return cost;
+  }
+
+  void PutUint32(std::vector<unsigned char> &out, unsigned int value)
+  {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+  }
+
+  void WritePngChunk(std::ofstream &file, const char *type, const std::vector<unsigned char> &data)
+  {
+    std::vector<unsigned char> header;
+    PutUint32(header, static_cast<unsigned int>(data.size()));
+    header.insert(header.end(), type, type + 4);
+
+    unsigned int crc = compression::Crc32(&header[4], 4);
+    crc = compression::Crc32(data.data(), data.size(), crc);
+    std::vector<unsigned char> footer;
+    PutUint32(footer, crc);
+
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.write(reinterpret_cast<const char *>(footer.data()), footer.size());
+  }
+}
 
 Image::Image()
 {
@@ -58,6 +137,119 @@ void Image::Save(const std::string &fileName)
   if(error) std::cout << "encoder error " << error << ": "<< lodepng_error_text(error) << std::endl;
 }
 
+void Image::Save(const std::string &fileName, compression::Level level, unsigned int threads)
+{
+  // Каждый кусок строк фильтруется и сжимается независимо и записывается в свой IDAT.
+  // Первый кусок начинается с заголовка zlib, последний заканчивается финальным блоком.
+  const size_t stride = 4 * static_cast<size_t>(mWidth);
+  const size_t tasks = 4 * ThreadCount(threads);
+  const size_t rowsPerChunk = std::max<size_t>(std::max<size_t>((mHeight + tasks - 1) / tasks,
+                                                                PNG_CHUNK_BYTES / (stride + 1)), 1);
+  const size_t chunks = std::max<size_t>((mHeight + rowsPerChunk - 1) / rowsPerChunk, 1);
+
+  std::vector<std::vector<unsigned char> > parts(chunks);
+  std::vector<unsigned int> adler(chunks, 1);
+  std::vector<size_t> sizes(chunks, 0);
+
+  ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+  {
+    std::vector<unsigned char> filtered;
+    std::vector<unsigned char> candidate(stride);
+    for(size_t i = begin; i < end; ++i)
+    {
+      const size_t first = i * rowsPerChunk;
+      const size_t last = std::min<size_t>(first + rowsPerChunk, mHeight);
+      filtered.resize((last - first) * (stride + 1));
+
+      for(size_t y = first; y < last; ++y)
+      {
+        const unsigned char *row = &mData[y * stride];
+        const unsigned char *prev = y > 0 ? &mData[(y - 1) * stride] : nullptr;
+        unsigned char *out = &filtered[(y - first) * (stride + 1)];
+
+        unsigned char type = 0;
+        if(level == compression::FAST)
+        {
+          type = 1;
+        }
+        else if(level != compression::STORE)
+        {
+          // Выбираем фильтр с наименьшей суммой модулей.
+          size_t best = 0;
+          for(unsigned char t = 0; t < 5; ++t)
+          {
+            FilterRow(t, row, prev, stride, candidate.data());
+            const size_t cost = FilterCost(candidate.data(), stride);
+            if(t == 0 || cost < best)
+            {
+              best = cost;
+              type = t;
+            }
+          }
+        }
+        out[0] = type;
+        FilterRow(type, row, prev, stride, out + 1);
+      }
+
+      if(i == 0)
+      {
+        compression::ZlibHeader(level, parts[i]);
+      }
+      compression::CompressChunk(filtered.data(), filtered.size(), level, i + 1 == chunks, parts[i]);
+      adler[i] = compression::Adler32(filtered.data(), filtered.size());
+      sizes[i] = filtered.size();
+    }
+  }, threads);
+
+  unsigned int checksum = adler[0];
+  for(size_t i = 1; i < chunks; ++i)
+  {
+    checksum = compression::Adler32Combine(checksum, adler[i], sizes[i]);
+  }
+  PutUint32(parts.back(), checksum);
+
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+  if(!file)
+  {
+    std::cout << "encoder error: can't open file " << fileName << std::endl;
+    return;
+  }
+
+  const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+  // Цвет RGBA, 8 бит на канал, без чересстрочности.
+  std::vector<unsigned char> header;
+  PutUint32(header, mWidth);
+  PutUint32(header, mHeight);
+  header.push_back(8);
+  header.push_back(6);
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+  WritePngChunk(file, "IHDR", header);
+
+  for(auto it = parts.begin(); it != parts.end(); ++it)
+  {
+    WritePngChunk(file, "IDAT", *it);
+  }
+  WritePngChunk(file, "IEND", std::vector<unsigned char>());
+}
+
+void Image::SavePam(const std::string &fileName)
+{
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+  if(!file)
+  {
+    std::cout << "encoder error: can't open file " << fileName << std::endl;
+    return;
+  }
+
+  file << "P7\nWIDTH " << mWidth << "\nHEIGHT " << mHeight
+       << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  file.write(reinterpret_cast<const char *>(mData.data()), mData.size());
+}
+
 void Image::DrawPoint(const glm::uvec2 &p, unsigned int color)
 {
   Set(p, color);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
+#include "compression.h"
 
 class Image
 {
@@ -19,6 +20,16 @@ public:
 
   void Save(const std::string &fileName);
 
+  /// Сохранить изображение в PNG собственным кодировщиком.
+  /// Строки разбиваются на куски, которые фильтруются и сжимаются параллельно.
+  /// @param level Уровень сжатия.
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  void Save(const std::string &fileName, compression::Level level, unsigned int threads = 0);
+
+  /// Сохранить изображение без сжатия в формате PAM (RGBA).
+  /// Подходит для быстрого сохранения промежуточных результатов.
+  void SavePam(const std::string &fileName);
+
   void DrawPoint(const glm::uvec2 &point, unsigned int color);
 
   void DrawLine(const glm::vec2 &point1, const glm::vec2 &point2, unsigned int color);
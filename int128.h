@@ -0,0 +1,168 @@
+#ifndef INT128_H
+#define INT128_H
+
+#include <stdint.h>
+
+/// Знаковое 128-битное целое для точных целочисленных вычислений.
+/// Где компилятор поддерживает __int128, используется он, иначе
+/// операции собираются из 64-битных половин. Результат не зависит от платформы.
+class Int128
+{
+public:
+  Int128()
+    : mHi(0), mLo(0)
+  {
+  }
+
+  Int128(int64_t value)
+    : mHi(value < 0 ? -1 : 0), mLo(static_cast<uint64_t>(value))
+  {
+  }
+
+  /// Точное произведение двух 64-битных чисел.
+  static Int128 Mul(int64_t a, int64_t b)
+  {
+#ifdef __SIZEOF_INT128__
+    return FromNative(static_cast<__int128>(a) * b);
+#else
+    const bool negative = (a < 0) != (b < 0);
+    const uint64_t ua = a < 0 ? 0 - static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+    const uint64_t ub = b < 0 ? 0 - static_cast<uint64_t>(b) : static_cast<uint64_t>(b);
+
+    const uint64_t a0 = ua & 0xFFFFFFFFu, a1 = ua >> 32;
+    const uint64_t b0 = ub & 0xFFFFFFFFu, b1 = ub >> 32;
+    const uint64_t p00 = a0 * b0;
+    const uint64_t p01 = a0 * b1;
+    const uint64_t p10 = a1 * b0;
+    const uint64_t p11 = a1 * b1;
+    const uint64_t middle = (p00 >> 32) + (p01 & 0xFFFFFFFFu) + (p10 & 0xFFFFFFFFu);
+
+    Int128 result;
+    result.mLo = (middle << 32) | (p00 & 0xFFFFFFFFu);
+    result.mHi = static_cast<int64_t>(p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32));
+    return negative ? -result : result;
+#endif
+  }
+
+  Int128 operator+(const Int128 &other) const
+  {
+    Int128 result;
+    result.mLo = mLo + other.mLo;
+    result.mHi = static_cast<int64_t>(static_cast<uint64_t>(mHi) + static_cast<uint64_t>(other.mHi) +
+                                      (result.mLo < mLo ? 1 : 0));
+    return result;
+  }
+
+  Int128 operator-() const
+  {
+    Int128 result;
+    result.mLo = 0 - mLo;
+    result.mHi = static_cast<int64_t>(0 - static_cast<uint64_t>(mHi) - (mLo != 0 ? 1 : 0));
+    return result;
+  }
+
+  Int128 operator-(const Int128 &other) const
+  {
+    return *this + -other;
+  }
+
+  /// Сдвиг влево. Значение не должно переполняться.
+  Int128 operator<<(unsigned int bits) const
+  {
+    if(bits == 0)
+    {
+      return *this;
+    }
+    Int128 result;
+    if(bits >= 64)
+    {
+      result.mHi = static_cast<int64_t>(mLo << (bits - 64));
+      result.mLo = 0;
+    }
+    else
+    {
+      result.mHi = static_cast<int64_t>((static_cast<uint64_t>(mHi) << bits) | (mLo >> (64 - bits)));
+      result.mLo = mLo << bits;
+    }
+    return result;
+  }
+
+  bool operator<(const Int128 &other) const
+  {
+    return mHi != other.mHi ? mHi < other.mHi : mLo < other.mLo;
+  }
+
+  bool operator==(const Int128 &other) const
+  {
+    return mHi == other.mHi && mLo == other.mLo;
+  }
+
+  bool operator!=(const Int128 &other) const
+  {
+    return !(*this == other);
+  }
+
+  /// Знак числа: -1, 0 или 1.
+  int Sign() const
+  {
+    return mHi < 0 ? -1 : (mHi > 0 || mLo != 0 ? 1 : 0);
+  }
+
+  /// Частное, округленное к ближайшему целому (половина - от нуля).
+  /// Частное должно помещаться в 64 бита.
+  /// @param divisor Положительный делитель.
+  int64_t DivRound(int64_t divisor) const
+  {
+    const bool negative = mHi < 0;
+    const Int128 value = negative ? -*this : *this;
+    const uint64_t d = static_cast<uint64_t>(divisor);
+
+    uint64_t quotient;
+    uint64_t remainder;
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 n = (static_cast<unsigned __int128>(static_cast<uint64_t>(value.mHi)) << 64) | value.mLo;
+    quotient = static_cast<uint64_t>(n / d);
+    remainder = static_cast<uint64_t>(n % d);
+#else
+    // Деление столбиком по одному биту.
+    uint64_t hi = static_cast<uint64_t>(value.mHi);
+    uint64_t lo = value.mLo;
+    remainder = 0;
+    quotient = 0;
+    for(int i = 0; i < 128; ++i)
+    {
+      const bool carry = (remainder >> 63) != 0;
+      remainder = (remainder << 1) | (hi >> 63);
+      hi = (hi << 1) | (lo >> 63);
+      lo <<= 1;
+      quotient <<= 1;
+      if(carry || remainder >= d)
+      {
+        remainder -= d;
+        quotient |= 1;
+      }
+    }
+#endif
+    if(remainder >= d - remainder)
+    {
+      ++quotient;
+    }
+    return negative ? -static_cast<int64_t>(quotient) : static_cast<int64_t>(quotient);
+  }
+
+private:
+#ifdef __SIZEOF_INT128__
+  static Int128 FromNative(__int128 value)
+  {
+    Int128 result;
+    result.mHi = static_cast<int64_t>(value >> 64);
+    result.mLo = static_cast<uint64_t>(value);
+    return result;
+  }
+#endif
+
+  int64_t mHi;
+  uint64_t mLo;
+};
+
+#endif // INT128_H
@@ -3,106 +3,58 @@
 #include "gif-h/gif.h"
 #include "geometry.h"
 #include "Lloyd.h"
+#include "sites.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include <ctime>
-#include <algorithm>
-#include <iterator>
 
 float get_msec(){
     return clock() / static_cast<float>(CLOCKS_PER_SEC);
 }
 
-std::vector<glm::vec2> Generate(const unsigned int count, const glm::uvec2 &size)
+/// Сравнить равномерность точек Poisson-disk и релаксации Ллойда за одинаковое время.
+/// Ллойд начинает со случайных точек в том же количестве и делает столько итераций,
+/// сколько успевает за время построения Poisson-disk выборки.
+void BenchmarkSpacing(const glm::uvec2 &size, float minDistance)
 {
-  printf("%7gs Start generate\n", get_msec());
-
-  std::vector<glm::vec2> points;
-  points.reserve(count);
-
-  unsigned int seed = static_cast<unsigned int>(time(NULL));
-  srand(seed);
-  printf("%7gs Seed: %i\n", get_msec(), seed);
-
-  struct Generator
+  typedef std::chrono::steady_clock Clock;
+  auto Seconds = [](Clock::time_point start)
   {
-    const glm::uvec2 size;
-    Generator(const glm::uvec2 &s)
-      : size(s)
-    {}
-    glm::vec2 operator()() {return glm::vec2(rand() % size.x, rand() % size.y);}
-  } generator(size);
-
-  std::generate_n(std::back_inserter(points), count, generator);
-
-
-  std::sort(points.begin(), points.end(), 
-    [](const glm::vec2 &p1, const glm::vec2 &p2) -> bool
-  {
-    if(p1.y == p2.y)
-      return p1.x > p2.x;
-    return p1.y > p2.y;
-  });
-
-  auto it = std::unique(points.begin(), points.end(), 
-    [](const glm::vec2 &p1, const glm::vec2 &p2)
-    {
-      return p1.x == p2.x && p1.y == p2.y;
-    });   
-
-  points.resize(std::distance(points.begin(), it));
-
-  return std::move(points);
-}
-
-
-std::vector<glm::vec2> LloidGenerate(const unsigned int count, const glm::uvec2 &pos, const glm::uvec2 &size)
-{
-  printf("%7gs Start generate\n", get_msec());
-
-  std::vector<glm::vec2> points;
-  points.reserve(count);
-
-  unsigned int seed = static_cast<unsigned int>(time(NULL));
-  srand(seed);
-  printf("%7gs Seed: %i\n", get_msec(), seed);
-
-  struct Generator
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+  auto Print = [](const char *name, size_t count, double time, const std::vector<glm::vec2> &points, const glm::uvec2 &size)
   {
-    const glm::uvec2 pos;
-    const glm::uvec2 size;
-    Generator(const glm::uvec2 &p, const glm::uvec2 &s)
-      : pos(p), size(s)
-    {}
-    glm::vec2 operator()()
-    {
-      return glm::vec2(pos.x + rand() % size.x + (((rand() % 100) - 50) / 100.0f),
-                       pos.y + rand() % size.y + (((rand() % 100) - 50) / 100.0f));
-    }
-  } generator(pos, size);
-  std::generate_n(std::back_inserter(points), count, generator);
-
-
-  std::sort(points.begin(), points.end(),
-    [](const glm::vec2 &p1, const glm::vec2 &p2) -> bool
+    Voronoi diagram(points, size);
+    diagram();
+    const Spacing spacing = MeasureSpacing(diagram);
+    printf("%-8s %8u sites %8.3fs  min %.4f  mean %.4f  deviation %.4f\n", name,
+           static_cast<unsigned int>(count), time, spacing.min, spacing.mean, spacing.deviation);
+  };
+
+  Clock::time_point start = Clock::now();
+  std::vector<glm::vec2> points = PoissonDiskTiled(glm::vec2(), glm::vec2(size), minDistance, 1);
+  const double poissonTime = Seconds(start);
+  Print("poisson", points.size(), poissonTime, points, size);
+
+  std::vector<glm::vec2> lloyd = UniformSites(points.size(), glm::vec2(), glm::vec2(size), 1);
+  RemoveDuplicates(lloyd);
+  Print("random", lloyd.size(), 0.0, lloyd, size);
+
+  start = Clock::now();
+  unsigned int iterations = 0;
+  do
   {
-    if(p1.y == p2.y)
-      return p1.x > p2.x;
-    return p1.y > p2.y;
-  });
-
-  auto it = std::unique(points.begin(), points.end(),
-    [](const glm::vec2 &p1, const glm::vec2 &p2)
-    {
-      return p1.x == p2.x && p1.y == p2.y;
-    });
-
-  points.resize(std::distance(points.begin(), it));
-
-  return std::move(points);
+    lloyd = Lloyd(lloyd, size);
+    ++iterations;
+  }
+  while(Seconds(start) < poissonTime);
+  char name[32];
+  snprintf(name, sizeof(name), "lloyd%u", iterations);
+  Print(name, lloyd.size(), Seconds(start), lloyd, size);
 }
 
-
 struct HarmonicMean
 {
   glm::vec2 operator()(const glm::vec2 &, const std::vector<unsigned int> &poligon, const std::vector<glm::vec2> &vertex)
@@ -166,13 +118,26 @@ struct AverageDegree
 };
 
 
-int main()
+int main(int argc, char *argv[])
 {
+  if(argc > 1 && strcmp(argv[1], "bench") == 0)
+  {
+    BenchmarkSpacing(glm::uvec2(1000, 1000), 2.0f);
+    return 0;
+  }
+
   glm::uvec2 size(400, 400);
 
+  printf("%7gs Start generate\n", get_msec());
+
+  const uint64_t seed = static_cast<uint64_t>(time(NULL));
+  printf("%7gs Seed: %llu\n", get_msec(), static_cast<unsigned long long>(seed));
+
   std::vector<glm::vec2> points;
-  //points = Generate(100000, size);
-  points = LloidGenerate(300, glm::uvec2(180, 180), glm::uvec2(40, 40));
+  //points = UniformSites(100000, glm::vec2(), glm::vec2(size), seed);
+  //points = PoissonDiskTiled(glm::vec2(), glm::vec2(size), 2.0f, seed);
+  points = UniformSites(300, glm::vec2(180, 180), glm::vec2(40, 40), seed);
+  RemoveDuplicates(points);
 
   printf("%7gs End generate, Count: %i\n", get_msec(), static_cast<int>(points.size()));
 
@@ -245,7 +210,7 @@ int main()
 
   printf("%7gs Start saving\n", get_msec());
 
-  image.Save("img.png");
+  image.Save("img.png", compression::FAST);
 
   printf("%7gs End\n", get_msec());
 
@@ -0,0 +1,202 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// Количество потоков для параллельной обработки.
+/// @param threads Желаемое количество потоков. 0 - по количеству ядер.
+inline unsigned int ThreadCount(unsigned int threads = 0)
+{
+  if(threads == 0)
+  {
+    threads = std::thread::hardware_concurrency();
+  }
+  return threads > 0 ? threads : 1;
+}
+
+/// Параллельно обработать диапазон [0, count).
+/// Диапазон разбивается на куски по grain элементов, куски раздаются потокам
+/// по мере освобождения. Для каждого куска вызывается func(begin, end).
+/// Вызывающий поток тоже участвует в обработке.
+/// @param count Количество элементов.
+/// @param grain Минимальный размер куска.
+/// @param func Функция обработки куска.
+/// @param threads Количество потоков. 0 - по количеству ядер.
+template<class Func>
+void ParallelFor(size_t count, size_t grain, const Func &func, unsigned int threads = 0)
+{
+  if(count == 0)
+  {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+
+  const size_t chunks = (count + grain - 1) / grain;
+  const unsigned int workers = static_cast<unsigned int>(std::min<size_t>(ThreadCount(threads), chunks));
+
+  if(workers <= 1)
+  {
+    func(static_cast<size_t>(0), count);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]()
+  {
+    for(size_t chunk = next++; chunk < chunks; chunk = next++)
+    {
+      const size_t begin = chunk * grain;
+      func(begin, std::min(begin + grain, count));
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for(unsigned int i = 1; i < workers; ++i)
+  {
+    pool.push_back(std::thread(worker));
+  }
+  worker();
+
+  for(auto it = pool.begin(); it != pool.end(); ++it)
+  {
+    (*it).join();
+  }
+}
+
+/// Флаг кооперативной отмены.
+/// Копии ссылаются на один флаг: отмена через любую копию видна во всех.
+class CancelToken
+{
+public:
+  CancelToken()
+    : mFlag(std::make_shared<std::atomic<bool> >(false))
+  {}
+
+  /// Запросить отмену.
+  void Cancel()
+  {
+    mFlag->store(true, std::memory_order_relaxed);
+  }
+
+  /// Запрошена ли отмена?
+  bool IsCancelled() const
+  {
+    return mFlag->load(std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<std::atomic<bool> > mFlag;
+};
+
+/// Пул потоков с общей очередью задач.
+/// Задачи выполняются в порядке добавления. Деструктор дожидается
+/// выполнения всех добавленных задач.
+class ThreadPool
+{
+public:
+  /// @param threads Количество потоков. 0 - по количеству ядер.
+  explicit ThreadPool(unsigned int threads = 0)
+    : mStop(false)
+  {
+    threads = ThreadCount(threads);
+    mThreads.reserve(threads);
+    for(unsigned int i = 0; i < threads; ++i)
+    {
+      mThreads.push_back(std::thread([this]()
+      {
+        Work();
+      }));
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+    mCondition.notify_all();
+    for(auto it = mThreads.begin(); it != mThreads.end(); ++it)
+    {
+      (*it).join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// Добавить задачу в очередь.
+  /// @return Результат func().
+  template<class Func>
+  std::future<typename std::result_of<Func()>::type> Submit(Func func)
+  {
+    typedef typename std::result_of<Func()>::type Result;
+    auto task = std::make_shared<std::packaged_task<Result()> >(std::move(func));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mTasks.push_back([task]()
+      {
+        (*task)();
+      });
+    }
+    mCondition.notify_one();
+    return result;
+  }
+
+  /// Количество потоков.
+  unsigned int GetThreadCount() const
+  {
+    return static_cast<unsigned int>(mThreads.size());
+  }
+
+  /// Общий пул по количеству ядер, создается при первом обращении.
+  static ThreadPool &Default()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+private:
+  void Work()
+  {
+    while(true)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this]()
+        {
+          return mStop || !mTasks.empty();
+        });
+        if(mTasks.empty())
+        {
+          return;
+        }
+        task = std::move(mTasks.front());
+        mTasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> mThreads;
+  std::deque<std::function<void()> > mTasks;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mStop;
+};
+
+#endif // PARALLEL_H
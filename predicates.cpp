@@ -0,0 +1,453 @@
+#include "predicates.h"
+#include "int128.h"
+
+#include <math.h>
+#include <vector>
+
+using namespace geometry;
+
+namespace
+{
+  /// Половина единицы последнего разряда double (2^-53).
+  const double EPSILON = 1.1102230246251565e-16;
+
+  /// Множитель для разделения double на две половины по 26 бит (2^27 + 1).
+  const double SPLITTER = 134217729.0;
+
+  /// Оценки ошибки округления из статьи Шевчука.
+  const double RESULT_ERROR = (3.0 + 8.0 * EPSILON) * EPSILON;
+  const double CCW_ERROR_A = (3.0 + 16.0 * EPSILON) * EPSILON;
+  const double CCW_ERROR_B = (2.0 + 12.0 * EPSILON) * EPSILON;
+  const double CCW_ERROR_C = (9.0 + 64.0 * EPSILON) * EPSILON * EPSILON;
+  const double ICC_ERROR_A = (10.0 + 96.0 * EPSILON) * EPSILON;
+
+  /// Разложение - массив чисел по возрастанию модуля, мантиссы которых
+  /// не перекрываются. Значение разложения - точная сумма его чисел.
+  typedef std::vector<double> Expansion;
+
+  /// x + y = a + b точно, |a| >= |b|.
+  inline void FastTwoSum(double a, double b, double &x, double &y)
+  {
+    x = a + b;
+    const double bvirt = x - a;
+    y = b - bvirt;
+  }
+
+  /// x + y = a + b точно.
+  inline void TwoSum(double a, double b, double &x, double &y)
+  {
+    x = a + b;
+    const double bvirt = x - a;
+    const double avirt = x - bvirt;
+    y = (a - avirt) + (b - bvirt);
+  }
+
+  /// Ошибка округления вычитания x = a - b.
+  inline double TwoDiffTail(double a, double b, double x)
+  {
+    const double bvirt = a - x;
+    const double avirt = x + bvirt;
+    return (a - avirt) + (bvirt - b);
+  }
+
+  /// x + y = a - b точно.
+  inline void TwoDiff(double a, double b, double &x, double &y)
+  {
+    x = a - b;
+    y = TwoDiffTail(a, b, x);
+  }
+
+  /// Разделить a на старшую и младшую половины.
+  inline void Split(double a, double &hi, double &lo)
+  {
+    const double c = SPLITTER * a;
+    const double big = c - a;
+    hi = c - big;
+    lo = a - hi;
+  }
+
+  /// x + y = a * b точно.
+  inline void TwoProduct(double a, double b, double &x, double &y)
+  {
+    x = a * b;
+    double ahi, alo, bhi, blo;
+    Split(a, ahi, alo);
+    Split(b, bhi, blo);
+    const double err1 = x - ahi * bhi;
+    const double err2 = err1 - alo * bhi;
+    const double err3 = err2 - ahi * blo;
+    y = alo * blo - err3;
+  }
+
+  /// Разложение из четырех чисел, равное (a1 + a0) - (b1 + b0).
+  inline void TwoTwoDiff(double a1, double a0, double b1, double b0, double *x)
+  {
+    double i, j, zero;
+    TwoDiff(a0, b0, i, x[0]);
+    TwoSum(a1, i, j, zero);
+    TwoDiff(zero, b1, i, x[1]);
+    TwoSum(j, i, x[3], x[2]);
+  }
+
+  /// Сумма разложений e и f. Нулевые числа отбрасываются.
+  /// @return Длина разложения h, не больше elen + flen.
+  int ExpansionSum(int elen, const double *e, int flen, const double *f, double *h)
+  {
+    int eindex = 0;
+    int findex = 0;
+    int hindex = 0;
+    double enow = e[0];
+    double fnow = f[0];
+    double q, qnew, hh;
+
+    if((fnow > enow) == (fnow > -enow))
+    {
+      q = enow;
+      enow = ++eindex < elen ? e[eindex] : 0.0;
+    }
+    else
+    {
+      q = fnow;
+      fnow = ++findex < flen ? f[findex] : 0.0;
+    }
+
+    if(eindex < elen && findex < flen)
+    {
+      if((fnow > enow) == (fnow > -enow))
+      {
+        FastTwoSum(enow, q, qnew, hh);
+        enow = ++eindex < elen ? e[eindex] : 0.0;
+      }
+      else
+      {
+        FastTwoSum(fnow, q, qnew, hh);
+        fnow = ++findex < flen ? f[findex] : 0.0;
+      }
+      q = qnew;
+      if(hh != 0.0)
+      {
+        h[hindex++] = hh;
+      }
+
+      while(eindex < elen && findex < flen)
+      {
+        if((fnow > enow) == (fnow > -enow))
+        {
+          TwoSum(q, enow, qnew, hh);
+          enow = ++eindex < elen ? e[eindex] : 0.0;
+        }
+        else
+        {
+          TwoSum(q, fnow, qnew, hh);
+          fnow = ++findex < flen ? f[findex] : 0.0;
+        }
+        q = qnew;
+        if(hh != 0.0)
+        {
+          h[hindex++] = hh;
+        }
+      }
+    }
+
+    while(eindex < elen)
+    {
+      TwoSum(q, enow, qnew, hh);
+      enow = ++eindex < elen ? e[eindex] : 0.0;
+      q = qnew;
+      if(hh != 0.0)
+      {
+        h[hindex++] = hh;
+      }
+    }
+    while(findex < flen)
+    {
+      TwoSum(q, fnow, qnew, hh);
+      fnow = ++findex < flen ? f[findex] : 0.0;
+      q = qnew;
+      if(hh != 0.0)
+      {
+        h[hindex++] = hh;
+      }
+    }
+
+    if(q != 0.0 || hindex == 0)
+    {
+      h[hindex++] = q;
+    }
+    return hindex;
+  }
+
+  /// Произведение разложения e на число b. Нулевые числа отбрасываются.
+  /// @return Длина разложения h, не больше 2 * elen.
+  int ScaleExpansion(int elen, const double *e, double b, double *h)
+  {
+    int hindex = 0;
+    double q, hh;
+    TwoProduct(e[0], b, q, hh);
+    if(hh != 0.0)
+    {
+      h[hindex++] = hh;
+    }
+    for(int i = 1; i < elen; ++i)
+    {
+      double product1, product0, sum;
+      TwoProduct(e[i], b, product1, product0);
+      TwoSum(q, product0, sum, hh);
+      if(hh != 0.0)
+      {
+        h[hindex++] = hh;
+      }
+      FastTwoSum(product1, sum, q, hh);
+      if(hh != 0.0)
+      {
+        h[hindex++] = hh;
+      }
+    }
+    if(q != 0.0 || hindex == 0)
+    {
+      h[hindex++] = q;
+    }
+    return hindex;
+  }
+
+  Expansion Sum(const Expansion &e, const Expansion &f)
+  {
+    Expansion h(e.size() + f.size());
+    h.resize(ExpansionSum(static_cast<int>(e.size()), &e[0], static_cast<int>(f.size()), &f[0], &h[0]));
+    return h;
+  }
+
+  Expansion Negate(Expansion e)
+  {
+    for(auto it = e.begin(); it != e.end(); ++it)
+    {
+      *it = -*it;
+    }
+    return e;
+  }
+
+  Expansion Product(const Expansion &e, const Expansion &f)
+  {
+    Expansion h(1, 0.0);
+    Expansion term(e.size() * 2);
+    for(auto it = f.begin(); it != f.end(); ++it)
+    {
+      term.resize(e.size() * 2);
+      term.resize(ScaleExpansion(static_cast<int>(e.size()), &e[0], *it, &term[0]));
+      h = Sum(h, term);
+    }
+    return h;
+  }
+
+  /// Точная разность a - b.
+  Expansion Difference(double a, double b)
+  {
+    Expansion h(2);
+    TwoDiff(a, b, h[1], h[0]);
+    return h;
+  }
+
+  /// Приближенное значение разложения.
+  double Estimate(int elen, const double *e)
+  {
+    double q = e[0];
+    for(int i = 1; i < elen; ++i)
+    {
+      q += e[i];
+    }
+    return q;
+  }
+
+  /// Уточнение ориентации, когда знак быстрого вычисления не определен.
+  double Orient2dAdapt(const Point &a, const Point &b, const Point &c, double detsum)
+  {
+    const double acx = a.x - c.x;
+    const double bcx = b.x - c.x;
+    const double acy = a.y - c.y;
+    const double bcy = b.y - c.y;
+
+    double detleft, detlefttail, detright, detrighttail;
+    TwoProduct(acx, bcy, detleft, detlefttail);
+    TwoProduct(acy, bcx, detright, detrighttail);
+
+    double B[4];
+    TwoTwoDiff(detleft, detlefttail, detright, detrighttail, B);
+
+    double det = Estimate(4, B);
+    double errbound = CCW_ERROR_B * detsum;
+    if(det >= errbound || -det >= errbound)
+    {
+      return det;
+    }
+
+    const double acxtail = TwoDiffTail(a.x, c.x, acx);
+    const double bcxtail = TwoDiffTail(b.x, c.x, bcx);
+    const double acytail = TwoDiffTail(a.y, c.y, acy);
+    const double bcytail = TwoDiffTail(b.y, c.y, bcy);
+
+    if(acxtail == 0.0 && acytail == 0.0 && bcxtail == 0.0 && bcytail == 0.0)
+    {
+      return det;
+    }
+
+    errbound = CCW_ERROR_C * detsum + RESULT_ERROR * fabs(det);
+    det += (acx * bcytail + bcy * acxtail) - (acy * bcxtail + bcx * acytail);
+    if(det >= errbound || -det >= errbound)
+    {
+      return det;
+    }
+
+    double s1, s0, t1, t0, u[4];
+    double C1[8], C2[12], D[16];
+
+    TwoProduct(acxtail, bcy, s1, s0);
+    TwoProduct(acytail, bcx, t1, t0);
+    TwoTwoDiff(s1, s0, t1, t0, u);
+    const int c1length = ExpansionSum(4, B, 4, u, C1);
+
+    TwoProduct(acx, bcytail, s1, s0);
+    TwoProduct(acy, bcxtail, t1, t0);
+    TwoTwoDiff(s1, s0, t1, t0, u);
+    const int c2length = ExpansionSum(c1length, C1, 4, u, C2);
+
+    TwoProduct(acxtail, bcytail, s1, s0);
+    TwoProduct(acytail, bcxtail, t1, t0);
+    TwoTwoDiff(s1, s0, t1, t0, u);
+    const int dlength = ExpansionSum(c2length, C2, 4, u, D);
+
+    return D[dlength - 1];
+  }
+
+  /// Точное вычисление положения точки относительно окружности.
+  double InCircleExact(const Point &a, const Point &b, const Point &c, const Point &d)
+  {
+    const Expansion adx = Difference(a.x, d.x);
+    const Expansion ady = Difference(a.y, d.y);
+    const Expansion bdx = Difference(b.x, d.x);
+    const Expansion bdy = Difference(b.y, d.y);
+    const Expansion cdx = Difference(c.x, d.x);
+    const Expansion cdy = Difference(c.y, d.y);
+
+    const Expansion alift = Sum(Product(adx, adx), Product(ady, ady));
+    const Expansion blift = Sum(Product(bdx, bdx), Product(bdy, bdy));
+    const Expansion clift = Sum(Product(cdx, cdx), Product(cdy, cdy));
+
+    const Expansion bc = Sum(Product(bdx, cdy), Negate(Product(cdx, bdy)));
+    const Expansion ca = Sum(Product(cdx, ady), Negate(Product(adx, cdy)));
+    const Expansion ab = Sum(Product(adx, bdy), Negate(Product(bdx, ady)));
+
+    const Expansion det = Sum(Sum(Product(alift, bc), Product(blift, ca)), Product(clift, ab));
+    return det.back();
+  }
+}
+
+double predicates::Orient2d(const Point &a, const Point &b, const Point &c)
+{
+  const double detleft = (a.x - c.x) * (b.y - c.y);
+  const double detright = (a.y - c.y) * (b.x - c.x);
+  const double det = detleft - detright;
+
+  double detsum;
+  if(detleft > 0.0)
+  {
+    if(detright <= 0.0)
+    {
+      return det;
+    }
+    detsum = detleft + detright;
+  }
+  else if(detleft < 0.0)
+  {
+    if(detright >= 0.0)
+    {
+      return det;
+    }
+    detsum = -detleft - detright;
+  }
+  else
+  {
+    return det;
+  }
+
+  const double errbound = CCW_ERROR_A * detsum;
+  if(det >= errbound || -det >= errbound)
+  {
+    return det;
+  }
+
+  return Orient2dAdapt(a, b, c, detsum);
+}
+
+double predicates::InCircle(const Point &a, const Point &b, const Point &c, const Point &d)
+{
+  const double adx = a.x - d.x;
+  const double bdx = b.x - d.x;
+  const double cdx = c.x - d.x;
+  const double ady = a.y - d.y;
+  const double bdy = b.y - d.y;
+  const double cdy = c.y - d.y;
+
+  const double bdxcdy = bdx * cdy;
+  const double cdxbdy = cdx * bdy;
+  const double alift = adx * adx + ady * ady;
+
+  const double cdxady = cdx * ady;
+  const double adxcdy = adx * cdy;
+  const double blift = bdx * bdx + bdy * bdy;
+
+  const double adxbdy = adx * bdy;
+  const double bdxady = bdx * ady;
+  const double clift = cdx * cdx + cdy * cdy;
+
+  const double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+
+  const double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * alift +
+                           (fabs(cdxady) + fabs(adxcdy)) * blift +
+                           (fabs(adxbdy) + fabs(bdxady)) * clift;
+  const double errbound = ICC_ERROR_A * permanent;
+  if(det > errbound || -det > errbound)
+  {
+    return det;
+  }
+
+  return InCircleExact(a, b, c, d);
+}
+
+double predicates::Orient2d(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c)
+{
+  return Orient2d(Point(a), Point(b), Point(c));
+}
+
+double predicates::InCircle(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c, const glm::vec2 &d)
+{
+  return InCircle(Point(a), Point(b), Point(c), Point(d));
+}
+
+int64_t predicates::IntOrient2d(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &c)
+{
+  const int64_t acx = static_cast<int64_t>(a.x) - c.x;
+  const int64_t bcx = static_cast<int64_t>(b.x) - c.x;
+  const int64_t acy = static_cast<int64_t>(a.y) - c.y;
+  const int64_t bcy = static_cast<int64_t>(b.y) - c.y;
+  return acx * bcy - acy * bcx;
+}
+
+int predicates::IntInCircle(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &c, const glm::ivec2 &d)
+{
+  const int64_t adx = static_cast<int64_t>(a.x) - d.x;
+  const int64_t bdx = static_cast<int64_t>(b.x) - d.x;
+  const int64_t cdx = static_cast<int64_t>(c.x) - d.x;
+  const int64_t ady = static_cast<int64_t>(a.y) - d.y;
+  const int64_t bdy = static_cast<int64_t>(b.y) - d.y;
+  const int64_t cdy = static_cast<int64_t>(c.y) - d.y;
+
+  // Разности не больше 2^29, квадраты и миноры не больше 2^59, слагаемые - 2^118.
+  const int64_t alift = adx * adx + ady * ady;
+  const int64_t blift = bdx * bdx + bdy * bdy;
+  const int64_t clift = cdx * cdx + cdy * cdy;
+
+  const Int128 det = Int128::Mul(alift, bdx * cdy - cdx * bdy) +
+                     Int128::Mul(blift, cdx * ady - adx * cdy) +
+                     Int128::Mul(clift, adx * bdy - bdx * ady);
+  return det.Sign();
+}
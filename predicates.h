@@ -0,0 +1,47 @@
+#ifndef PREDICATES_H
+#define PREDICATES_H
+
+#include "geometry.h"
+#include <stdint.h>
+
+/// Устойчивые геометрические предикаты (по Шевчуку).
+/// Сначала определитель вычисляется в обычной арифметике и сравнивается с оценкой
+/// ошибки округления. Если знак не определен, определитель уточняется точной
+/// арифметикой на разложениях (сумма чисел double без потери точности).
+/// Знак результата всегда точный, величина - приближение определителя.
+/// Требует округления IEEE 754 double без расширенной точности и -ffast-math.
+namespace predicates
+{
+  /// Ориентация тройки точек.
+  /// Больше 0, если a, b, c расположены против часовой стрелки, меньше 0,
+  /// если по часовой, 0 - если точки лежат на одной прямой.
+  /// Совпадает по знаку с geometry::RotationPoint.
+  double Orient2d(const geometry::Point &a, const geometry::Point &b, const geometry::Point &c);
+
+  /// Положение точки d относительно окружности через a, b, c.
+  /// Для a, b, c против часовой стрелки: больше 0, если d внутри окружности,
+  /// меньше 0, если снаружи, 0 - если на окружности. Для a, b, c по часовой
+  /// стрелке знак меняется.
+  double InCircle(const geometry::Point &a, const geometry::Point &b,
+                  const geometry::Point &c, const geometry::Point &d);
+
+  /// Ориентация тройки точек float. Координаты переводятся в double без потерь.
+  double Orient2d(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c);
+
+  /// InCircle для точек float. Координаты переводятся в double без потерь.
+  double InCircle(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c, const glm::vec2 &d);
+
+  /// Наибольший модуль координаты для целочисленных предикатов.
+  const int32_t MAX_INT_COORDINATE = 1 << 28;
+
+  /// Целочисленная ориентация: удвоенная площадь треугольника a, b, c со знаком.
+  /// Вычисляется точно для координат по модулю не больше MAX_INT_COORDINATE.
+  int64_t IntOrient2d(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &c);
+
+  /// Целочисленный InCircle. Возвращает только знак: -1, 0 или 1.
+  /// Вычисляется точно в 128-битной арифметике для координат по модулю
+  /// не больше MAX_INT_COORDINATE.
+  int IntInCircle(const glm::ivec2 &a, const glm::ivec2 &b, const glm::ivec2 &c, const glm::ivec2 &d);
+}
+
+#endif // PREDICATES_H
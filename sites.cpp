@@ -0,0 +1,461 @@
+#include "sites.h"
+#include "parallel.h"
+#include "sort.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+  const uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+  /// Перемешивающая функция SplitMix64.
+  uint64_t SplitMix(uint64_t value)
+  {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+  }
+
+  /// Количество точек, которые генерирует один поток за раз.
+  const size_t SITES_GRAIN = 1 << 14;
+
+  /// Независимый поток с номером stream, производный от seed.
+  uint64_t SubSeed(uint64_t seed, uint64_t stream)
+  {
+    return SplitMix(SplitMix(seed) ^ (stream * GOLDEN_GAMMA));
+  }
+
+  /// Равномерное число в [0, 1) с точностью double.
+  double RandomDoubleAt(uint64_t seed, uint64_t index)
+  {
+    return static_cast<double>(RandomAt(seed, index) >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  /// Отразить координату от границ [from, from + size].
+  float Reflect(float value, float from, float size)
+  {
+    float t = value - from;
+    if(t < 0.0f)
+    {
+      t = -t;
+    }
+    if(t > size)
+    {
+      t = 2.0f * size - t;
+    }
+    return from + std::min(size, std::max(0.0f, t));
+  }
+
+  /// Размер тайла в ячейках сетки.
+  /// Должен быть не меньше 4 ячеек, чтобы одновременно обрабатываемые тайлы
+  /// не читали ячейки друг друга.
+  const int TILE_CELLS = 32;
+
+  /// Сетка Poisson-disk выборки.
+  /// Ячейка содержит не более одной точки; пустая ячейка содержит бесконечность,
+  /// расстояние до которой всегда больше минимального.
+  class Sampler
+  {
+  public:
+    Sampler(const glm::vec2 &pos, const glm::vec2 &size, float minDistance, unsigned int attempts)
+      : mPos(pos), mEnd(pos + size), mRadius(minDistance), mRadius2(minDistance * minDistance),
+        mCell(minDistance / sqrtf(2.0f)), mAttempts(attempts)
+    {
+      mCols = std::max(1, static_cast<int>(ceilf(size.x / mCell)));
+      mRows = std::max(1, static_cast<int>(ceilf(size.y / mCell)));
+      const float empty = std::numeric_limits<float>::infinity();
+      mGrid.assign(static_cast<size_t>(mCols) * mRows, glm::vec2(empty, empty));
+    }
+
+    int GetCols() const
+    {
+      return mCols;
+    }
+
+    int GetRows() const
+    {
+      return mRows;
+    }
+
+    /// Заполнить прямоугольник ячеек [x0, x1) x [y0, y1).
+    /// Заполнение начинается от точек вокруг прямоугольника, если они есть.
+    void Fill(int x0, int y0, int x1, int y1, Random &random)
+    {
+      const glm::vec2 lo(mPos.x + x0 * mCell, mPos.y + y0 * mCell);
+      const glm::vec2 hi(std::min(mEnd.x, mPos.x + x1 * mCell), std::min(mEnd.y, mPos.y + y1 * mCell));
+
+      std::vector<glm::vec2> active;
+      for(int y = std::max(0, y0 - 3); y < std::min(mRows, y1 + 3); ++y)
+      {
+        for(int x = std::max(0, x0 - 3); x < std::min(mCols, x1 + 3); ++x)
+        {
+          const glm::vec2 &point = mGrid[static_cast<size_t>(y) * mCols + x];
+          if(point.x != std::numeric_limits<float>::infinity())
+          {
+            active.push_back(point);
+          }
+        }
+      }
+
+      // Рост от активных точек, затем случайные броски в оставшиеся дыры.
+      for(unsigned int misses = 0; misses < mAttempts; )
+      {
+        Grow(active, lo, hi, random);
+        const glm::vec2 point(random.Range(lo.x, hi.x), random.Range(lo.y, hi.y));
+        if(Inside(point, lo, hi) && Fits(point))
+        {
+          Insert(point);
+          active.push_back(point);
+          misses = 0;
+        }
+        else
+        {
+          ++misses;
+        }
+      }
+    }
+
+    /// Собрать точки в порядке ячеек.
+    void Collect(std::vector<glm::vec2> &points) const
+    {
+      for(auto it = mGrid.begin(); it != mGrid.end(); ++it)
+      {
+        if((*it).x != std::numeric_limits<float>::infinity())
+        {
+          points.push_back(*it);
+        }
+      }
+    }
+
+  private:
+    void Grow(std::vector<glm::vec2> &active, const glm::vec2 &lo, const glm::vec2 &hi, Random &random)
+    {
+      while(!active.empty())
+      {
+        const size_t index = static_cast<size_t>(random.Next() % active.size());
+        const glm::vec2 center = active[index];
+        bool found = false;
+        for(unsigned int i = 0; i < mAttempts && !found; ++i)
+        {
+          const float angle = random.Float() * 6.28318530718f;
+          const float radius = mRadius * (1.0f + random.Float());
+          const glm::vec2 point(center.x + radius * cosf(angle), center.y + radius * sinf(angle));
+          if(Inside(point, lo, hi) && Fits(point))
+          {
+            Insert(point);
+            active.push_back(point);
+            found = true;
+          }
+        }
+        if(!found)
+        {
+          active[index] = active.back();
+          active.pop_back();
+        }
+      }
+    }
+
+    static bool Inside(const glm::vec2 &point, const glm::vec2 &lo, const glm::vec2 &hi)
+    {
+      return point.x >= lo.x && point.x < hi.x && point.y >= lo.y && point.y < hi.y;
+    }
+
+    int CellX(float x) const
+    {
+      return std::min(mCols - 1, std::max(0, static_cast<int>((x - mPos.x) / mCell)));
+    }
+
+    int CellY(float y) const
+    {
+      return std::min(mRows - 1, std::max(0, static_cast<int>((y - mPos.y) / mCell)));
+    }
+
+    bool Fits(const glm::vec2 &point) const
+    {
+      const int cx = CellX(point.x);
+      const int cy = CellY(point.y);
+      for(int y = std::max(0, cy - 2); y <= std::min(mRows - 1, cy + 2); ++y)
+      {
+        const glm::vec2 *row = &mGrid[static_cast<size_t>(y) * mCols];
+        for(int x = std::max(0, cx - 2); x <= std::min(mCols - 1, cx + 2); ++x)
+        {
+          const float dx = row[x].x - point.x;
+          const float dy = row[x].y - point.y;
+          if(dx * dx + dy * dy < mRadius2)
+          {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    void Insert(const glm::vec2 &point)
+    {
+      mGrid[static_cast<size_t>(CellY(point.y)) * mCols + CellX(point.x)] = point;
+    }
+
+    const glm::vec2 mPos;
+    const glm::vec2 mEnd;
+    const float mRadius;
+    const float mRadius2;
+    const float mCell;
+    const unsigned int mAttempts;
+    int mCols;
+    int mRows;
+    std::vector<glm::vec2> mGrid;
+  };
+}
+
+Random::Random(uint64_t seed)
+  : mState(seed)
+{
+}
+
+uint64_t Random::Next()
+{
+  mState += GOLDEN_GAMMA;
+  return SplitMix(mState);
+}
+
+float Random::Float()
+{
+  return static_cast<float>(Next() >> 40) * (1.0f / 16777216.0f);
+}
+
+float Random::Range(float from, float to)
+{
+  return from + (to - from) * Float();
+}
+
+uint64_t RandomAt(uint64_t seed, uint64_t index)
+{
+  return SplitMix(seed + (index + 1) * GOLDEN_GAMMA);
+}
+
+float RandomFloatAt(uint64_t seed, uint64_t index)
+{
+  return static_cast<float>(RandomAt(seed, index) >> 40) * (1.0f / 16777216.0f);
+}
+
+std::vector<glm::vec2> UniformSites(size_t count, const glm::vec2 &pos, const glm::vec2 &size,
+                                    uint64_t seed, unsigned int threads)
+{
+  std::vector<glm::vec2> sites(count);
+  ParallelFor(count, SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      sites[i] = pos + size * glm::vec2(RandomFloatAt(seed, 2 * i), RandomFloatAt(seed, 2 * i + 1));
+    }
+  }, threads);
+  return sites;
+}
+
+std::vector<glm::vec2> ClusteredSites(size_t count, const glm::vec2 &pos, const glm::vec2 &size,
+                                      unsigned int clusters, float spread,
+                                      uint64_t seed, unsigned int threads)
+{
+  assert(clusters > 0);
+  const uint64_t centerSeed = SubSeed(seed, 1);
+  std::vector<glm::vec2> centers(clusters);
+  for(unsigned int i = 0; i < clusters; ++i)
+  {
+    centers[i] = pos + size * glm::vec2(RandomFloatAt(centerSeed, 2 * i), RandomFloatAt(centerSeed, 2 * i + 1));
+  }
+
+  std::vector<glm::vec2> sites(count);
+  ParallelFor(count, SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      const glm::vec2 &center = centers[RandomAt(seed, 4 * i) % clusters];
+      // Преобразование Бокса-Мюллера.
+      const double radius = sqrt(-2.0 * log(1.0 - RandomDoubleAt(seed, 4 * i + 1)));
+      const double angle = 6.283185307179586 * RandomDoubleAt(seed, 4 * i + 2);
+      const float x = center.x + static_cast<float>(spread * radius * cos(angle));
+      const float y = center.y + static_cast<float>(spread * radius * sin(angle));
+      sites[i] = glm::vec2(Reflect(x, pos.x, size.x), Reflect(y, pos.y, size.y));
+    }
+  }, threads);
+  return sites;
+}
+
+std::vector<glm::vec2> JitteredGridSites(const glm::vec2 &pos, const glm::vec2 &size, float step, float jitter,
+                                         uint64_t seed, unsigned int threads)
+{
+  assert(step > 0.0f);
+  const size_t cols = static_cast<size_t>(size.x / step);
+  const size_t rows = static_cast<size_t>(size.y / step);
+  jitter = std::min(1.0f, std::max(0.0f, jitter));
+
+  std::vector<glm::vec2> sites(cols * rows);
+  ParallelFor(sites.size(), SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      const float x = (i % cols) + 0.5f + jitter * (RandomFloatAt(seed, 2 * i) - 0.5f);
+      const float y = (i / cols) + 0.5f + jitter * (RandomFloatAt(seed, 2 * i + 1) - 0.5f);
+      sites[i] = pos + glm::vec2(x, y) * step;
+    }
+  }, threads);
+  return sites;
+}
+
+std::vector<glm::vec2> DensitySites(size_t count, const std::vector<float> &density,
+                                    unsigned int width, unsigned int height,
+                                    const glm::vec2 &pos, const glm::vec2 &size,
+                                    uint64_t seed, unsigned int threads)
+{
+  assert(density.size() == static_cast<size_t>(width) * height);
+
+  // Функция распределения по пикселям карты.
+  std::vector<double> cdf(density.size());
+  double total = 0.0;
+  for(size_t i = 0; i < density.size(); ++i)
+  {
+    total += std::max(0.0f, density[i]);
+    cdf[i] = total;
+  }
+  if(total <= 0.0)
+  {
+    return std::vector<glm::vec2>();
+  }
+
+  const glm::vec2 pixel(size.x / width, size.y / height);
+  std::vector<glm::vec2> sites(count);
+  ParallelFor(count, SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      const double target = RandomDoubleAt(seed, 3 * i) * total;
+      const size_t index = std::min(cdf.size() - 1,
+        static_cast<size_t>(std::upper_bound(cdf.begin(), cdf.end(), target) - cdf.begin()));
+      const float x = (index % width) + RandomFloatAt(seed, 3 * i + 1);
+      const float y = (index / width) + RandomFloatAt(seed, 3 * i + 2);
+      sites[i] = pos + glm::vec2(x, y) * pixel;
+    }
+  }, threads);
+  return sites;
+}
+
+void RemoveDuplicates(std::vector<glm::vec2> &sites, unsigned int threads)
+{
+  std::vector<uint64_t> keys(sites.size());
+  ParallelFor(sites.size(), SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      keys[i] = SweepKey(sites[i]);
+    }
+  }, threads);
+
+  RadixSort(keys, threads);
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  sites.resize(keys.size());
+  ParallelFor(sites.size(), SITES_GRAIN, [&](size_t begin, size_t end)
+  {
+    for(size_t i = begin; i < end; ++i)
+    {
+      sites[i] = SweepKeyPoint(keys[i]);
+    }
+  }, threads);
+}
+
+std::vector<glm::vec2> PoissonDisk(const glm::vec2 &pos, const glm::vec2 &size, float minDistance,
+                                   uint64_t seed, unsigned int attempts)
+{
+  assert(minDistance > 0.0f);
+  Sampler sampler(pos, size, minDistance, attempts);
+  Random random(seed);
+  sampler.Fill(0, 0, sampler.GetCols(), sampler.GetRows(), random);
+
+  std::vector<glm::vec2> points;
+  sampler.Collect(points);
+  return points;
+}
+
+std::vector<glm::vec2> PoissonDiskTiled(const glm::vec2 &pos, const glm::vec2 &size, float minDistance,
+                                        uint64_t seed, unsigned int attempts, unsigned int threads)
+{
+  assert(minDistance > 0.0f);
+  Sampler sampler(pos, size, minDistance, attempts);
+  const int tilesX = (sampler.GetCols() + TILE_CELLS - 1) / TILE_CELLS;
+  const int tilesY = (sampler.GetRows() + TILE_CELLS - 1) / TILE_CELLS;
+
+  // Тайлы одного цвета разделены хотя бы одним тайлом другого цвета.
+  std::vector<int> tiles;
+  for(int color = 0; color < 4; ++color)
+  {
+    tiles.clear();
+    for(int y = color >> 1; y < tilesY; y += 2)
+    {
+      for(int x = color & 1; x < tilesX; x += 2)
+      {
+        tiles.push_back(y * tilesX + x);
+      }
+    }
+
+    ParallelFor(tiles.size(), 1, [&](size_t begin, size_t end)
+    {
+      for(size_t i = begin; i < end; ++i)
+      {
+        const int x = tiles[i] % tilesX;
+        const int y = tiles[i] / tilesX;
+        Random random(RandomAt(seed, static_cast<uint64_t>(tiles[i])));
+        sampler.Fill(x * TILE_CELLS, y * TILE_CELLS, std::min(sampler.GetCols(), (x + 1) * TILE_CELLS),
+                     std::min(sampler.GetRows(), (y + 1) * TILE_CELLS), random);
+      }
+    }, threads);
+  }
+
+  std::vector<glm::vec2> points;
+  sampler.Collect(points);
+  return points;
+}
+
+Spacing MeasureSpacing(const Voronoi &diagram)
+{
+  const std::vector<glm::vec2> &sites = diagram.GetSites();
+  const std::vector<Voronoi::Edge> &edges = diagram.GetEdges();
+
+  std::vector<float> nearest(sites.size(), std::numeric_limits<float>::infinity());
+  for(auto it = edges.begin(); it != edges.end(); ++it)
+  {
+    if((*it).site1 == (*it).site2)
+    {
+      continue;
+    }
+    const float distance = glm::distance(sites[(*it).site1], sites[(*it).site2]);
+    nearest[(*it).site1] = std::min(nearest[(*it).site1], distance);
+    nearest[(*it).site2] = std::min(nearest[(*it).site2], distance);
+  }
+
+  Spacing spacing = {0.0f, 0.0f, 0.0f};
+  double sum = 0.0;
+  double sum2 = 0.0;
+  size_t count = 0;
+  float min = std::numeric_limits<float>::infinity();
+  for(auto it = nearest.begin(); it != nearest.end(); ++it)
+  {
+    if(*it != std::numeric_limits<float>::infinity())
+    {
+      sum += *it;
+      sum2 += static_cast<double>(*it) * *it;
+      min = std::min(min, *it);
+      ++count;
+    }
+  }
+  if(count > 0)
+  {
+    const double mean = sum / count;
+    spacing.min = min;
+    spacing.mean = static_cast<float>(mean);
+    spacing.deviation = mean > 0.0 ? static_cast<float>(sqrt(std::max(0.0, sum2 / count - mean * mean)) / mean) : 0.0f;
+  }
+  return spacing;
+}
@@ -0,0 +1,113 @@
+#ifndef SITES_H
+#define SITES_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <vector>
+
+/// Генератор псевдослучайных чисел SplitMix64.
+/// Результат полностью определяется зерном и не зависит от платформы.
+class Random
+{
+public:
+  explicit Random(uint64_t seed);
+
+  /// Следующее 64-битное число.
+  uint64_t Next();
+
+  /// Равномерное число в [0, 1).
+  float Float();
+
+  /// Равномерное число в [from, to).
+  float Range(float from, float to);
+
+private:
+  uint64_t mState;
+};
+
+/// Счетчиковый генератор: число с номером index потока seed.
+/// Совпадает с (index + 1)-м вызовом Random(seed).Next(). Не имеет состояния,
+/// поэтому любое количество потоков может заполнять непересекающиеся
+/// диапазоны и получать одинаковый результат.
+uint64_t RandomAt(uint64_t seed, uint64_t index);
+
+/// Равномерное число в [0, 1) с номером index потока seed.
+float RandomFloatAt(uint64_t seed, uint64_t index);
+
+/// Генераторы точек.
+/// Результат определяется только зерном и параметрами и не зависит от количества
+/// потоков. Порядок точек - порядок их номеров. Генераторы не удаляют совпадающие
+/// точки, для этого используется RemoveDuplicates.
+/// @param pos Левый нижний угол области.
+/// @param size Размер области.
+/// @param threads Количество потоков. 0 - по количеству ядер.
+
+/// Равномерно распределенные точки.
+std::vector<glm::vec2> UniformSites(size_t count, const glm::vec2 &pos, const glm::vec2 &size,
+                                    uint64_t seed, unsigned int threads = 0);
+
+/// Точки, сгруппированные вокруг clusters случайных центров.
+/// Отклонение от центра распределено нормально со средним квадратичным spread.
+/// Точки, вышедшие за область, отражаются от ее границы.
+std::vector<glm::vec2> ClusteredSites(size_t count, const glm::vec2 &pos, const glm::vec2 &size,
+                                      unsigned int clusters, float spread,
+                                      uint64_t seed, unsigned int threads = 0);
+
+/// Решетка с шагом step, каждая точка сдвинута случайно внутри своей ячейки.
+/// @param jitter Доля ячейки, в пределах которой сдвигается точка, от 0 до 1.
+/// При jitter <= 1 точки не совпадают.
+std::vector<glm::vec2> JitteredGridSites(const glm::vec2 &pos, const glm::vec2 &size, float step, float jitter,
+                                         uint64_t seed, unsigned int threads = 0);
+
+/// Точки с плотностью, пропорциональной карте плотности.
+/// Карта растягивается на всю область, строка 0 соответствует нижней границе.
+/// @param density Неотрицательные значения плотности, width * height элементов по строкам.
+std::vector<glm::vec2> DensitySites(size_t count, const std::vector<float> &density,
+                                    unsigned int width, unsigned int height,
+                                    const glm::vec2 &pos, const glm::vec2 &size,
+                                    uint64_t seed, unsigned int threads = 0);
+
+/// Удалить совпадающие точки.
+/// Точки сортируются поразрядной сортировкой в порядке заметающей прямой
+/// (по убыванию y, затем по убыванию x).
+void RemoveDuplicates(std::vector<glm::vec2> &sites, unsigned int threads = 0);
+
+/// Точки с минимальным расстоянием между ними (Poisson-disk, алгоритм Бриджсона).
+/// Вспомогательная сетка с ячейкой minDistance / sqrt(2) содержит не более одной
+/// точки в ячейке, поэтому проверка кандидата смотрит только 5x5 ячеек.
+/// Точки равномерно заполняют область за один проход O(n).
+/// @param pos Левый нижний угол области.
+/// @param size Размер области.
+/// @param minDistance Минимальное расстояние между точками.
+/// @param seed Зерно генератора.
+/// @param attempts Количество кандидатов вокруг активной точки.
+std::vector<glm::vec2> PoissonDisk(const glm::vec2 &pos, const glm::vec2 &size, float minDistance,
+                                   uint64_t seed, unsigned int attempts = 30);
+
+/// Многопоточный вариант PoissonDisk для больших областей.
+/// Область разбивается на квадратные тайлы, тайлы обрабатываются в четыре фазы
+/// так, что одновременно обрабатываемые тайлы не соседствуют. Тайл продолжает
+/// заполнение от точек уже обработанных соседей, поэтому швов между тайлами нет.
+/// У каждого тайла свой генератор, результат зависит от зерна и не зависит
+/// от количества потоков.
+/// @param threads Количество потоков. 0 - по количеству ядер.
+std::vector<glm::vec2> PoissonDiskTiled(const glm::vec2 &pos, const glm::vec2 &size, float minDistance,
+                                        uint64_t seed, unsigned int attempts = 30, unsigned int threads = 0);
+
+/// Статистика расстояний до ближайшего соседа.
+struct Spacing
+{
+  /// Минимальное расстояние.
+  float min;
+  /// Среднее расстояние.
+  float mean;
+  /// Отношение среднеквадратичного отклонения к среднему.
+  /// Чем меньше, тем равномернее расположены точки.
+  float deviation;
+};
+
+/// Оценить равномерность расположения точек построенной диаграммы.
+/// Ближайший сосед точки всегда является ее соседом по грани диаграммы.
+Spacing MeasureSpacing(const Voronoi &diagram);
+
+#endif // SITES_H
@@ -0,0 +1,105 @@
+#include "sort.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <algorithm>
+
+namespace
+{
+  const unsigned int RADIX_BITS = 8;
+  const unsigned int RADIX = 1 << RADIX_BITS;
+
+  /// Минимальный размер куска, который сортирует один поток.
+  const size_t CHUNK_SIZE = 1 << 16;
+
+  template<bool WithValues>
+  void Sort(std::vector<uint64_t> &keys, std::vector<unsigned int> *values, unsigned int threads)
+  {
+    const size_t count = keys.size();
+    if(count < 2)
+    {
+      return;
+    }
+
+    // Биты, которые различаются хотя бы у двух ключей.
+    uint64_t diff = 0;
+    for(size_t i = 1; i < count; ++i)
+    {
+      diff |= keys[i] ^ keys[0];
+    }
+
+    // Куски фиксированы, чтобы распределение по кускам не зависело от потоков.
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(ThreadCount(threads), count / CHUNK_SIZE));
+    std::vector<size_t> histogram(chunks * RADIX);
+    std::vector<uint64_t> tempKeys(count);
+    std::vector<unsigned int> tempValues(WithValues ? count : 0);
+
+    for(unsigned int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+      if(((diff >> shift) & (RADIX - 1)) == 0)
+      {
+        continue;
+      }
+
+      std::fill(histogram.begin(), histogram.end(), 0);
+      ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+      {
+        for(size_t chunk = begin; chunk < end; ++chunk)
+        {
+          size_t *counts = &histogram[chunk * RADIX];
+          for(size_t i = chunk * count / chunks; i < (chunk + 1) * count / chunks; ++i)
+          {
+            ++counts[(keys[i] >> shift) & (RADIX - 1)];
+          }
+        }
+      }, threads);
+
+      // Начало каждого разряда в каждом куске.
+      size_t offset = 0;
+      for(unsigned int digit = 0; digit < RADIX; ++digit)
+      {
+        for(size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+          const size_t size = histogram[chunk * RADIX + digit];
+          histogram[chunk * RADIX + digit] = offset;
+          offset += size;
+        }
+      }
+      assert(offset == count);
+
+      ParallelFor(chunks, 1, [&](size_t begin, size_t end)
+      {
+        for(size_t chunk = begin; chunk < end; ++chunk)
+        {
+          size_t *offsets = &histogram[chunk * RADIX];
+          for(size_t i = chunk * count / chunks; i < (chunk + 1) * count / chunks; ++i)
+          {
+            const size_t position = offsets[(keys[i] >> shift) & (RADIX - 1)]++;
+            tempKeys[position] = keys[i];
+            if(WithValues)
+            {
+              tempValues[position] = (*values)[i];
+            }
+          }
+        }
+      }, threads);
+
+      keys.swap(tempKeys);
+      if(WithValues)
+      {
+        values->swap(tempValues);
+      }
+    }
+  }
+}
+
+void RadixSort(std::vector<uint64_t> &keys, unsigned int threads)
+{
+  Sort<false>(keys, nullptr, threads);
+}
+
+void RadixSort(std::vector<uint64_t> &keys, std::vector<unsigned int> &values, unsigned int threads)
+{
+  assert(keys.size() == values.size());
+  Sort<true>(keys, &values, threads);
+}
@@ -0,0 +1,51 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/// Представить float беззнаковым целым, порядок которого совпадает с порядком чисел.
+/// -0.0 и 0.0 дают один ключ.
+inline uint32_t OrderedBits(float value)
+{
+  value += 0.0f;
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+/// Обратное преобразование к OrderedBits.
+inline float OrderedFloat(uint32_t bits)
+{
+  bits = bits & 0x80000000u ? bits & 0x7FFFFFFFu : ~bits;
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// Ключ порядка заметающей прямой: точки упорядочены по убыванию y,
+/// при равных y - по убыванию x. Ключ однозначно задает точку.
+inline uint64_t SweepKey(const glm::vec2 &point)
+{
+  return (static_cast<uint64_t>(~OrderedBits(point.y)) << 32) | ~OrderedBits(point.x);
+}
+
+/// Точка по ключу SweepKey.
+inline glm::vec2 SweepKeyPoint(uint64_t key)
+{
+  return glm::vec2(OrderedFloat(~static_cast<uint32_t>(key)), OrderedFloat(~static_cast<uint32_t>(key >> 32)));
+}
+
+/// Поразрядная сортировка (LSD) 64-битных ключей по возрастанию.
+/// Сортировка устойчива. Разряды, одинаковые у всех ключей, пропускаются.
+/// Большие массивы сортируются параллельно.
+/// @param threads Количество потоков. 0 - по количеству ядер.
+void RadixSort(std::vector<uint64_t> &keys, unsigned int threads = 0);
+
+/// Поразрядная сортировка ключей вместе со значениями.
+/// values[i] переставляется вместе с keys[i].
+void RadixSort(std::vector<uint64_t> &keys, std::vector<unsigned int> &values, unsigned int threads = 0);
+
+#endif // SORT_H
@@ -0,0 +1,554 @@
+#include "storage.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(glm::vec2) == 2 * sizeof(float), "glm::vec2 must be tightly packed");
+static_assert(sizeof(Voronoi::Edge) == 4 * sizeof(unsigned int), "Voronoi::Edge must be tightly packed");
+
+namespace
+{
+  const uint32_t BYTE_ORDER_MARK = 0x01020304;
+  const uint64_t SECTION_ALIGN = 64;
+  const unsigned int MAX_SECTIONS = 8;
+
+  /// Описание секции в заголовке.
+  struct Section
+  {
+    uint32_t type;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  /// Заголовок файла.
+  struct Header
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t sectionCount;
+    double rect[4];
+    Section sections[MAX_SECTIONS];
+  };
+
+  uint64_t Align(uint64_t offset)
+  {
+    return (offset + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+  }
+
+  bool WritePadding(FILE *file, uint64_t from, uint64_t to)
+  {
+    static const char zeros[SECTION_ALIGN] = {0};
+    assert(to >= from && to - from <= SECTION_ALIGN);
+    return fwrite(zeros, 1, static_cast<size_t>(to - from), file) == to - from;
+  }
+
+  /// Найти секцию по типу и проверить ее границы.
+  /// @return Указатель на начало секции или nullptr, если секция отсутствует или повреждена.
+  const unsigned char *FindSection(const unsigned char *data, size_t size, uint32_t type,
+                                   uint32_t elementSize, size_t &count)
+  {
+    const Header *header = reinterpret_cast<const Header *>(data);
+    for(uint32_t i = 0; i < header->sectionCount; ++i)
+    {
+      const Section &section = header->sections[i];
+      if(section.type != type)
+      {
+        continue;
+      }
+      if(section.elementSize != elementSize || section.offset % SECTION_ALIGN != 0 ||
+         section.offset > size || section.count > (size - section.offset) / elementSize)
+      {
+        return nullptr;
+      }
+      count = static_cast<size_t>(section.count);
+      return data + section.offset;
+    }
+    return nullptr;
+  }
+}
+
+void storage::BuildCellEdges(const std::vector<Voronoi::Edge> &edges, size_t siteCount,
+                             std::vector<unsigned int> &offsets, std::vector<unsigned int> &cellEdges)
+{
+  // Грань границы многоугольника (site1 == site2) входит в список точки один раз.
+  offsets.assign(siteCount + 1, 0);
+  for(auto it = edges.begin(); it != edges.end(); ++it)
+  {
+    ++offsets[(*it).site1 + 1];
+    if((*it).site2 != (*it).site1)
+    {
+      ++offsets[(*it).site2 + 1];
+    }
+  }
+  for(size_t i = 1; i < offsets.size(); ++i)
+  {
+    offsets[i] += offsets[i - 1];
+  }
+
+  cellEdges.resize(offsets.back());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for(unsigned int i = 0; i < edges.size(); ++i)
+  {
+    cellEdges[fill[edges[i].site1]++] = i;
+    if(edges[i].site2 != edges[i].site1)
+    {
+      cellEdges[fill[edges[i].site2]++] = i;
+    }
+  }
+}
+
+bool storage::Save(const std::string &fileName, const geometry::Rect &rect,
+                   const std::vector<glm::vec2> &sites, const std::vector<glm::vec2> &vertex,
+                   const std::vector<Voronoi::Edge> &edges, bool topology,
+                   const std::vector<unsigned int> &siteOrder, const std::vector<unsigned int> &periodicSource,
+                   const std::vector<unsigned char> &source)
+{
+  std::vector<unsigned int> offsets;
+  std::vector<unsigned int> cellEdges;
+  if(topology)
+  {
+    BuildCellEdges(edges, sites.size(), offsets, cellEdges);
+  }
+
+  struct Data
+  {
+    uint32_t type;
+    uint32_t elementSize;
+    const void *data;
+    size_t count;
+  };
+  Data data[MAX_SECTIONS] =
+  {
+    {SITES, sizeof(glm::vec2), sites.data(), sites.size()},
+    {VERTEX, sizeof(glm::vec2), vertex.data(), vertex.size()},
+    {EDGES, sizeof(Voronoi::Edge), edges.data(), edges.size()},
+  };
+  uint32_t count = 3;
+  if(topology)
+  {
+    data[count++] = {CELL_OFFSETS, sizeof(unsigned int), offsets.data(), offsets.size()};
+    data[count++] = {CELL_EDGES, sizeof(unsigned int), cellEdges.data(), cellEdges.size()};
+  }
+  if(!source.empty())
+  {
+    data[count++] = {SOURCE, 1, source.data(), source.size()};
+  }
+  if(!siteOrder.empty())
+  {
+    data[count++] = {SITE_ORDER, sizeof(unsigned int), siteOrder.data(), siteOrder.size()};
+  }
+  if(!periodicSource.empty())
+  {
+    data[count++] = {PERIODIC_SOURCE, sizeof(unsigned int), periodicSource.data(), periodicSource.size()};
+  }
+  assert(count <= MAX_SECTIONS);
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  header.byteOrder = BYTE_ORDER_MARK;
+  header.sectionCount = count;
+  header.rect[0] = rect.lb.x;
+  header.rect[1] = rect.lb.y;
+  header.rect[2] = rect.rt.x;
+  header.rect[3] = rect.rt.y;
+
+  uint64_t offset = Align(sizeof(Header));
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    header.sections[i].type = data[i].type;
+    header.sections[i].elementSize = data[i].elementSize;
+    header.sections[i].offset = offset;
+    header.sections[i].count = data[i].count;
+    offset = Align(offset + static_cast<uint64_t>(data[i].count) * data[i].elementSize);
+  }
+
+  // Пишем во временный файл, чтобы не оставить наполовину записанный файл.
+  const std::string temp = TempName(fileName);
+  FILE *file = fopen(temp.c_str(), "wb");
+  if(!file)
+  {
+    return false;
+  }
+
+  bool good = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64_t position = sizeof(header);
+  for(uint32_t i = 0; good && i < count; ++i)
+  {
+    good = WritePadding(file, position, header.sections[i].offset);
+    const size_t bytes = data[i].count * data[i].elementSize;
+    if(good && bytes > 0)
+    {
+      good = fwrite(data[i].data, 1, bytes, file) == bytes;
+    }
+    position = header.sections[i].offset + bytes;
+  }
+  good = fclose(file) == 0 && good;
+
+  if(!good)
+  {
+    remove(temp.c_str());
+    return false;
+  }
+  return CommitFile(temp, fileName);
+}
+
+std::string storage::TempName(const std::string &fileName)
+{
+  static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+  const unsigned long process = static_cast<unsigned long>(_getpid());
+#else
+  const unsigned long process = static_cast<unsigned long>(getpid());
+#endif
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%lu.%u.part", process, counter++);
+  return fileName + suffix;
+}
+
+bool storage::CommitFile(const std::string &temp, const std::string &fileName)
+{
+#ifdef _WIN32
+  const bool good = MoveFileExA(temp.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  const bool good = rename(temp.c_str(), fileName.c_str()) == 0;
+#endif
+  if(!good)
+  {
+    remove(temp.c_str());
+  }
+  return good;
+}
+
+MappedDiagram::MappedDiagram()
+  : mData(nullptr), mSize(0)
+#ifdef _WIN32
+  , mFile(nullptr), mMapping(nullptr)
+#endif
+{
+}
+
+MappedDiagram::~MappedDiagram()
+{
+  Close();
+}
+
+MappedDiagram::MappedDiagram(MappedDiagram &&diagram)
+  : mData(nullptr), mSize(0)
+#ifdef _WIN32
+  , mFile(nullptr), mMapping(nullptr)
+#endif
+{
+  *this = std::move(diagram);
+}
+
+MappedDiagram &MappedDiagram::operator=(MappedDiagram &&diagram)
+{
+  if(this != &diagram)
+  {
+    Close();
+    mData = diagram.mData;
+    mSize = diagram.mSize;
+#ifdef _WIN32
+    mFile = diagram.mFile;
+    mMapping = diagram.mMapping;
+    diagram.mFile = nullptr;
+    diagram.mMapping = nullptr;
+#endif
+    mRect = diagram.mRect;
+    mSites = diagram.mSites;
+    mVertex = diagram.mVertex;
+    mEdges = diagram.mEdges;
+    mCellOffsets = diagram.mCellOffsets;
+    mCellEdges = diagram.mCellEdges;
+    mSource = diagram.mSource;
+    mSiteOrder = diagram.mSiteOrder;
+    mPeriodicSource = diagram.mPeriodicSource;
+
+    diagram.mData = nullptr;
+    diagram.mSize = 0;
+    diagram.Close();
+  }
+  return *this;
+}
+
+bool MappedDiagram::Open(const std::string &fileName)
+{
+  Close();
+  if(!Map(fileName))
+  {
+    return false;
+  }
+
+  const Header *header = reinterpret_cast<const Header *>(mData);
+  if(mSize < sizeof(Header) || memcmp(header->magic, storage::MAGIC, sizeof(header->magic)) != 0 ||
+     header->version != storage::VERSION || header->byteOrder != BYTE_ORDER_MARK ||
+     header->sectionCount > MAX_SECTIONS)
+  {
+    Close();
+    return false;
+  }
+
+  mRect = geometry::Rect(geometry::Point(header->rect[0], header->rect[1]),
+                         geometry::Point(header->rect[2], header->rect[3]));
+
+  size_t count = 0;
+  const unsigned char *sites = FindSection(mData, mSize, storage::SITES, sizeof(glm::vec2), count);
+  mSites = ArrayView<glm::vec2>(reinterpret_cast<const glm::vec2 *>(sites), count);
+
+  count = 0;
+  const unsigned char *vertex = FindSection(mData, mSize, storage::VERTEX, sizeof(glm::vec2), count);
+  mVertex = ArrayView<glm::vec2>(reinterpret_cast<const glm::vec2 *>(vertex), count);
+
+  count = 0;
+  const unsigned char *edges = FindSection(mData, mSize, storage::EDGES, sizeof(Voronoi::Edge), count);
+  mEdges = ArrayView<Voronoi::Edge>(reinterpret_cast<const Voronoi::Edge *>(edges), count);
+
+  if(!sites || !vertex || !edges)
+  {
+    Close();
+    return false;
+  }
+
+  count = 0;
+  const unsigned char *offsets = FindSection(mData, mSize, storage::CELL_OFFSETS, sizeof(unsigned int), count);
+  mCellOffsets = ArrayView<unsigned int>(reinterpret_cast<const unsigned int *>(offsets), count);
+
+  count = 0;
+  const unsigned char *cellEdges = FindSection(mData, mSize, storage::CELL_EDGES, sizeof(unsigned int), count);
+  mCellEdges = ArrayView<unsigned int>(reinterpret_cast<const unsigned int *>(cellEdges), count);
+
+  // Списки граней используются, только если они согласованы по размеру.
+  if(!offsets || !cellEdges || mCellOffsets.size() != mSites.size() + 1 ||
+     mCellOffsets[mSites.size()] != mCellEdges.size())
+  {
+    mCellOffsets = ArrayView<unsigned int>();
+    mCellEdges = ArrayView<unsigned int>();
+  }
+
+  count = 0;
+  const unsigned char *source = FindSection(mData, mSize, storage::SOURCE, 1, count);
+  mSource = ArrayView<unsigned char>(source, source ? count : 0);
+
+  count = 0;
+  const unsigned char *order = FindSection(mData, mSize, storage::SITE_ORDER, sizeof(unsigned int), count);
+  mSiteOrder = ArrayView<unsigned int>(reinterpret_cast<const unsigned int *>(order), order ? count : 0);
+
+  count = 0;
+  const unsigned char *periodic = FindSection(mData, mSize, storage::PERIODIC_SOURCE, sizeof(unsigned int), count);
+  mPeriodicSource = ArrayView<unsigned int>(reinterpret_cast<const unsigned int *>(periodic), periodic ? count : 0);
+
+  return true;
+}
+
+void MappedDiagram::Close()
+{
+  Unmap();
+  mRect = geometry::Rect();
+  mSites = ArrayView<glm::vec2>();
+  mVertex = ArrayView<glm::vec2>();
+  mEdges = ArrayView<Voronoi::Edge>();
+  mCellOffsets = ArrayView<unsigned int>();
+  mCellEdges = ArrayView<unsigned int>();
+  mSource = ArrayView<unsigned char>();
+  mSiteOrder = ArrayView<unsigned int>();
+  mPeriodicSource = ArrayView<unsigned int>();
+}
+
+bool MappedDiagram::IsOpen() const
+{
+  return mData != nullptr;
+}
+
+bool MappedDiagram::Validate() const
+{
+  for(auto it = mEdges.begin(); it != mEdges.end(); ++it)
+  {
+    if((*it).site1 >= mSites.size() || (*it).site2 >= mSites.size() ||
+       (*it).vertex1 >= mVertex.size() || (*it).vertex2 >= mVertex.size())
+    {
+      return false;
+    }
+  }
+  for(size_t i = 0; i + 1 < mCellOffsets.size(); ++i)
+  {
+    if(mCellOffsets[i] > mCellOffsets[i + 1])
+    {
+      return false;
+    }
+  }
+  for(auto it = mCellEdges.begin(); it != mCellEdges.end(); ++it)
+  {
+    if(*it >= mEdges.size())
+    {
+      return false;
+    }
+  }
+
+  // Копии PERIODIC - последние точки списка, их источники - точки до копий.
+  if(!mSiteOrder.empty() && mSiteOrder.size() != mSites.size())
+  {
+    return false;
+  }
+  for(auto it = mSiteOrder.begin(); it != mSiteOrder.end(); ++it)
+  {
+    if(*it >= mSites.size())
+    {
+      return false;
+    }
+  }
+  if(mPeriodicSource.size() > mSites.size())
+  {
+    return false;
+  }
+  for(auto it = mPeriodicSource.begin(); it != mPeriodicSource.end(); ++it)
+  {
+    if(*it >= mSites.size() - mPeriodicSource.size())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+const geometry::Rect &MappedDiagram::GetRect() const
+{
+  return mRect;
+}
+
+ArrayView<glm::vec2> MappedDiagram::GetSites() const
+{
+  return mSites;
+}
+
+ArrayView<Voronoi::Edge> MappedDiagram::GetEdges() const
+{
+  return mEdges;
+}
+
+ArrayView<glm::vec2> MappedDiagram::GetVertex() const
+{
+  return mVertex;
+}
+
+bool MappedDiagram::HasTopology() const
+{
+  return !mCellOffsets.empty();
+}
+
+ArrayView<unsigned int> MappedDiagram::GetCellEdges(unsigned int site) const
+{
+  assert(HasTopology());
+  assert(site < mSites.size());
+  return ArrayView<unsigned int>(mCellEdges.data() + mCellOffsets[site],
+                                 mCellOffsets[site + 1] - mCellOffsets[site]);
+}
+
+ArrayView<unsigned char> MappedDiagram::GetSource() const
+{
+  return mSource;
+}
+
+ArrayView<unsigned int> MappedDiagram::GetSiteOrder() const
+{
+  return mSiteOrder;
+}
+
+ArrayView<unsigned int> MappedDiagram::GetPeriodicSource() const
+{
+  return mPeriodicSource;
+}
+
+bool MappedDiagram::Map(const std::string &fileName)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if(!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(!data)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  mFile = file;
+  mMapping = mapping;
+  mData = static_cast<const unsigned char *>(data);
+  mSize = static_cast<size_t>(size.QuadPart);
+#else
+  int file = open(fileName.c_str(), O_RDONLY);
+  if(file < 0)
+  {
+    return false;
+  }
+  struct stat info;
+  if(fstat(file, &info) != 0 || info.st_size == 0)
+  {
+    close(file);
+    return false;
+  }
+  void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  // Отображение остается действительным после закрытия дескриптора.
+  close(file);
+  if(data == MAP_FAILED)
+  {
+    return false;
+  }
+  mData = static_cast<const unsigned char *>(data);
+  mSize = static_cast<size_t>(info.st_size);
+#endif
+  return true;
+}
+
+void MappedDiagram::Unmap()
+{
+  if(!mData)
+  {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(mData);
+  CloseHandle(mMapping);
+  CloseHandle(mFile);
+  mMapping = nullptr;
+  mFile = nullptr;
+#else
+  munmap(const_cast<unsigned char *>(mData), mSize);
+#endif
+  mData = nullptr;
+  mSize = 0;
+}
@@ -0,0 +1,176 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "Voronoi.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Бинарный формат диаграммы.
+///
+/// Файл состоит из заголовка и секций. Каждая секция - плоский массив
+/// элементов фиксированного размера, выровненный по 64 байтам, поэтому файл
+/// можно отобразить в память и использовать массивы без разбора.
+/// Порядок байтов - порядок байтов машины, записавшей файл; файл с другим
+/// порядком байтов не открывается.
+///
+/// Секции:
+///   SITES        - исходные точки, glm::vec2;
+///   VERTEX       - вершины, glm::vec2;
+///   EDGES        - грани, Voronoi::Edge;
+///   CELL_OFFSETS - необязательно, начало списка граней каждой точки в CELL_EDGES,
+///                  sites + 1 элементов unsigned int;
+///   CELL_EDGES   - необязательно, индексы граней, сгруппированные по точкам;
+///   SOURCE       - необязательно, исходные данные построения в формате
+///                  записавшего файл приложения, байты;
+///   SITE_ORDER   - необязательно, исходные номера точек после построения
+///                  с REORDER_SITES, unsigned int (Voronoi::GetSiteOrder);
+///   PERIODIC_SOURCE - необязательно, исходные точки копий после построения
+///                  с PERIODIC, unsigned int (Voronoi::GetPeriodicSource).
+namespace storage
+{
+  const char MAGIC[4] = {'V', 'O', 'R', 'D'};
+  const uint32_t VERSION = 1;
+
+  enum SectionType
+  {
+    SITES = 1,
+    VERTEX = 2,
+    EDGES = 3,
+    CELL_OFFSETS = 4,
+    CELL_EDGES = 5,
+    SOURCE = 6,
+    SITE_ORDER = 7,
+    PERIODIC_SOURCE = 8,
+  };
+
+  /// Построить списки граней для каждой точки.
+  /// Грани точки site - это cellEdges[offsets[site]] ... cellEdges[offsets[site + 1] - 1].
+  /// Грань границы многоугольника области (site1 == site2) входит в список один раз.
+  void BuildCellEdges(const std::vector<Voronoi::Edge> &edges, size_t siteCount,
+                      std::vector<unsigned int> &offsets, std::vector<unsigned int> &cellEdges);
+
+  /// Уникальное имя временного файла рядом с fileName для записи
+  /// из нескольких процессов и потоков.
+  std::string TempName(const std::string &fileName);
+
+  /// Атомарно заменить файл fileName файлом temp.
+  /// Если замена не удалась, temp удаляется.
+  bool CommitFile(const std::string &temp, const std::string &fileName);
+
+  /// Записать диаграмму в файл.
+  /// @param topology Записывать ли списки граней для каждой точки.
+  /// @param siteOrder, periodicSource Таблицы GetSiteOrder и GetPeriodicSource,
+  /// пустой список - секция не пишется.
+  /// @param source Исходные данные построения, пустой список - секция не пишется.
+  bool Save(const std::string &fileName, const geometry::Rect &rect,
+            const std::vector<glm::vec2> &sites, const std::vector<glm::vec2> &vertex,
+            const std::vector<Voronoi::Edge> &edges, bool topology,
+            const std::vector<unsigned int> &siteOrder = std::vector<unsigned int>(),
+            const std::vector<unsigned int> &periodicSource = std::vector<unsigned int>(),
+            const std::vector<unsigned char> &source = std::vector<unsigned char>());
+}
+
+/// Непрерывный массив, которым не владеем.
+template<class T>
+class ArrayView
+{
+public:
+  ArrayView()
+    : mData(nullptr), mSize(0)
+  {}
+  ArrayView(const T *data, size_t size)
+    : mData(data), mSize(size)
+  {}
+  ArrayView(const std::vector<T> &vector)
+    : mData(vector.data()), mSize(vector.size())
+  {}
+
+  const T *begin() const { return mData; }
+  const T *end() const { return mData + mSize; }
+  const T *data() const { return mData; }
+  size_t size() const { return mSize; }
+  bool empty() const { return mSize == 0; }
+  const T &operator[](size_t i) const { return mData[i]; }
+
+private:
+  const T *mData;
+  size_t mSize;
+};
+
+/// Диаграмма, отображенная в память из файла.
+/// Данные не копируются и не разбираются, массивы указывают прямо в отображение.
+class MappedDiagram
+{
+public:
+  MappedDiagram();
+  ~MappedDiagram();
+
+  MappedDiagram(MappedDiagram &&diagram);
+  MappedDiagram &operator=(MappedDiagram &&diagram);
+
+  /// Отобразить файл в память.
+  /// Проверяются заголовок и границы секций, содержимое секций не проверяется.
+  /// @return false, если файл не удалось открыть или он имеет неверный формат.
+  bool Open(const std::string &fileName);
+
+  /// Освободить отображение.
+  void Close();
+
+  bool IsOpen() const;
+
+  /// Проверить, что индексы граней и таблиц точек не выходят за пределы массивов.
+  bool Validate() const;
+
+  /// Вернуть ограничивающую область диаграммы.
+  const geometry::Rect &GetRect() const;
+
+  /// Вернуть список точек.
+  ArrayView<glm::vec2> GetSites() const;
+
+  /// Вернуть список граней.
+  ArrayView<Voronoi::Edge> GetEdges() const;
+
+  /// Вернуть список вершин.
+  ArrayView<glm::vec2> GetVertex() const;
+
+  /// Содержит ли файл списки граней для каждой точки.
+  bool HasTopology() const;
+
+  /// Вернуть индексы граней точки.
+  ArrayView<unsigned int> GetCellEdges(unsigned int site) const;
+
+  /// Вернуть исходные данные построения, пустой список, если их нет в файле.
+  ArrayView<unsigned char> GetSource() const;
+
+  /// Вернуть таблицы Voronoi::GetSiteOrder и Voronoi::GetPeriodicSource,
+  /// пустой список, если их нет в файле.
+  ArrayView<unsigned int> GetSiteOrder() const;
+  ArrayView<unsigned int> GetPeriodicSource() const;
+
+private:
+  MappedDiagram(const MappedDiagram &);
+  MappedDiagram &operator=(const MappedDiagram &);
+
+  bool Map(const std::string &fileName);
+  void Unmap();
+
+  const unsigned char *mData;
+  size_t mSize;
+#ifdef _WIN32
+  void *mFile;
+  void *mMapping;
+#endif
+
+  geometry::Rect mRect;
+  ArrayView<glm::vec2> mSites;
+  ArrayView<glm::vec2> mVertex;
+  ArrayView<Voronoi::Edge> mEdges;
+  ArrayView<unsigned int> mCellOffsets;
+  ArrayView<unsigned int> mCellEdges;
+  ArrayView<unsigned char> mSource;
+  ArrayView<unsigned int> mSiteOrder;
+  ArrayView<unsigned int> mPeriodicSource;
+};
+
+#endif // STORAGE_H
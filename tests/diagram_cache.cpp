@@ -0,0 +1,89 @@
+// Диаграмма из кэша должна совпадать с построенной, включая таблицы
+// GetSiteOrder и GetPeriodicSource.
+
+#include "tests.h"
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const char DIRECTORY[] = "diagram_cache.tmp";
+
+  bool Same(const Voronoi &hit, const Voronoi &miss)
+  {
+    return hit.GetSites() == miss.GetSites() && hit.GetVertex() == miss.GetVertex() &&
+           hit.GetSiteOrder() == miss.GetSiteOrder() && hit.GetPeriodicSource() == miss.GetPeriodicSource() &&
+           hit.GetEdges().size() == miss.GetEdges().size() &&
+           std::equal(hit.GetEdges().begin(), hit.GetEdges().end(), miss.GetEdges().begin(),
+                      [](const Voronoi::Edge &a, const Voronoi::Edge &b) -> bool
+    {
+      return a.site1 == b.site1 && a.site2 == b.site2 && a.vertex1 == b.vertex1 && a.vertex2 == b.vertex2;
+    });
+  }
+}
+
+bool TestDiagramCache()
+{
+#ifdef _WIN32
+  _mkdir(DIRECTORY);
+#else
+  mkdir(DIRECTORY, 0777);
+#endif
+
+  srand(5);
+  std::vector<glm::vec2> sites;
+  for(unsigned int i = 0; i < 500; ++i)
+  {
+    sites.push_back(glm::vec2(rand() % 100000 / 100.0f, rand() % 100000 / 100.0f));
+  }
+  geometry::DublicatePoints<float>(sites);
+  const glm::vec2 size(1000.0f);
+
+  const unsigned int flags[] =
+  {
+    0,
+    Voronoi::REORDER_SITES,
+    Voronoi::REORDER_SITES | Voronoi::RESTORE_SITE_ORDER,
+    Voronoi::PERIODIC,
+    Voronoi::PERIODIC | Voronoi::REORDER_SITES,
+  };
+
+  bool good = true;
+  DiagramCache cache(DIRECTORY);
+  for(unsigned int flag : flags)
+  {
+    // Первое построение - промах, второе - попадание.
+    Voronoi miss(sites, size, flag);
+    const bool missed = !cache.Build(miss);
+    Voronoi hit(sites, size, flag);
+    const bool loaded = cache.Build(hit);
+    if(!missed || !loaded || !Same(hit, miss))
+    {
+      printf("FAILED: flags %u: miss %d, loaded %d, site order %u/%u, periodic source %u/%u\n", flag, missed, loaded,
+             static_cast<unsigned int>(hit.GetSiteOrder().size()),
+             static_cast<unsigned int>(miss.GetSiteOrder().size()),
+             static_cast<unsigned int>(hit.GetPeriodicSource().size()),
+             static_cast<unsigned int>(miss.GetPeriodicSource().size()));
+      good = false;
+    }
+  }
+
+  // Удаляем файлы кэша и каталог.
+  DiagramCache(DIRECTORY, 1).Trim();
+#ifdef _WIN32
+  _rmdir(DIRECTORY);
+#else
+  rmdir(DIRECTORY);
+#endif
+  return good;
+}
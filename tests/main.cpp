@@ -0,0 +1,28 @@
+// Запуск проверок. Возвращает 0, если все проверки прошли.
+
+#include "tests.h"
+
+#include <stdio.h>
+
+int main()
+{
+  struct Test
+  {
+    const char *name;
+    bool (*run)();
+  };
+  const Test tests[] =
+  {
+    {"polygon_cells", TestPolygonCells},
+    {"diagram_cache", TestDiagramCache},
+  };
+
+  bool good = true;
+  for(const Test &test : tests)
+  {
+    const bool passed = test.run();
+    printf("%s %s\n", passed ? "OK    " : "FAILED", test.name);
+    good = passed && good;
+  }
+  return good ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+// Экспорт ячеек диаграммы в области-многоугольнике.
+// Каждая ячейка должна выводиться замкнутым полигоном при любом масштабе области.
+
+#include "tests.h"
+#include "export.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+  unsigned int CountWord(const std::string &text, const char *word)
+  {
+    unsigned int count = 0;
+    for(size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1))
+    {
+      ++count;
+    }
+    return count;
+  }
+
+  /// Лежит ли точка строго внутри выпуклого многоугольника, обходимого против часовой стрелки.
+  bool Inside(const std::vector<glm::vec2> &polygon, const glm::vec2 &point)
+  {
+    for(size_t i = 0; i < polygon.size(); ++i)
+    {
+      const glm::vec2 &a = polygon[i];
+      const glm::vec2 &b = polygon[i + 1 == polygon.size() ? 0 : i + 1];
+      if((b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x) <= 0.0f)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Check(const std::vector<glm::vec2> &domain, unsigned int count, float scale)
+  {
+    std::vector<glm::vec2> boundary(domain);
+    for(auto it = boundary.begin(); it != boundary.end(); ++it)
+    {
+      *it *= scale;
+    }
+    std::vector<glm::vec2> sites;
+    while(sites.size() < count)
+    {
+      const glm::vec2 point(rand() % 100000 / 100.0f * scale, rand() % 100000 / 100.0f * scale);
+      if(Inside(boundary, point))
+      {
+        sites.push_back(point);
+      }
+    }
+
+    Voronoi voronoi(sites, boundary);
+    voronoi();
+
+    const char fileName[] = "polygon_cells.json";
+    if(!ExportGeoJson(voronoi, fileName, EXPORT_CELLS))
+    {
+      printf("FAILED: cannot write %s\n", fileName);
+      return false;
+    }
+    std::ifstream file(fileName);
+    std::stringstream text;
+    text << file.rdbuf();
+    file.close();
+    remove(fileName);
+
+    const unsigned int polygons = CountWord(text.str(), "\"Polygon\"");
+    const unsigned int lines = CountWord(text.str(), "\"MultiLineString\"");
+    if(polygons != count || lines != 0)
+    {
+      printf("FAILED: %u sides, %u sites, scale %g: %u polygons, %u open cells\n",
+             static_cast<unsigned int>(domain.size()), count, scale, polygons, lines);
+      return false;
+    }
+    return true;
+  }
+}
+
+bool TestPolygonCells()
+{
+  srand(3);
+  std::vector<std::vector<glm::vec2> > domains;
+  domains.push_back({glm::vec2(0, 0), glm::vec2(1000, 0), glm::vec2(0, 1000)});
+  domains.push_back({glm::vec2(500, 0), glm::vec2(1000, 300), glm::vec2(900, 900),
+                     glm::vec2(200, 1000), glm::vec2(0, 400)});
+  const unsigned int counts[] = {1, 2, 5, 50, 2000};
+  const float scales[] = {0.01f, 1.0f, 1000.0f};
+
+  bool good = true;
+  for(auto domain = domains.begin(); domain != domains.end(); ++domain)
+  {
+    for(unsigned int count : counts)
+    {
+      for(float scale : scales)
+      {
+        good = Check(*domain, count, scale) && good;
+      }
+    }
+  }
+  return good;
+}
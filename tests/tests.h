@@ -0,0 +1,8 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+/// Проверки. Каждая печатает причину ошибки и возвращает false, если не прошла.
+bool TestPolygonCells();
+bool TestDiagramCache();
+
+#endif // TESTS_H
@@ -0,0 +1,28 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = tests
+
+QMAKE_CXXFLAGS += -std=c++11
+unix:QMAKE_CXXFLAGS += -pthread
+unix:LIBS += -pthread
+
+INCLUDEPATH += ..
+
+HEADERS += tests.h
+
+SOURCES += main.cpp \
+    polygon_cells.cpp \
+    diagram_cache.cpp \
+    ../Voronoi.cpp \
+    ../geometry.cpp \
+    ../predicates.cpp \
+    ../sort.cpp \
+    ../storage.cpp \
+    ../archive.cpp \
+    ../compression.cpp \
+    ../export.cpp \
+    ../cache.cpp \
+    ../lodepng/lodepng.cpp
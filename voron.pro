@@ -4,17 +4,47 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 QMAKE_CXXFLAGS += -std=c++11
+unix:QMAKE_CXXFLAGS += -pthread
+# Разрешает компилятору векторизовать циклы обрезки с ветвлениями (geometry.cpp).
+unix:QMAKE_CXXFLAGS += -fno-trapping-math
+unix:LIBS += -pthread
 
 SOURCES += main.cpp \
     image.cpp \
     Voronoi.cpp \
     geometry.cpp \
+    compression.cpp \
+    export.cpp \
+    storage.cpp \
+    archive.cpp \
+    cache.cpp \
+    sites.cpp \
+    sort.cpp \
+    predicates.cpp \
+    IntVoronoi.cpp \
+    compact.cpp \
+    batch.cpp \
+    SmallVoronoi.cpp \
     lodepng/lodepng.cpp
 
 HEADERS += \
     image.h \
     Voronoi.h \
     geometry.h \
+    compression.h \
+    export.h \
+    storage.h \
+    archive.h \
+    cache.h \
+    sites.h \
+    sort.h \
+    predicates.h \
+    int128.h \
+    IntVoronoi.h \
+    compact.h \
+    batch.h \
+    SmallVoronoi.h \
+    parallel.h \
     lodepng/lodepng.h \
     Lloyd.h \
     gif-h/gif.h